@@ -0,0 +1,124 @@
+/*
+ benchmark_sensing_matrix.cpp
+
+ Microbenchmark of the assembly of the dense sensing matrix
+ (ALM::get_matrix_elements) for a diamond Si supercell with random
+ displacements. The elapsed time and the effective write bandwidth are
+ reported for several panel sizes. nrows_panel = 6, i.e. a single row
+ block of 3 * natmin rows, corresponds to scattering each row block
+ directly into the column-major matrix.
+
+ Usage: benchmark_sensing_matrix [ncell] [ndata] [norder]
+
+ Build with cmake -DBUILD_BENCHMARK=ON, or compile e.g. as
+ $ g++ -O2 -fopenmp -DWITH_SPARSE_SOLVER -I../src -I/path/to/eigen3 benchmark_sensing_matrix.cpp \
+       -L../lib -lalmcxx -lsymspg -llapack
+*/
+
+#include "alm.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+int main(int argc, char **argv)
+{
+    const int ncell = argc > 1 ? std::atoi(argv[1]) : 4;
+    const int ndata = argc > 2 ? std::atoi(argv[2]) : 20;
+    const int norder = argc > 3 ? std::atoi(argv[3]) : 1;
+
+    // Diamond structure in the conventional cell
+    const double a_si = 10.262; // Bohr
+    const double xfrac[8][3] = {{0.0, 0.0, 0.0}, {0.0, 0.5, 0.5},
+                                {0.5, 0.0, 0.5}, {0.5, 0.5, 0.0},
+                                {0.25, 0.25, 0.25}, {0.25, 0.75, 0.75},
+                                {0.75, 0.25, 0.75}, {0.75, 0.75, 0.25}};
+
+    const size_t nat = 8 * ncell * ncell * ncell;
+    double lavec[3][3] = {{a_si * ncell, 0.0, 0.0},
+                          {0.0, a_si * ncell, 0.0},
+                          {0.0, 0.0, a_si * ncell}};
+    std::vector<double> xcoord(3 * nat);
+    std::vector<int> kd(nat, 1);
+    std::string kdname[1] = {"Si"};
+
+    size_t iat = 0;
+    for (auto i = 0; i < ncell; ++i) {
+        for (auto j = 0; j < ncell; ++j) {
+            for (auto k = 0; k < ncell; ++k) {
+                for (auto l = 0; l < 8; ++l) {
+                    xcoord[3 * iat] = (xfrac[l][0] + i) / ncell;
+                    xcoord[3 * iat + 1] = (xfrac[l][1] + j) / ncell;
+                    xcoord[3 * iat + 2] = (xfrac[l][2] + k) / ncell;
+                    ++iat;
+                }
+            }
+        }
+    }
+
+    // Random displacements and forces
+    std::mt19937 rng(1234);
+    std::normal_distribution<double> dist(0.0, 0.02);
+    std::vector<double> u(3 * nat * ndata), f(3 * nat * ndata);
+    for (auto &it : u) it = dist(rng);
+    for (auto &it : f) it = dist(rng);
+
+    auto alm = new ALM_NS::ALM();
+    alm->set_verbosity(0);
+    alm->set_cell(nat, lavec,
+                  reinterpret_cast<const double (*)[3]>(&xcoord[0]),
+                  &kd[0], kdname);
+
+    std::vector<int> nbody(norder);
+    for (auto i = 0; i < norder; ++i) nbody[i] = i + 2;
+    alm->define(norder, 0, &nbody[0], nullptr);
+    alm->generate_force_constant();
+    alm->set_constraint_type(11);
+    alm->set_displacement_and_force(&u[0], &f[0], nat, ndata);
+
+    size_t ncols = 0;
+    for (auto i = 0; i < norder; ++i) {
+        ncols += alm->get_number_of_irred_fc_elements(i + 1);
+    }
+    const auto nrows = alm->get_nrows_sensing_matrix();
+
+    std::vector<double> amat(nrows * ncols);
+    std::vector<double> bvec(nrows);
+
+    std::cout << " NAT = " << nat << ", NDATA = " << ndata
+        << ", sensing matrix: " << nrows << " x " << ncols
+        << " (" << static_cast<double>(nrows * ncols) * 8.0e-9 << " GB)" << std::endl;
+    std::cout << std::setw(14) << "nrows_panel"
+        << std::setw(14) << "time (s)"
+        << std::setw(14) << "GB/s" << std::endl;
+
+    const std::vector<int> nrows_panel{6, 64, 256, 1024, 0};
+
+    for (const auto it : nrows_panel) {
+        alm->set_sensing_matrix_panel_rows(it);
+
+        // The first call also compiles the list of terms of the sensing matrix.
+        alm->get_matrix_elements(&amat[0], &bvec[0]);
+
+        auto t_min = 1.0e+30;
+        for (auto itry = 0; itry < 3; ++itry) {
+            const auto t_start = std::chrono::steady_clock::now();
+            alm->get_matrix_elements(&amat[0], &bvec[0]);
+            const auto t_end = std::chrono::steady_clock::now();
+            t_min = std::min(t_min, std::chrono::duration<double>(t_end - t_start).count());
+        }
+
+        std::cout << std::setw(14) << (it == 0 ? "auto" : std::to_string(it))
+            << std::setw(14) << std::fixed << std::setprecision(4) << t_min
+            << std::setw(14) << static_cast<double>(nrows * ncols) * 8.0e-9 / t_min
+            << std::endl;
+        std::cout.unsetf(std::ios::fixed);
+    }
+
+    delete alm;
+    return 0;
+}
@@ -17,9 +17,12 @@ static PyObject * py_alm_new(PyObject *self, PyObject *args);
 static PyObject * py_alm_delete(PyObject *self, PyObject *args);
 static PyObject * py_run_suggest(PyObject *self, PyObject *args);
 static PyObject * py_optimize(PyObject *self, PyObject *args);
+static PyObject * py_optimize_multiple_forces(PyObject *self, PyObject *args);
 static PyObject * py_set_cell(PyObject *self, PyObject *args);
 static PyObject * py_set_verbosity(PyObject *self, PyObject *args);
 static PyObject * py_set_displacement_and_force(PyObject *self, PyObject *args);
+static PyObject * py_append_displacement_and_force(PyObject *self, PyObject *args);
+static PyObject * py_set_incremental_mode(PyObject *self, PyObject *args);
 static PyObject * py_get_nrows_amat(PyObject *self, PyObject *args);
 static PyObject * py_set_constraint_type(PyObject *self, PyObject *args);
 static PyObject * py_define(PyObject *self, PyObject *args);
@@ -62,9 +65,12 @@ static PyMethodDef _alm_methods[] = {
   {"alm_delete", py_alm_delete, METH_VARARGS, ""},
   {"run_suggest", py_run_suggest, METH_VARARGS, ""},
   {"optimize", py_optimize, METH_VARARGS, ""},
+  {"optimize_multiple_forces", py_optimize_multiple_forces, METH_VARARGS, ""},
   {"set_cell", py_set_cell, METH_VARARGS, ""},
   {"set_verbosity", py_set_verbosity, METH_VARARGS, ""},
   {"set_displacement_and_force", py_set_displacement_and_force, METH_VARARGS, ""},
+  {"append_displacement_and_force", py_append_displacement_and_force, METH_VARARGS, ""},
+  {"set_incremental_mode", py_set_incremental_mode, METH_VARARGS, ""},
   {"set_constraint_type", py_set_constraint_type, METH_VARARGS, ""},
   {"define", py_define, METH_VARARGS, ""},
   {"generate_force_constant", py_generate_force_constant, METH_VARARGS, ""},
@@ -195,6 +201,35 @@ static PyObject * py_optimize(PyObject *self, PyObject *args)
   return PyLong_FromLong((long) info);
 }
 
+static PyObject * py_optimize_multiple_forces(PyObject *self, PyObject *args)
+{
+  int id, info;
+  PyArrayObject* py_u;
+  PyArrayObject* py_f;
+  const char *solver;
+  PyArrayObject* py_fc_out;
+
+  if (!PyArg_ParseTuple(args, "iOOsO",
+                              &id,
+                              &py_u,
+                              &py_f,
+                              &solver,
+                              &py_fc_out)) {
+    return NULL;
+  }
+
+  const double* u = (double*)PyArray_DATA(py_u);
+  const double* f = (double*)PyArray_DATA(py_f);
+  double* fc_out = (double*)PyArray_DATA(py_fc_out);
+
+  const size_t nrhs = (size_t)PyArray_DIMS(py_f)[0];
+  const size_t ndata_used = (size_t)PyArray_DIMS(py_f)[1];
+  const size_t nat = (size_t)PyArray_DIMS(py_f)[2];
+  info = alm_optimize_multiple_forces(id, u, f, nat, ndata_used, nrhs, solver, fc_out);
+
+  return PyLong_FromLong((long) info);
+}
+
 static PyObject * py_set_cell(PyObject *self, PyObject *args)
 {
   int id;
@@ -259,6 +294,42 @@ static PyObject * py_set_displacement_and_force(PyObject *self, PyObject *args)
   Py_RETURN_NONE;
 }
 
+static PyObject * py_append_displacement_and_force(PyObject *self, PyObject *args)
+{
+  int id;
+  PyArrayObject* py_u;
+  PyArrayObject* py_f;
+  if (!PyArg_ParseTuple(args, "iOO",
+                              &id,
+                              &py_u,
+                              &py_f)) {
+    return NULL;
+  }
+
+  const double* u = (double*)PyArray_DATA(py_u);
+  const double* f = (double*)PyArray_DATA(py_f);
+
+  const size_t ndata_used = (size_t)PyArray_DIMS(py_f)[0];
+  const size_t nat = (size_t)PyArray_DIMS(py_f)[1];
+  alm_append_displacement_and_force(id, u, f, nat, ndata_used);
+
+  Py_RETURN_NONE;
+}
+
+static PyObject * py_set_incremental_mode(PyObject *self, PyObject *args)
+{
+  int id, incremental_mode;
+  if (!PyArg_ParseTuple(args, "ii",
+                              &id,
+                              &incremental_mode)) {
+    return NULL;
+  }
+
+  alm_set_incremental_mode(id, incremental_mode);
+
+  Py_RETURN_NONE;
+}
+
 static PyObject * py_set_constraint_type(PyObject *self, PyObject *args)
 {
   int id, iconst;
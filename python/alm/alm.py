@@ -109,19 +109,50 @@ class ALM:
 
         alm.run_suggest(self._id)
 
-    def optimize(self, solver='dense'):
+    def optimize(self, solver='dense', incremental=None):
         """Fit force constants to forces.
 
         Parameters
         ----------
         solver : str, default='dense'
-            Solver choice for fitting either 'dense' or 'SimplicialLDLT'.
+            Solver choice for fitting. One of the dense solvers 'dense',
+            'QR', 'TSQR', 'Cholesky', and 'SketchLSQR', or one of the sparse solvers
+            'SimplicialLDLT', 'SimplicialLLT', 'SparseQR',
+            'ConjugateGradient', 'LeastSquaresConjugateGradient',
+            'BiCGSTAB', 'LSQR', and 'CholmodSupernodalLLT'.
 
             - When solver='dense', the fitting is performed with the
               singular value decomposition implemented in LAPACK.
+            - When solver='QR' or 'Cholesky', the fitting is performed
+              with the QR decomposition of the sensing matrix or the
+              Cholesky decomposition of the normal equation, respectively.
+              These are faster than 'dense' and fall back to the singular
+              value decomposition when the sensing matrix is
+              rank-deficient. 'TSQR' is the parallel version of 'QR',
+              where the row blocks of the sensing matrix are factorized
+              by different OpenMP threads. 'SketchLSQR' runs LSQR
+              preconditioned by the QR factor of a random sketch of the
+              sensing matrix, which is efficient when the sensing matrix
+              has many more rows than columns.
             - When solver='SimplicialLDLT', the fitting is performed with
               the sparse solver class SimplicialLDLT implemented in
-              Eigen3 library.
+              Eigen3 library. The other Eigen3 solvers are used in the
+              same way. 'SimplicialLDLT', 'SimplicialLLT',
+              'ConjugateGradient', 'BiCGSTAB', and 'CholmodSupernodalLLT'
+              solve the normal equation, whereas 'SparseQR',
+              'LeastSquaresConjugateGradient', and 'LSQR' work on the
+              sensing matrix directly. 'CholmodSupernodalLLT' is
+              available only when ALM is built with CHOLMOD.
+        incremental : bool, default=None
+            When True, the R factor of the QR decomposition of the
+            sensing matrix is kept after the fitting. In the next call
+            with incremental=True, only the entries added by
+            append_displacement_and_force are converted into the sensing
+            matrix and absorbed into the R factor, and the solution is
+            updated without refitting all the data. The solver option is
+            ignored in this mode. Available when the constraint type is
+            0, 10, or 11. When None, the mode set in the previous call is
+            kept, which is False at first.
 
         Returns
         -------
@@ -134,15 +165,81 @@ class ALM:
         if self._id is None:
             self._show_error_message()
 
-        if solver not in ['dense', 'SimplicialLDLT']:
+        solvers = ['dense', 'QR', 'TSQR', 'Cholesky', 'SketchLSQR',
+                   'SimplicialLDLT', 'SimplicialLLT', 'SparseQR',
+                   'ConjugateGradient', 'LeastSquaresConjugateGradient',
+                   'BiCGSTAB', 'LSQR', 'CholmodSupernodalLLT']
+        if solver not in solvers:
             print("The given solver option is not supported.")
-            print("Available options are 'dense' and 'SimplicialLDLT'.")
+            print("Available options are %s." % ", ".join(solvers))
             raise ValueError
 
+        if incremental is not None:
+            alm.set_incremental_mode(self._id, int(incremental))
         info = alm.optimize(self._id, solver)
 
         return info
 
+    def optimize_multiple_forces(self, u, f, solver='dense'):
+        """Fit force constants to several force sets at once.
+
+        The force sets are calculated for the same displacements, e.g.,
+        with different exchange-correlation functionals. The sensing
+        matrix is constructed and factorized only once, and all the force
+        sets are solved with the same factorization. The data given by
+        set_displacement_and_force are not used nor modified.
+
+        Parameters
+        ----------
+        u : array_like
+            Atomic displacement patterns in supercells in Cartesian.
+            dtype='double'
+            shape=(supercells, num_atoms, 3)
+        f : array_like
+            Sets of forces in supercells.
+            dtype='double'
+            shape=(num_sets, supercells, num_atoms, 3)
+        solver : str, default='dense'
+            One of the dense solvers 'dense', 'QR', 'TSQR', 'Cholesky',
+            and 'SketchLSQR'.
+            See optimize for details.
+
+        Returns
+        -------
+        info : int
+            0 if the fitting is successful, 1 otherwise.
+        fc_sets : ndarray
+            Irreducible sets of force constants of all orders, one per
+            force set. Each of them can be given to set_fc to use get_fc.
+            dtype='double'
+            shape=(num_sets, num_fc_irred)
+
+        """
+
+        if self._id is None:
+            self._show_error_message()
+
+        solvers = ['dense', 'QR', 'TSQR', 'Cholesky', 'SketchLSQR']
+        if solver not in solvers:
+            print("The given solver option is not supported.")
+            print("Available options are %s." % ", ".join(solvers))
+            raise ValueError
+
+        u = np.array(u, dtype='double', order='C')
+        f = np.array(f, dtype='double', order='C')
+        if f.ndim != 4 or f.shape[1:] != u.shape:
+            print("The shape of the force array must be (num_sets,) + u.shape.")
+            raise ValueError
+
+        fc_length_irred = 0
+        for i in range(self._maxorder):
+            fc_length_irred += self._get_number_of_irred_fc_elements(i + 1)
+
+        fc_sets = np.zeros((f.shape[0], fc_length_irred), dtype='double')
+        info = alm.optimize_multiple_forces(self._id, u, f, solver, fc_sets)
+
+        return info, fc_sets
+
     def set_displacement_and_force(self, u, f):
         """Set displacements and respective forces in supercell.
 
@@ -167,6 +264,34 @@ class ALM:
             np.array(u, dtype='double', order='C'),
             np.array(f, dtype='double', order='C'))
 
+    def append_displacement_and_force(self, u, f):
+        """Append displacements and respective forces in supercell.
+
+        The given data are added to those set by set_displacement_and_force
+        or the previous calls of this method. This is useful together
+        with optimize(incremental=True).
+
+        Parameters
+        ----------
+        u : array_like
+            Atomic displacement patterns in supercells in Cartesian.
+            dtype='double'
+            shape=(supercells, num_atoms, 3)
+        f : array_like
+            Forces in supercells.
+            dtype='double'
+            shape=(supercells, num_atoms, 3)
+
+        """
+
+        if self._id is None:
+            self._show_error_message()
+
+        alm.append_displacement_and_force(
+            self._id,
+            np.array(u, dtype='double', order='C'),
+            np.array(f, dtype='double', order='C'))
+
     def define(self, maxorder, cutoff_radii=None, nbody=None):
         """Define the Taylor expansion potential.
 
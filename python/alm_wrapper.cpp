@@ -148,6 +148,21 @@ extern "C" {
         alm[id]->set_displacement_and_force(u_in, f_in, nat, ndata_used);
     }
 
+    void alm_append_displacement_and_force(const int id,
+                                           const double* u_in,
+                                           const double* f_in,
+                                           const size_t nat,
+                                           const size_t ndata_used)
+    {
+        alm[id]->append_displacement_and_force(u_in, f_in, nat, ndata_used);
+    }
+
+    void alm_set_incremental_mode(const int id,
+                                  const int incremental_mode)
+    {
+        alm[id]->set_incremental_mode(incremental_mode);
+    }
+
     size_t alm_get_nrows_sensing_matrix(const int id)
     {
         return alm[id]->get_nrows_sensing_matrix();
@@ -307,11 +322,29 @@ extern "C" {
         if (str_solver == "dense") {
 
             alm[id]->set_sparse_mode(0);
+            alm[id]->set_dense_solver("SVD");
             info = alm[id]->run_optimize();
 
-        } else if (str_solver == "SimplicialLDLT") {
+        } else if (str_solver == "QR"
+            || str_solver == "TSQR"
+            || str_solver == "Cholesky"
+            || str_solver == "SketchLSQR") {
+
+            alm[id]->set_sparse_mode(0);
+            alm[id]->set_dense_solver(str_solver);
+            info = alm[id]->run_optimize();
+
+        } else if (str_solver == "SimplicialLDLT"
+            || str_solver == "SimplicialLLT"
+            || str_solver == "SparseQR"
+            || str_solver == "ConjugateGradient"
+            || str_solver == "LeastSquaresConjugateGradient"
+            || str_solver == "BiCGSTAB"
+            || str_solver == "LSQR"
+            || str_solver == "CholmodSupernodalLLT") {
 
             alm[id]->set_sparse_mode(1);
+            alm[id]->set_sparse_solver(str_solver);
             info = alm[id]->run_optimize();
 
         } else {
@@ -320,4 +353,32 @@ extern "C" {
         }
         return info;
     }
+
+    int alm_optimize_multiple_forces(const int id,
+                                     const double* u_in,
+                                     const double* f_in,
+                                     const size_t nat,
+                                     const size_t ndata_used,
+                                     const size_t nrhs,
+                                     const char *solver,
+                                     double *fc_out)
+    {
+        alm[id]->set_run_mode("fitting");
+        std::string str_solver = std::string(solver);
+
+        // Only the dense solvers can share the factorization.
+        // The solver is passed to this call only, and DENSESOLVER and SPARSE are kept.
+        if (str_solver == "dense") {
+            str_solver = "SVD";
+        } else if (str_solver != "QR"
+            && str_solver != "TSQR"
+            && str_solver != "Cholesky"
+            && str_solver != "SketchLSQR") {
+            std::cerr << " Unsupported solver type : " << str_solver << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        return alm[id]->optimize_multiple_forces(u_in, f_in, nat, ndata_used, nrhs,
+                                                 str_solver, fc_out);
+    }
 }
@@ -35,6 +35,15 @@ extern "C" {
                                         const size_t nat,
                                         const size_t ndata_used);
 
+    void alm_append_displacement_and_force(const int id,
+                                           const double* u_in,
+                                           const double* f_in,
+                                           const size_t nat,
+                                           const size_t ndata_used);
+
+    void alm_set_incremental_mode(const int id,
+                                  const int incremental_mode);
+
     void alm_set_constraint_type(const int id,
                                  const int constraint_flag); // ICONST
     // void set_fitting_constraint_rotation_axis(const std::string rotation_axis) // ROTAXIS
@@ -88,6 +97,14 @@ extern "C" {
     void alm_run_suggest(const int id);
     int alm_optimize(const int id,
                      const char *solver);
+    int alm_optimize_multiple_forces(const int id,
+                                     const double* u_in,
+                                     const double* f_in,
+                                     const size_t nat,
+                                     const size_t ndata_used,
+                                     const size_t nrhs,
+                                     const char *solver,
+                                     double *fc_out);
 
 #ifdef __cplusplus
 }
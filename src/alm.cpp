@@ -164,14 +164,41 @@ void ALM::set_displacement_and_force(const double *u_in,
     f.clear();
 }
 
-void ALM::set_constraint_type(const int constraint_flag) const // ICONST
+void ALM::append_displacement_and_force(const double *u_in,
+                                        const double *f_in,
+                                        const int nat,
+                                        const int ndata_used) const
 {
+    // Entries are added to those given before. With the incremental mode,
+    // only the added entries are processed in the next run_optimize.
+    std::vector<std::vector<double>> u, f;
+
+    u.resize(ndata_used, std::vector<double>(3 * nat));
+    f.resize(ndata_used, std::vector<double>(3 * nat));
+
+    for (auto i = 0; i < ndata_used; i++) {
+        for (auto j = 0; j < 3 * nat; j++) {
+            u[i][j] = u_in[i * nat * 3 + j];
+            f[i][j] = f_in[i * nat * 3 + j];
+        }
+    }
+    optimize->append_training_data(u, f);
+}
+
+void ALM::set_constraint_type(const int constraint_flag) // ICONST
+{
+    // The constraints are set up again at the next fitting, and the R factor
+    // of the incremental mode built with the old ones is discarded.
     constraint->set_constraint_mode(constraint_flag);
+    ready_to_fit = false;
+    optimize->reset_incremental_factor();
 }
 
-void ALM::set_rotation_axis(const std::string rotation_axis) const // ROTAXIS
+void ALM::set_rotation_axis(const std::string rotation_axis) // ROTAXIS
 {
     constraint->set_rotation_axis(rotation_axis);
+    ready_to_fit = false;
+    optimize->reset_incremental_factor();
 }
 
 void ALM::set_sparse_mode(const int sparse_mode) const // SPARSE
@@ -181,6 +208,35 @@ void ALM::set_sparse_mode(const int sparse_mode) const // SPARSE
     optimize->set_optimizer_control(optctrl);
 }
 
+void ALM::set_sparse_solver(const std::string sparse_solver) const // SPARSESOLVER
+{
+    auto optctrl = optimize->get_optimizer_control();
+    optctrl.sparsesolver = sparse_solver;
+    optimize->set_optimizer_control(optctrl);
+}
+
+void ALM::set_incremental_mode(const int incremental_mode) const
+{
+    auto optctrl = optimize->get_optimizer_control();
+    optctrl.incremental = incremental_mode;
+    optimize->set_optimizer_control(optctrl);
+}
+
+void ALM::set_dense_solver(const std::string dense_solver) const // DENSESOLVER
+{
+    auto optctrl = optimize->get_optimizer_control();
+    optctrl.densesolver = dense_solver;
+    optimize->set_optimizer_control(optctrl);
+}
+
+void ALM::set_sensing_matrix_panel_rows(const int nrows_panel) const
+{
+    // 0 selects the panel size automatically.
+    auto optctrl = optimize->get_optimizer_control();
+    optctrl.nrows_panel = nrows_panel;
+    optimize->set_optimizer_control(optctrl);
+}
+
 //void ALM::set_fitting_filenames(const std::string dfile,
 //                                // DFILE
 //                                const std::string ffile) const // FFILE
@@ -501,6 +557,7 @@ void ALM::get_matrix_elements(double *amat,
     std::vector<double> amat_vec;
     std::vector<double> bvec_vec;
 
+    optimize->update_sensing_matrix_plan(maxorder, symmetry, fcs);
     optimize->get_matrix_elements_algebraic_constraint(maxorder,
                                                        amat_vec,
                                                        bvec_vec,
@@ -575,6 +632,81 @@ int ALM::run_optimize()
     return info;
 }
 
+int ALM::optimize_multiple_forces(const double *u_in,
+                                  const double *f_in,
+                                  const int nat,
+                                  const int ndata_used,
+                                  const int nrhs,
+                                  const std::string dense_solver,
+                                  double *fc_out)
+{
+    // Fit nrhs sets of forces for the same displacements at once.
+    // The irreducible force constants of each set are stored in fc_out
+    // and can be passed to set_fc. The training data are not modified.
+    // dense_solver is used only in this call, and the optimizer settings are restored.
+
+    if (!structure_initialized) {
+        std::cout << "initialize_structure must be called beforehand." << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    if (!ready_to_fit) {
+        constraint->setup(system,
+                          fcs,
+                          cluster,
+                          symmetry,
+                          run_mode,
+                          verbosity,
+                          timer);
+        ready_to_fit = true;
+    }
+
+    const auto nat3 = 3 * nat;
+    std::vector<std::vector<double>> u(ndata_used, std::vector<double>(nat3));
+    std::vector<std::vector<std::vector<double>>> f(nrhs,
+                                                    std::vector<std::vector<double>>(ndata_used,
+                                                                                     std::vector<double>(nat3)));
+
+    for (auto i = 0; i < ndata_used; i++) {
+        for (auto j = 0; j < nat3; j++) {
+            u[i][j] = u_in[i * nat3 + j];
+        }
+    }
+    for (auto k = 0; k < nrhs; k++) {
+        for (auto i = 0; i < ndata_used; i++) {
+            for (auto j = 0; j < nat3; j++) {
+                f[k][i][j] = f_in[(k * ndata_used + i) * nat3 + j];
+            }
+        }
+    }
+
+    const auto optctrl_saved = optimize->get_optimizer_control();
+    auto optctrl = optctrl_saved;
+    optctrl.use_sparse_solver = 0;
+    if (!dense_solver.empty()) optctrl.densesolver = dense_solver;
+    optimize->set_optimizer_control(optctrl);
+
+    std::vector<std::vector<double>> fc_irred;
+    const auto info = optimize->optimize_multiple_rhs(symmetry,
+                                                      constraint,
+                                                      fcs,
+                                                      cluster->get_maxorder(),
+                                                      u,
+                                                      f,
+                                                      verbosity,
+                                                      fc_irred,
+                                                      timer);
+
+    optimize->set_optimizer_control(optctrl_saved);
+
+    if (info == 0) {
+        size_t i = 0;
+        for (const auto &it : fc_irred) {
+            for (const auto val : it) fc_out[i++] = val;
+        }
+    }
+    return info;
+}
+
 void ALM::run_suggest() const
 {
     displace->gen_displacement_pattern(cluster,
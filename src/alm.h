@@ -64,9 +64,17 @@ namespace ALM_NS
                                         const double *f_in,
                                         int nat,
                                         int ndata_used) const;
-        void set_constraint_type(int constraint_flag) const;
-        void set_rotation_axis(std::string rotation_axis) const;
+        void append_displacement_and_force(const double *u_in,
+                                           const double *f_in,
+                                           int nat,
+                                           int ndata_used) const;
+        void set_constraint_type(int constraint_flag);
+        void set_rotation_axis(std::string rotation_axis);
         void set_sparse_mode(int sparse_mode) const;
+        void set_sparse_solver(std::string sparse_solver) const;
+        void set_incremental_mode(int incremental_mode) const;
+        void set_dense_solver(std::string dense_solver) const;
+        void set_sensing_matrix_panel_rows(int nrows_panel) const;
         //void set_fitting_filenames(std::string dfile,
         //                           std::string ffile) const;
         void define(const int maxorder,
@@ -119,6 +127,14 @@ namespace ALM_NS
                                  double *bvec) const;
         void generate_force_constant();
         int run_optimize();
+        int optimize_multiple_forces(const double *u_in,
+                                     const double *f_in,
+                                     // (nrhs, ndata_used, nat, 3) is flatten.
+                                     const int nat,
+                                     const int ndata_used,
+                                     const int nrhs,
+                                     const std::string dense_solver, // empty: use DENSESOLVER
+                                     double *fc_out); // (nrhs, len(irreducible fc)) is flatten.
         void run_suggest() const;
         void run();
 
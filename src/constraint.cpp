@@ -25,6 +25,7 @@
 #include <iomanip>
 #include <boost/bimap.hpp>
 #include <algorithm>
+#include <iterator>
 #include <unordered_set>
 #include <map>
 #include <boost/property_tree/ptree.hpp>
@@ -51,6 +52,7 @@ void Constraint::set_default_variables()
     fix_harmonic = false;
     fix_cubic = false;
     constraint_algebraic = 1;
+    constraint_solver = "DGGLSE";
     fc2_file = "";
     fc3_file = "";
     exist_constraint = false;
@@ -309,20 +311,29 @@ void Constraint::setup(const System *system,
             nparams += fcs->get_nequiv()[order].size();
         }
 
-        if (const_mat) {
-            deallocate(const_mat);
-        }
-        allocate(const_mat, Pmax, nparams);
+        if (constraint_solver == "NullSpace") {
 
-        if (const_rhs) {
-            deallocate(const_rhs);
-        }
-        allocate(const_rhs, Pmax);
+            // null_space is updated. const_mat is not allocated.
+            number_of_constraints = calc_constraint_null_space(maxorder,
+                                                               fcs->get_nequiv(),
+                                                               nparams);
+        } else {
+
+            if (const_mat) {
+                deallocate(const_mat);
+            }
+            allocate(const_mat, Pmax, nparams);
 
-        // const_mat and const_rhs are updated.
-        number_of_constraints = calc_constraint_matrix(maxorder,
-                                                       fcs->get_nequiv(),
-                                                       nparams);
+            if (const_rhs) {
+                deallocate(const_rhs);
+            }
+            allocate(const_rhs, Pmax);
+
+            // const_mat and const_rhs are updated.
+            number_of_constraints = calc_constraint_matrix(maxorder,
+                                                           fcs->get_nequiv(),
+                                                           nparams);
+        }
     }
 
     exist_constraint
@@ -397,6 +408,13 @@ void Constraint::setup(const System *system,
 
                 std::cout << "  Total number of constraints = " << number_of_constraints << std::endl << std::endl;
 
+                if (constraint_solver == "NullSpace") {
+                    std::cout << "  CONST_SOLVER = NullSpace : The fitting is performed in the null space"
+                        << std::endl;
+                    std::cout << "  of the constraints. Number of free parameters = "
+                        << null_space.get_nfree() << std::endl << std::endl;
+                }
+
             }
         }
         timer->print_elapsed();
@@ -525,6 +543,120 @@ size_t Constraint::calc_constraint_matrix(const int maxorder,
     return nconst;
 }
 
+size_t Constraint::calc_constraint_null_space(const int maxorder,
+                                              const std::vector<size_t> *nequiv,
+                                              const size_t nparams)
+{
+    // The same constraints as in calc_constraint_matrix are collected in the sparse form
+    // and reduced to the row echelon form. Each row then expresses a pivot parameter
+    // by the free ones as x[pivot] = -sum_j c_j x[j], which gives the columns of Z.
+    // The fixed force constants are not free. Their values are taken from const_fix
+    // when fitting because they may be rescaled after the setup.
+
+    size_t i;
+    int order;
+    ConstraintSparseForm const_total;
+    std::vector<int> is_free(nparams, 1);
+    size_t nconst = 0;
+
+    size_t nshift = 0;
+
+    for (order = 0; order < maxorder; ++order) {
+        if (const_fix[order].empty()) {
+            for (const auto &p : const_self[order]) {
+                std::map<size_t, double> row_tmp;
+                for (const auto &it : p) {
+                    row_tmp[nshift + it.first] = it.second;
+                }
+                const_total.push_back(row_tmp);
+            }
+        }
+        nshift += nequiv[order].size();
+    }
+
+    const auto nconst1 = const_total.size();
+
+    // Inter-order constraints
+    size_t nshift2 = 0;
+    for (order = 1; order < maxorder; ++order) {
+        if (const_fix[order - 1].empty() && const_fix[order].empty()) {
+            for (const auto &p : const_rotation_cross[order]) {
+                std::map<size_t, double> row_tmp;
+                for (const auto &it : p) {
+                    row_tmp[nshift2 + it.first] = it.second;
+                }
+                const_total.push_back(row_tmp);
+            }
+        }
+        nshift2 += nequiv[order - 1].size();
+    }
+
+    if (nconst1 != const_total.size()) {
+        rref_sparse(nparams, const_total, tolerance_constraint);
+    }
+
+    if (fix_harmonic) {
+        for (const auto &p : const_fix[0]) {
+            is_free[p.p_index_target] = 0;
+        }
+        nconst += const_fix[0].size();
+    }
+
+    if (fix_cubic && maxorder > 1) {
+        const auto ishift2 = nequiv[0].size();
+        for (const auto &p : const_fix[1]) {
+            is_free[p.p_index_target + ishift2] = 0;
+        }
+        nconst += const_fix[1].size();
+    }
+
+    for (const auto &p : const_total) {
+        is_free[p.begin()->first] = 0;
+    }
+    nconst += const_total.size();
+
+    std::vector<size_t> index_free(nparams, nparams);
+    size_t nfree = 0;
+    for (i = 0; i < nparams; ++i) {
+        if (is_free[i]) index_free[i] = nfree++;
+    }
+
+    // Entries of the pivot parameters for each column of Z
+
+    std::vector<std::vector<std::pair<size_t, double>>> z_cols(nfree);
+
+    for (const auto &p : const_total) {
+        const auto ipivot = p.begin()->first;
+        for (auto it = std::next(p.begin()); it != p.end(); ++it) {
+            if (index_free[it->first] == nparams) {
+                exit("calc_constraint_null_space",
+                     "The constraint matrix is not in the reduced row echelon form.");
+            }
+            z_cols[index_free[it->first]].emplace_back(ipivot, -it->second);
+        }
+    }
+    const_total.clear();
+
+    null_space.clear();
+    null_space.nparams = nparams;
+    null_space.col_ptr.reserve(nfree + 1);
+    null_space.col_ptr.push_back(0);
+
+    for (i = 0; i < nparams; ++i) {
+        if (!is_free[i]) continue;
+        auto &z_col = z_cols[index_free[i]];
+        z_col.emplace_back(i, 1.0);
+        std::sort(z_col.begin(), z_col.end());
+        for (const auto &it : z_col) {
+            null_space.row_index.push_back(it.first);
+            null_space.values.push_back(it.second);
+        }
+        null_space.col_ptr.push_back(null_space.row_index.size());
+        z_col.clear();
+    }
+
+    return nconst;
+}
 
 void Constraint::get_mapping_constraint(const int nmax,
                                         const std::vector<size_t> *nequiv,
@@ -674,6 +806,16 @@ int Constraint::get_constraint_algebraic() const
     return constraint_algebraic;
 }
 
+std::string Constraint::get_constraint_solver() const
+{
+    return constraint_solver;
+}
+
+void Constraint::set_constraint_solver(const std::string constraint_solver_in)
+{
+    constraint_solver = constraint_solver_in;
+}
+
 double** Constraint::get_const_mat() const
 {
     return const_mat;
@@ -684,6 +826,11 @@ double* Constraint::get_const_rhs() const
     return const_rhs;
 }
 
+const ConstraintNullSpace& Constraint::get_null_space() const
+{
+    return null_space;
+}
+
 double Constraint::get_tolerance_constraint() const
 {
     return tolerance_constraint;
@@ -193,6 +193,34 @@ namespace ALM_NS
         return true;
     }
 
+    class ConstraintNullSpace
+    {
+        // Basis Z of the null space of the homogeneous constraints (CONST_SOLVER = NullSpace).
+        // The parameters satisfying the constraints are x = x0 + Z y, where x0 holds
+        // the fixed force constants and y the free parameters.
+        // Z is a nparams x nfree matrix stored column by column (CSC format).
+    public:
+        size_t nparams;
+        std::vector<size_t> col_ptr;
+        std::vector<size_t> row_index;
+        std::vector<double> values;
+
+        ConstraintNullSpace() : nparams(0) { }
+
+        size_t get_nfree() const
+        {
+            return col_ptr.empty() ? 0 : col_ptr.size() - 1;
+        }
+
+        void clear()
+        {
+            nparams = 0;
+            col_ptr.clear();
+            row_index.clear();
+            values.clear();
+        }
+    };
+
     inline bool operator<(const std::map<size_t, double> &obj1,
                           const std::map<size_t, double> &obj2)
     {
@@ -232,8 +260,12 @@ namespace ALM_NS
         void set_fix_cubic(const bool);
         int get_constraint_algebraic() const;
 
+        std::string get_constraint_solver() const;
+        void set_constraint_solver(const std::string);
+
         double** get_const_mat() const;
         double* get_const_rhs() const;
+        const ConstraintNullSpace& get_null_space() const;
 
         double get_tolerance_constraint() const;
         void set_tolerance_constraint(const double);
@@ -260,8 +292,10 @@ namespace ALM_NS
         bool fix_harmonic, fix_cubic;
         int constraint_algebraic;
 
+        std::string constraint_solver; // DGGLSE or NullSpace (used only when ICONST < 10)
         double **const_mat;
         double *const_rhs;
+        ConstraintNullSpace null_space;
 
         double tolerance_constraint;
 
@@ -301,6 +335,11 @@ namespace ALM_NS
                                       const std::vector<size_t> *nequiv,
                                       const size_t nparams) const;
 
+        // null_space is updated.
+        size_t calc_constraint_null_space(const int maxorder,
+                                          const std::vector<size_t> *nequiv,
+                                          const size_t nparams);
+
         void print_constraint(const ConstraintSparseForm &) const;
 
         void setup_rotation_axis(bool [3][3]);
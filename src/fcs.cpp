@@ -65,6 +65,7 @@ void Fcs::init(const Cluster *cluster,
         deallocate(fc_table);
     }
     allocate(fc_table, maxorder);
+    ++generation;
 
     if (nequiv) {
         deallocate(nequiv);
@@ -114,6 +115,7 @@ void Fcs::set_default_variables()
     fc_table = nullptr;
     fc_zeros = nullptr;
     store_zeros = true;
+    generation = 0;
 }
 
 void Fcs::deallocate_variables()
@@ -547,6 +549,11 @@ std::vector<FcProperty>* Fcs::get_fc_table() const
     return fc_table;
 }
 
+size_t Fcs::get_generation() const
+{
+    return generation;
+}
+
 void Fcs::get_available_symmop(const size_t nat,
                                const Symmetry *symmetry,
                                const std::string basis,
@@ -109,8 +109,10 @@ namespace ALM_NS
 
         std::vector<size_t>* get_nequiv() const;
         std::vector<FcProperty>* get_fc_table() const;
+        size_t get_generation() const;
 
     private:
+        size_t generation; // incremented whenever the tables are regenerated
         std::vector<size_t> *nequiv;       // stores duplicate number of irreducible force constants
         std::vector<FcProperty> *fc_table; // all force constants
         std::vector<FcProperty> *fc_zeros; // zero force constants (due to space group symm.)
@@ -9,6 +9,16 @@
 */
 
 #include "files.h"
+#include "error.h"
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#if !(defined(WIN32) || defined(_WIN32))
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 using namespace ALM_NS;
 
@@ -54,3 +64,250 @@ DispForceFile Files::get_datfile_validation() const
 {
     return datfile_validation;
 }
+
+
+DispForceBinaryFile::DispForceBinaryFile()
+{
+    std::memset(&header, 0, sizeof(DispForceBinaryHeader));
+#if !(defined(WIN32) || defined(_WIN32))
+    mapped_addr = nullptr;
+    mapped_size = 0;
+#endif
+}
+
+DispForceBinaryFile::~DispForceBinaryFile()
+{
+    close();
+}
+
+bool DispForceBinaryFile::is_binary(const std::string &filename)
+{
+    char magic[8];
+    std::ifstream ifs(filename.c_str(), std::ios::in | std::ios::binary);
+    if (!ifs) return false;
+    if (!ifs.read(magic, 8)) return false;
+    return std::memcmp(magic, "ALMDFSET", 8) == 0;
+}
+
+void DispForceBinaryFile::open(const std::string &filename)
+{
+    close();
+
+#if defined(WIN32) || defined(_WIN32)
+    ifs_data.open(filename.c_str(), std::ios::in | std::ios::binary);
+    if (!ifs_data) exit("openfiles", "cannot open DFSET file");
+    ifs_data.seekg(0, std::ios::end);
+    const auto file_size = static_cast<size_t>(ifs_data.tellg());
+    ifs_data.seekg(0, std::ios::beg);
+    if (file_size < sizeof(DispForceBinaryHeader)
+        || !ifs_data.read(reinterpret_cast<char *>(&header), sizeof(DispForceBinaryHeader))) {
+        exit("open", "The binary DFSET file is too short: ", filename.c_str());
+    }
+#else
+    const auto fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) exit("openfiles", "cannot open DFSET file");
+
+    struct stat st{};
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        exit("open", "cannot stat DFSET file: ", filename.c_str());
+    }
+    const auto file_size = static_cast<size_t>(st.st_size);
+    if (file_size < sizeof(DispForceBinaryHeader)) {
+        ::close(fd);
+        exit("open", "The binary DFSET file is too short: ", filename.c_str());
+    }
+
+    mapped_addr = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapped_addr == MAP_FAILED) {
+        mapped_addr = nullptr;
+        exit("open", "mmap failed for DFSET file: ", filename.c_str());
+    }
+    mapped_size = file_size;
+    madvise(mapped_addr, mapped_size, MADV_SEQUENTIAL);
+    std::memcpy(&header, mapped_addr, sizeof(DispForceBinaryHeader));
+#endif
+
+    if (std::memcmp(header.magic, "ALMDFSET", 8) != 0) {
+        exit("open", "Not a binary DFSET file: ", filename.c_str());
+    }
+    if (header.byte_order != 0x01020304) {
+        exit("open", "The byte order of the binary DFSET file is different from this machine: ",
+             filename.c_str());
+    }
+    if (header.version != 1) {
+        exit("open", "Unsupported version of the binary DFSET file: ", header.version);
+    }
+    if (header.data_offset < sizeof(DispForceBinaryHeader)
+        || file_size < header.data_offset + 6 * header.nat * header.ndata * sizeof(double)) {
+        exit("open", "The binary DFSET file is truncated: ", filename.c_str());
+    }
+}
+
+void DispForceBinaryFile::close()
+{
+#if defined(WIN32) || defined(_WIN32)
+    if (ifs_data.is_open()) ifs_data.close();
+#else
+    if (mapped_addr) {
+        munmap(mapped_addr, mapped_size);
+        mapped_addr = nullptr;
+        mapped_size = 0;
+    }
+#endif
+}
+
+size_t DispForceBinaryFile::get_nat() const
+{
+    return header.nat;
+}
+
+size_t DispForceBinaryFile::get_ndata() const
+{
+    return header.ndata;
+}
+
+std::string DispForceBinaryFile::get_units() const
+{
+    return std::string(header.units, strnlen(header.units, sizeof(header.units)));
+}
+
+void DispForceBinaryFile::copy_entry(const size_t ientry,
+                                     double *u,
+                                     double *f)
+{
+    const auto nat3 = 3 * header.nat;
+    const auto offset = header.data_offset + 2 * nat3 * ientry * sizeof(double);
+
+#if defined(WIN32) || defined(_WIN32)
+    ifs_data.seekg(offset, std::ios::beg);
+    ifs_data.read(reinterpret_cast<char *>(u), nat3 * sizeof(double));
+    ifs_data.read(reinterpret_cast<char *>(f), nat3 * sizeof(double));
+#else
+    const auto values = reinterpret_cast<const double *>(static_cast<const char *>(mapped_addr) + offset);
+    std::copy(values, values + nat3, u);
+    std::copy(values + nat3, values + 2 * nat3, f);
+#endif
+}
+
+
+DispForceFileReader::DispForceFileReader()
+{
+    nat = 0;
+    ientry = 0;
+    ipos_line = 0;
+    is_binary = false;
+}
+
+DispForceFileReader::~DispForceFileReader()
+{
+    close();
+}
+
+void DispForceFileReader::open(const DispForceFile &datfile_in,
+                               const size_t nat_in)
+{
+    close();
+
+    datfile = datfile_in;
+    nat = nat_in;
+    ientry = 0;
+    values_line.clear();
+    ipos_line = 0;
+
+    is_binary = DispForceBinaryFile::is_binary(datfile.filename);
+
+    if (is_binary) {
+        binfile.open(datfile.filename);
+        if (binfile.get_nat() != nat) {
+            exit("open", "NAT in the binary DFSET file is inconsistent with the input NAT.");
+        }
+    } else {
+        ifs_data.open(datfile.filename.c_str(), std::ios::in);
+        if (!ifs_data) exit("openfiles", "cannot open DFSET file");
+    }
+}
+
+void DispForceFileReader::close()
+{
+    if (ifs_data.is_open()) ifs_data.close();
+    binfile.close();
+}
+
+bool DispForceFileReader::read_entry(std::vector<double> &values)
+{
+    // Read 6 * nat numbers from the file.
+    // Numbers remaining in the current line are kept for the next entry.
+
+    std::string line;
+    double val;
+
+    values.clear();
+
+    while (values.size() < 6 * nat) {
+        if (ipos_line == values_line.size()) {
+            values_line.clear();
+            ipos_line = 0;
+            if (!std::getline(ifs_data >> std::ws, line)) return false;
+            if (line[0] == '#') continue;
+
+            std::istringstream iss(line);
+            while (iss >> val) values_line.push_back(val);
+            continue;
+        }
+        values.push_back(values_line[ipos_line++]);
+    }
+    return true;
+}
+
+size_t DispForceFileReader::read_next(const size_t nentry_max,
+                                      std::vector<std::vector<double>> &u,
+                                      std::vector<std::vector<double>> &f)
+{
+    // Same selection rule as InputParser::parse_displacement_and_force_files
+
+    std::vector<double> values;
+
+    u.clear();
+    f.clear();
+
+    while (u.size() < nentry_max && ientry < datfile.ndata) {
+        if (ientry > datfile.nend - 1) break;
+
+        if (is_binary) {
+            if (ientry >= binfile.get_ndata()) {
+                exit("read_next",
+                     "The number of entries in DFSET is too small for the given NDATA = ",
+                     datfile.ndata);
+            }
+        } else if (!read_entry(values)) {
+            exit("read_next",
+                 "The number of lines in DFSET is too small for the given NDATA = ",
+                 datfile.ndata);
+        }
+        const auto i = ientry++;
+
+        if (i < datfile.nstart - 1) continue;
+        if (i >= datfile.skip_s - 1 && i < datfile.skip_e - 1) continue;
+
+        u.emplace_back(3 * nat);
+        f.emplace_back(3 * nat);
+        auto &u_now = u.back();
+        auto &f_now = f.back();
+
+        if (is_binary) {
+            binfile.copy_entry(i, &u_now[0], &f_now[0]);
+            continue;
+        }
+
+        for (size_t j = 0; j < nat; ++j) {
+            for (auto k = 0; k < 3; ++k) {
+                u_now[3 * j + k] = values[6 * j + k];
+                f_now[3 * j + k] = values[6 * j + k + 3];
+            }
+        }
+    }
+
+    return u.size();
+}
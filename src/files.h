@@ -11,6 +11,9 @@
 #pragma once
 
 #include <string>
+#include <fstream>
+#include <vector>
+#include <cstdint>
 
 namespace ALM_NS
 {
@@ -36,6 +39,80 @@ namespace ALM_NS
         DispForceFile& operator=(const DispForceFile &obj) = default;
     };
 
+    // Header of the binary DFSET file.
+    // It is followed by ndata entries, each of which consists of 3 * nat displacements
+    // and 3 * nat forces stored as contiguous doubles in the byte order of the writer.
+    struct DispForceBinaryHeader
+    {
+        char magic[8];        // "ALMDFSET"
+        uint32_t version;
+        uint32_t byte_order;  // 0x01020304 written in the native byte order
+        uint64_t nat;
+        uint64_t ndata;
+        uint64_t data_offset; // position of the first entry in bytes
+        char units[24];       // "Rydberg" (Bohr, Ry/Bohr)
+    };
+
+    // Binary DFSET mapped into memory (read with ifstream on Windows).
+    class DispForceBinaryFile
+    {
+    public:
+        DispForceBinaryFile();
+        ~DispForceBinaryFile();
+
+        static bool is_binary(const std::string &filename);
+
+        void open(const std::string &filename);
+        void close();
+
+        size_t get_nat() const;
+        size_t get_ndata() const;
+        std::string get_units() const;
+
+        void copy_entry(const size_t ientry,
+                        double *u,
+                        double *f);
+
+    private:
+        DispForceBinaryHeader header;
+#if defined(WIN32) || defined(_WIN32)
+        std::ifstream ifs_data;
+#else
+        void *mapped_addr;
+        size_t mapped_size;
+#endif
+    };
+
+    // Sequential reader of DFSET that returns the displacement-force entries
+    // selected by NSTART, NEND and SKIP a few at a time.
+    // Used when the whole training data set does not fit in memory.
+    class DispForceFileReader
+    {
+    public:
+        DispForceFileReader();
+        ~DispForceFileReader();
+
+        void open(const DispForceFile &datfile_in,
+                  const size_t nat_in);
+        void close();
+
+        size_t read_next(const size_t nentry_max,
+                         std::vector<std::vector<double>> &u,
+                         std::vector<std::vector<double>> &f);
+
+    private:
+        std::ifstream ifs_data;
+        DispForceFile datfile;
+        size_t nat;
+        size_t ientry; // index of the next entry in the file
+        std::vector<double> values_line;
+        size_t ipos_line;
+        bool is_binary;
+        DispForceBinaryFile binfile;
+
+        bool read_entry(std::vector<double> &values);
+    };
+
     class Files
     {
     public:
@@ -61,9 +61,19 @@ void InputParser::run(ALM *alm,
 
 void InputParser::parse_displacement_and_force_files(std::vector<std::vector<double>> &u,
                                                      std::vector<std::vector<double>> &f,
-                                                     DispForceFile &datfile_in) const
+                                                     DispForceFile &datfile_in,
+                                                     const bool load_data) const
 
 {
+    // When load_data is false, only the number of entries is checked
+    // and u and f are left untouched.
+    // This is used when the training data is read chunk by chunk (NDATA_CHUNK > 0).
+
+    if (DispForceBinaryFile::is_binary(datfile_in.filename)) {
+        parse_displacement_and_force_binary(u, f, datfile_in, load_data);
+        return;
+    }
+
     int nrequired;
 
     if (datfile_in.ndata == 0) {
@@ -91,7 +101,7 @@ void InputParser::parse_displacement_and_force_files(std::vector<std::vector<dou
             std::istringstream iss(line);
 
             while (iss >> val) {
-                value_arr.push_back(val);
+                if (load_data) value_arr.push_back(val);
                 ++nline_u;
 
                 if (nline_u == nrequired) {
@@ -107,7 +117,7 @@ void InputParser::parse_displacement_and_force_files(std::vector<std::vector<dou
 
     // Check if the length of the vector is correct.
     // Also, estimate ndata if it is not set. 
-    const auto n_entries = value_arr.size();
+    const size_t n_entries = nline_u;
 
     if (nrequired == -1) {
         if (n_entries % (6 * nat) == 0) {
@@ -127,6 +137,8 @@ void InputParser::parse_displacement_and_force_files(std::vector<std::vector<dou
     if (datfile_in.nstart == 0) datfile_in.nstart = 1;
     if (datfile_in.nend == 0) datfile_in.nend = datfile_in.ndata;
 
+    if (!load_data) return;
+
     // Copy the data into 2D array
     const auto ndata_used = datfile_in.nend - datfile_in.nstart
         + 1 - datfile_in.skip_e + datfile_in.skip_s;
@@ -645,19 +657,21 @@ void InputParser::parse_optimize_vars(ALM *alm)
     int constraint_flag;
     auto flag_sparse = 0;
     std::string rotation_axis;
+    std::string constraint_solver = "DGGLSE";
 
     OptimizerControl optcontrol;
     std::vector<std::vector<double>> u_tmp1, f_tmp1;
     std::vector<std::vector<double>> u_tmp2, f_tmp2;
 
     const std::vector<std::string> input_list{
-        "LMODEL", "SPARSE",
-        "ICONST", "ROTAXIS", "FC2XML", "FC3XML",
+        "LMODEL", "SPARSE", "SPARSESOLVER", "DENSESOLVER",
+        "ICONST", "CONST_SOLVER", "ROTAXIS", "FC2XML", "FC3XML",
         "NDATA", "NSTART", "NEND", "SKIP", "DFILE", "FFILE", "DFSET",
         "NDATA_CV", "NSTART_CV", "NEND_CV", "DFSET_CV",
         "L1_RATIO", "STANDARDIZE", "ENET_DNORM",
         "L1_ALPHA", "CV_MAXALPHA", "CV_MINALPHA", "CV_NALPHA",
-        "CV", "MAXITER", "CONV_TOL", "NWRITE", "SOLUTION_PATH", "DEBIAS_OLS"
+        "CV", "MAXITER", "CONV_TOL", "NWRITE", "SOLUTION_PATH", "DEBIAS_OLS",
+        "NDATA_CHUNK", "GRAM_CACHE", "CV_PARALLEL", "ENET_SOLVER", "CV_PATIENCE"
     };
 
     std::map<std::string, std::string> fitting_var_dict;
@@ -690,6 +704,31 @@ void InputParser::parse_optimize_vars(ALM *alm)
         optcontrol.use_sparse_solver = flag_sparse;
     }
 
+    if (!fitting_var_dict["SPARSESOLVER"].empty()) {
+        auto str_sparsesolver = fitting_var_dict["SPARSESOLVER"];
+        boost::to_lower(str_sparsesolver);
+
+        const std::map<std::string, std::string> sparsesolver_names{
+            {"simplicialldlt", "SimplicialLDLT"}, {"ldlt", "SimplicialLDLT"},
+            {"simplicialllt", "SimplicialLLT"}, {"llt", "SimplicialLLT"},
+            {"sparseqr", "SparseQR"}, {"qr", "SparseQR"},
+            {"conjugategradient", "ConjugateGradient"}, {"cg", "ConjugateGradient"},
+            {"leastsquaresconjugategradient", "LeastSquaresConjugateGradient"},
+            {"lscg", "LeastSquaresConjugateGradient"},
+            {"bicgstab", "BiCGSTAB"},
+            {"lsqr", "LSQR"},
+            {"sketchlsqr", "SketchLSQR"}, {"sketch", "SketchLSQR"},
+            {"cholmodsupernodalllt", "CholmodSupernodalLLT"},
+            {"cholmod", "CholmodSupernodalLLT"}
+        };
+
+        const auto it = sparsesolver_names.find(str_sparsesolver);
+        if (it == sparsesolver_names.end()) {
+            exit("parse_optimize_vars", "Invalid SPARSESOLVER-tag");
+        }
+        optcontrol.sparsesolver = it->second;
+    }
+
     if (!fitting_var_dict["ENET_DNORM"].empty()) {
         optcontrol.displacement_normalization_factor
             = boost::lexical_cast<double>(fitting_var_dict["ENET_DNORM"]);
@@ -706,6 +745,25 @@ void InputParser::parse_optimize_vars(ALM *alm)
     if (!fitting_var_dict["CV_NALPHA"].empty()) {
         optcontrol.num_l1_alpha = boost::lexical_cast<int>(fitting_var_dict["CV_NALPHA"]);
     }
+    if (!fitting_var_dict["DENSESOLVER"].empty()) {
+        auto str_densesolver = fitting_var_dict["DENSESOLVER"];
+        boost::to_lower(str_densesolver);
+
+        if (str_densesolver == "svd") {
+            optcontrol.densesolver = "SVD";
+        } else if (str_densesolver == "qr") {
+            optcontrol.densesolver = "QR";
+        } else if (str_densesolver == "tsqr") {
+            optcontrol.densesolver = "TSQR";
+        } else if (str_densesolver == "cholesky") {
+            optcontrol.densesolver = "Cholesky";
+        } else if (str_densesolver == "sketchlsqr" || str_densesolver == "sketch") {
+            optcontrol.densesolver = "SketchLSQR";
+        } else {
+            exit("parse_optimize_vars", "Invalid DENSESOLVER-tag");
+        }
+    }
+
     if (!fitting_var_dict["CONV_TOL"].empty()) {
         optcontrol.tolerance_iteration = boost::lexical_cast<double>(fitting_var_dict["CONV_TOL"]);
     }
@@ -727,9 +785,38 @@ void InputParser::parse_optimize_vars(ALM *alm)
     if (!fitting_var_dict["DEBIAS_OLS"].empty()) {
         optcontrol.debiase_after_l1opt = boost::lexical_cast<int>(fitting_var_dict["DEBIAS_OLS"]);
     }
+    if (!fitting_var_dict["GRAM_CACHE"].empty()) {
+        optcontrol.gram_cache_mb = boost::lexical_cast<double>(fitting_var_dict["GRAM_CACHE"]);
+        if (optcontrol.gram_cache_mb < 0.0) {
+            exit("parse_optimize_vars", "GRAM_CACHE must be 0 or positive.");
+        }
+    }
+    if (!fitting_var_dict["ENET_SOLVER"].empty()) {
+        auto str_enet_solver = fitting_var_dict["ENET_SOLVER"];
+        boost::to_lower(str_enet_solver);
+
+        if (str_enet_solver == "cd" || str_enet_solver == "coordinate-descent") {
+            optcontrol.enet_solver = "CD";
+        } else if (str_enet_solver == "fista") {
+            optcontrol.enet_solver = "FISTA";
+        } else if (str_enet_solver == "lars") {
+            optcontrol.enet_solver = "LARS";
+        } else {
+            exit("parse_optimize_vars", "Invalid ENET_SOLVER-tag");
+        }
+    }
+    if (!fitting_var_dict["CV_PARALLEL"].empty()) {
+        optcontrol.parallel_cv = boost::lexical_cast<int>(fitting_var_dict["CV_PARALLEL"]);
+    }
+    if (!fitting_var_dict["CV_PATIENCE"].empty()) {
+        optcontrol.cv_patience = boost::lexical_cast<int>(fitting_var_dict["CV_PATIENCE"]);
+    }
     if (!fitting_var_dict["L1_RATIO"].empty()) {
         optcontrol.l1_ratio = boost::lexical_cast<double>(fitting_var_dict["L1_RATIO"]);
     }
+    if (!fitting_var_dict["NDATA_CHUNK"].empty()) {
+        optcontrol.ndata_chunk = boost::lexical_cast<int>(fitting_var_dict["NDATA_CHUNK"]);
+    }
 
 
     DispForceFile datfile_train;
@@ -778,10 +865,19 @@ void InputParser::parse_optimize_vars(ALM *alm)
              "NDATA, NSTART, NEND and SKIP tags are inconsistent.");
     }
 
-    // Parse u_tmp1 and f_tmp1 from DFSET and set ndata if it's not.
-    parse_displacement_and_force_files(u_tmp1,
-                                       f_tmp1,
-                                       datfile_train);
+    if (optcontrol.linear_model == 1 && optcontrol.ndata_chunk > 0) {
+        // The training data is read chunk by chunk during the fitting.
+        // Here, only set ndata if it's not.
+        parse_displacement_and_force_files(u_tmp1,
+                                           f_tmp1,
+                                           datfile_train,
+                                           false);
+    } else {
+        // Parse u_tmp1 and f_tmp1 from DFSET and set ndata if it's not.
+        parse_displacement_and_force_files(u_tmp1,
+                                           f_tmp1,
+                                           datfile_train);
+    }
 
     // Check consistency again
     if (!is_data_range_consistent(datfile_train)) {
@@ -841,6 +937,19 @@ void InputParser::parse_optimize_vars(ALM *alm)
         assign_val(constraint_flag, "ICONST", fitting_var_dict);
     }
 
+    if (!fitting_var_dict["CONST_SOLVER"].empty()) {
+        auto str_constraint_solver = fitting_var_dict["CONST_SOLVER"];
+        boost::to_lower(str_constraint_solver);
+
+        if (str_constraint_solver == "dgglse") {
+            constraint_solver = "DGGLSE";
+        } else if (str_constraint_solver == "nullspace") {
+            constraint_solver = "NullSpace";
+        } else {
+            exit("parse_optimize_vars", "Invalid CONST_SOLVER-tag");
+        }
+    }
+
     auto fc2_file = fitting_var_dict["FC2XML"];
     auto fc3_file = fitting_var_dict["FC3XML"];
     const auto fix_harmonic = !fc2_file.empty();
@@ -856,6 +965,7 @@ void InputParser::parse_optimize_vars(ALM *alm)
 
     input_setter->set_constraint_vars(alm,
                                       constraint_flag,
+                                      constraint_solver,
                                       rotation_axis,
                                       fc2_file,
                                       fc3_file,
@@ -1274,6 +1384,59 @@ void InputParser::get_var_dict(const std::vector<std::string> &input_list,
     keyword_set.clear();
 }
 
+void InputParser::parse_displacement_and_force_binary(std::vector<std::vector<double>> &u,
+                                                      std::vector<std::vector<double>> &f,
+                                                      DispForceFile &datfile_in,
+                                                      const bool load_data) const
+{
+    // Binary DFSET (see DispForceBinaryHeader). The entries are copied
+    // directly from the mapped file without any text parsing.
+
+    DispForceBinaryFile binfile;
+    binfile.open(datfile_in.filename);
+
+    if (binfile.get_nat() != nat) {
+        exit("parse_displacement_and_force_binary",
+             "NAT in the binary DFSET file is inconsistent with the input NAT = ", nat);
+    }
+    const auto units = binfile.get_units();
+    if (units != "Rydberg") {
+        exit("parse_displacement_and_force_binary",
+             "The binary DFSET must be in units of Bohr and Ryd/Bohr, but the header says ",
+             units.c_str());
+    }
+
+    if (datfile_in.ndata == 0) {
+        datfile_in.ndata = binfile.get_ndata();
+    } else if (binfile.get_ndata() < datfile_in.ndata) {
+        exit("parse_displacement_and_force_binary",
+             "The number of entries in DFSET is too small for the given NDATA = ",
+             datfile_in.ndata);
+    }
+
+    if (datfile_in.nstart == 0) datfile_in.nstart = 1;
+    if (datfile_in.nend == 0) datfile_in.nend = datfile_in.ndata;
+
+    if (!load_data) return;
+
+    const auto ndata_used = datfile_in.nend - datfile_in.nstart
+        + 1 - datfile_in.skip_e + datfile_in.skip_s;
+
+    u.resize(ndata_used, std::vector<double>(3 * nat));
+    f.resize(ndata_used, std::vector<double>(3 * nat));
+
+    auto idata = 0;
+    for (size_t i = 0; i < datfile_in.ndata; ++i) {
+        if (i < datfile_in.nstart - 1) continue;
+        if (i >= datfile_in.skip_s - 1 && i < datfile_in.skip_e - 1) continue; // When skip_s == skip_e, skip nothing.
+        if (i > datfile_in.nend - 1) break;
+
+        binfile.copy_entry(i, &u[idata][0], &f[idata][0]);
+        ++idata;
+    }
+}
+
+
 bool InputParser::is_data_range_consistent(const DispForceFile &datfile_in) const
 {
     const auto ndata = datfile_in.ndata;
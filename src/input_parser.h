@@ -66,6 +66,12 @@ namespace ALM_NS
 
         void parse_displacement_and_force_files(std::vector<std::vector<double>> &u,
                                                 std::vector<std::vector<double>> &f,
-                                                DispForceFile &datfile_in) const;
+                                                DispForceFile &datfile_in,
+                                                const bool load_data = true) const;
+
+        void parse_displacement_and_force_binary(std::vector<std::vector<double>> &u,
+                                                 std::vector<std::vector<double>> &f,
+                                                 DispForceFile &datfile_in,
+                                                 const bool load_data) const;
     };
 }
@@ -206,6 +206,7 @@ void InputSetter::set_file_vars(ALM *alm,
 
 void InputSetter::set_constraint_vars(ALM *alm,
                                       const int constraint_flag,
+                                      const std::string constraint_solver,
                                       const std::string rotation_axis,
                                       const std::string fc2_file,
                                       const std::string fc3_file,
@@ -213,11 +214,13 @@ void InputSetter::set_constraint_vars(ALM *alm,
                                       const bool fix_cubic) const
 {
     alm->constraint->set_constraint_mode(constraint_flag);
+    alm->constraint->set_constraint_solver(constraint_solver);
     alm->constraint->set_rotation_axis(rotation_axis);
     alm->constraint->set_fc_file(2, fc2_file);
     alm->constraint->set_fix_harmonic(fix_harmonic);
     alm->constraint->set_fc_file(3, fc3_file);
     alm->constraint->set_fix_cubic(fix_cubic);
+    alm->optimize->reset_incremental_factor();
 }
 
 
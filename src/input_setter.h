@@ -68,6 +68,7 @@ namespace ALM_NS
 
         void set_constraint_vars(ALM *alm,
                                  int constraint_flag,
+                                 std::string constraint_solver,
                                  std::string rotation_axis,
                                  std::string fc2_file,
                                  std::string fc3_file,
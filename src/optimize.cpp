@@ -19,20 +19,29 @@
 #include "memory.h"
 #include "symmetry.h"
 #include "timer.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
 #include <iostream>
 #include <cmath>
+#include <limits>
 #include <string>
 #include <vector>
 #include <boost/lexical_cast.hpp>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #ifdef WITH_SPARSE_SOLVER
 #include <Eigen/Dense>
 #include <Eigen/SparseCore>
 #include <Eigen/SparseQR>
 #include <Eigen/SparseCholesky>
-//#include <Eigen/IterativeLinearSolvers>
-//#include <unsupported/Eigen/SparseExtra>
-//#include <bench/BenchTimer.h>
+#include <Eigen/IterativeLinearSolvers>
+#ifdef WITH_CHOLMOD
+#include <Eigen/CholmodSupport>
+#endif
 #endif
 
 using namespace ALM_NS;
@@ -122,6 +131,10 @@ int Optimize::optimize_main(const Symmetry *symmetry,
         std::cout << '\n';
     }
 
+    // Compile the list of terms of the sensing matrix once.
+    // It is reused for all sensing matrices constructed below.
+    update_sensing_matrix_plan(maxorder, symmetry, fcs);
+
     // Run optimization and obtain force constants
 
     std::vector<double> fcs_tmp(N, 0.0);
@@ -130,15 +143,45 @@ int Optimize::optimize_main(const Symmetry *symmetry,
 
         // Use ordinary least-squares
 
-        info_fitting = least_squares(maxorder,
-                                     N,
-                                     N_new,
-                                     M,
-                                     verbosity,
-                                     symmetry,
-                                     fcs,
-                                     constraint,
-                                     fcs_tmp);
+        if (optcontrol.cross_validation != 0 && verbosity > 0) {
+            if (optcontrol.cross_validation == -1) {
+                std::cout << "  WARNING: CV = -1 is not supported when LMODEL = least-squares." << std::endl;
+            } else if (optcontrol.incremental || optcontrol.ndata_chunk > 0) {
+                std::cout << "  WARNING: CV is ignored with NDATA_CHUNK > 0 or the incremental mode." << std::endl;
+            }
+        }
+
+        if (optcontrol.incremental) {
+            info_fitting = least_squares_incremental(maxorder,
+                                                     N,
+                                                     N_new,
+                                                     verbosity,
+                                                     symmetry,
+                                                     fcs,
+                                                     constraint,
+                                                     fcs_tmp);
+        } else if (optcontrol.ndata_chunk > 0) {
+            info_fitting = least_squares_chunked(maxorder,
+                                                 N,
+                                                 N_new,
+                                                 filedata_train,
+                                                 verbosity,
+                                                 symmetry,
+                                                 fcs,
+                                                 constraint,
+                                                 fcs_tmp);
+        } else {
+            info_fitting = least_squares(file_prefix,
+                                         maxorder,
+                                         N,
+                                         N_new,
+                                         M,
+                                         verbosity,
+                                         symmetry,
+                                         fcs,
+                                         constraint,
+                                         fcs_tmp);
+        }
 
     } else if (optcontrol.linear_model == 2) {
 
@@ -149,6 +192,10 @@ int Optimize::optimize_main(const Symmetry *symmetry,
                  "Sorry, ICONST=10 or ICONST = 11 must be used when using elastic net.");
         }
 
+        if (optcontrol.ndata_chunk > 0 && verbosity > 0) {
+            std::cout << "  WARNING: NDATA_CHUNK is ignored when LMODEL = enet." << std::endl;
+        }
+
         info_fitting = elastic_net(file_prefix,
                                    maxorder,
                                    N_new,
@@ -187,7 +234,229 @@ int Optimize::optimize_main(const Symmetry *symmetry,
     return info_fitting;
 }
 
-int Optimize::least_squares(const int maxorder,
+int Optimize::optimize_multiple_rhs(const Symmetry *symmetry,
+                                    const Constraint *constraint,
+                                    const Fcs *fcs,
+                                    const int maxorder,
+                                    const std::vector<std::vector<double>> &u_in,
+                                    const std::vector<std::vector<std::vector<double>>> &f_in,
+                                    const int verbosity,
+                                    std::vector<std::vector<double>> &fc_irred_out,
+                                    Timer *timer)
+{
+    // Least-squares fitting of several force sets f_in[k] obtained for
+    // the same displacements u_in. The sensing matrix is constructed and
+    // factorized only once, and the force sets are solved together as
+    // the columns of one right-hand-side matrix.
+    // fc_irred_out[k] is the irreducible set of force constants for f_in[k]
+    // in the order accepted by set_fcs_values.
+
+    size_t i, k;
+
+    timer->start_clock("optimize");
+
+    const auto nrhs = f_in.size();
+    const auto algebraic = constraint->get_constraint_algebraic();
+    size_t N = 0;
+    size_t N_new = 0;
+    for (auto order = 0; order < maxorder; ++order) {
+        N += fcs->get_nequiv()[order].size();
+        N_new += constraint->get_index_bimap(order).size();
+    }
+    const auto ncols = algebraic ? N_new : N;
+
+    if (optcontrol.linear_model != 1) {
+        exit("optimize_multiple_rhs",
+             "Multiple force sets are supported only when LMODEL = least-squares.");
+    }
+    if (u_in.empty() || nrhs == 0) {
+        exit("optimize_multiple_rhs", "No training data found.");
+    }
+    for (k = 0; k < nrhs; ++k) {
+        if (f_in[k].size() != u_in.size()) {
+            exit("optimize_multiple_rhs",
+                 "The lengths of displacement array and force array are diferent.");
+        }
+    }
+
+    if (verbosity > 0) {
+        std::cout << " OPTIMIZATION (MULTIPLE FORCE SETS)\n";
+        std::cout << " ==================================\n\n";
+        std::cout << "  " << u_in.size() << " entries with "
+            << nrhs << " force sets will be used for training.\n\n";
+        std::cout << "  Total Number of Parameters : " << N << '\n';
+        if (algebraic) {
+            std::cout << "  Total Number of Free Parameters : " << N_new << '\n';
+        }
+        std::cout << '\n';
+
+        if (optcontrol.use_sparse_solver) {
+            std::cout << "  WARNING: SPARSE = 1 is ignored for multiple force sets." << std::endl;
+        }
+        if (optcontrol.incremental || optcontrol.ndata_chunk > 0 || optcontrol.cross_validation != 0) {
+            std::cout << "  WARNING: CV, NDATA_CHUNK, and the incremental mode are ignored"
+                << " for multiple force sets." << std::endl;
+        }
+    }
+
+    update_sensing_matrix_plan(maxorder, symmetry, fcs);
+
+    std::vector<double> amat, bvec;
+    double fnorm;
+
+    if (algebraic) {
+        get_matrix_elements_algebraic_constraint(maxorder,
+                                                 amat,
+                                                 bvec,
+                                                 u_in,
+                                                 f_in[0],
+                                                 fnorm,
+                                                 symmetry,
+                                                 fcs,
+                                                 constraint);
+    } else {
+        get_matrix_elements(maxorder,
+                            amat,
+                            bvec,
+                            u_in,
+                            f_in[0],
+                            symmetry,
+                            fcs);
+    }
+
+    // The contribution of the fixed force constants to the r.h.s. vector
+    // is common to all force sets, so that only the forces are replaced.
+
+    const auto M = bvec.size();
+    const auto LMAX = std::max<size_t>(M, ncols);
+    std::vector<double> fsum2(LMAX * nrhs, 0.0);
+    std::vector<double> f_square(nrhs, 0.0);
+    std::vector<double> fvec0, fvec;
+
+    get_force_vector(maxorder, f_in[0], fvec0, symmetry, fcs);
+
+    for (k = 0; k < nrhs; ++k) {
+        if (k == 0) {
+            fvec = fvec0;
+        } else {
+            get_force_vector(maxorder, f_in[k], fvec, symmetry, fcs);
+        }
+        for (i = 0; i < M; ++i) {
+            fsum2[LMAX * k + i] = bvec[i] + (fvec[i] - fvec0[i]);
+            f_square[k] += fvec[i] * fvec[i];
+        }
+    }
+
+    int INFO = 0;
+    int nrank = ncols;
+    std::vector<double> f_residual(nrhs, 0.0);
+    std::vector<std::vector<double>> params(nrhs);
+
+    if (!algebraic && constraint->get_exist_constraint()
+        && constraint->get_constraint_solver() == "NullSpace") {
+
+        std::vector<double> param_tmp(N * nrhs);
+
+        INFO = fit_null_space(N, M, nrhs, &amat[0], &fsum2[0], LMAX,
+                              &param_tmp[0], maxorder, fcs, constraint, verbosity);
+
+        for (k = 0; k < nrhs; ++k) {
+            params[k].assign(param_tmp.begin() + N * k, param_tmp.begin() + N * (k + 1));
+        }
+
+    } else if (!algebraic && constraint->get_exist_constraint()) {
+
+        // DGGLSE takes only one right-hand side.
+
+        const auto P = constraint->get_number_of_constraints();
+        std::vector<double> amat_tmp, dvec;
+
+        if (verbosity > 0) {
+            std::cout << "  WARNING: The force sets are fitted one by one"
+                << " when the constraints are not considered algebraically." << std::endl;
+        }
+
+        for (k = 0; k < nrhs; ++k) {
+            amat_tmp = amat;
+            dvec.assign(constraint->get_const_rhs(), constraint->get_const_rhs() + P);
+            params[k].resize(N);
+            INFO = fit_with_constraints(N,
+                                        M,
+                                        P,
+                                        &amat_tmp[0],
+                                        &fsum2[LMAX * k],
+                                        &params[k][0],
+                                        constraint->get_const_mat(),
+                                        &dvec[0],
+                                        verbosity);
+            if (INFO != 0) break;
+        }
+
+    } else {
+
+        if (verbosity > 0) {
+            std::cout << "  Entering fitting routine: " << optcontrol.densesolver
+                << " with " << nrhs << " right-hand sides" << std::endl;
+        }
+
+        INFO = solve_dense_least_squares(ncols, M, nrhs, &amat[0], &fsum2[0],
+                                         nrank, f_residual, verbosity);
+
+        if (static_cast<size_t>(nrank) < ncols) {
+            warn("optimize_multiple_rhs",
+                 "Matrix is rank-deficient. Force constants could not be determined uniquely :(");
+        }
+
+        if (static_cast<size_t>(nrank) == ncols && verbosity > 0) {
+            std::cout << std::endl;
+            for (k = 0; k < nrhs; ++k) {
+                std::cout << "  Force set " << std::setw(4) << k + 1
+                    << " : residual sum of squares = " << std::sqrt(f_residual[k])
+                    << ", fitting error (%) = "
+                    << std::sqrt(f_residual[k] / f_square[k]) * 100.0 << std::endl;
+            }
+        }
+
+        for (k = 0; k < nrhs; ++k) {
+            params[k].assign(fsum2.begin() + LMAX * k, fsum2.begin() + LMAX * k + ncols);
+        }
+    }
+
+    if (INFO == 0) {
+        fc_irred_out.resize(nrhs);
+        for (k = 0; k < nrhs; ++k) {
+            if (algebraic) {
+                fc_irred_out[k] = params[k];
+            } else {
+                // Pick up the irreducible elements of the full set
+                fc_irred_out[k].assign(N_new, 0.0);
+                size_t ishift = 0;
+                size_t iparam = 0;
+                for (auto order = 0; order < maxorder; ++order) {
+                    for (const auto &it : constraint->get_index_bimap(order)) {
+                        fc_irred_out[k][it.left + iparam] = params[k][it.right + ishift];
+                    }
+                    ishift += fcs->get_nequiv()[order].size();
+                    iparam += constraint->get_index_bimap(order).size();
+                }
+            }
+        }
+    }
+
+    if (verbosity > 0) {
+        std::cout << std::endl;
+        timer->print_elapsed();
+        std::cout << " -------------------------------------------------------------------" << std::endl;
+        std::cout << std::endl;
+    }
+
+    timer->stop_clock("optimize");
+
+    return INFO;
+}
+
+int Optimize::least_squares(const std::string job_prefix,
+                            const int maxorder,
                             const size_t N,
                             const size_t N_new,
                             const size_t M,
@@ -231,11 +500,15 @@ int Optimize::least_squares(const int maxorder,
                                                symmetry,
                                                fcs,
                                                constraint);
+            if (optcontrol.cross_validation > 0 && verbosity > 0) {
+                std::cout << "  WARNING: CV is not supported with SPARSE = 1." << std::endl;
+            }
+
             if (verbosity > 0) {
                 std::cout << " Now, start fitting ..." << std::endl;
             }
 
-            info_fitting = run_eigen_sparseQR(sp_amat,
+            info_fitting = run_sparse_solver(sp_amat,
                                               sp_bvec,
                                               param_out,
                                               fnorm,
@@ -265,6 +538,12 @@ int Optimize::least_squares(const int maxorder,
                                                      fcs,
                                                      constraint);
 
+            if (optcontrol.cross_validation > 0) {
+                run_least_squares_crossvalidation(job_prefix + ".cvscore",
+                                                  N_new, M, &amat[0], &bvec[0],
+                                                  verbosity);
+            }
+
             // Perform fitting with SVD
 
             info_fitting
@@ -302,7 +581,33 @@ int Optimize::least_squares(const int maxorder,
         assert(!amat.empty());
         assert(!bvec.empty());
 
-        if (constraint->get_exist_constraint()) {
+        if (optcontrol.cross_validation > 0) {
+            if (constraint->get_exist_constraint()) {
+                if (verbosity > 0) {
+                    std::cout << "  WARNING: CV is supported only with ICONST = 0, 10, or 11." << std::endl;
+                }
+            } else {
+                run_least_squares_crossvalidation(job_prefix + ".cvscore",
+                                                  N, M, &amat[0], &bvec[0],
+                                                  verbosity);
+            }
+        }
+
+        if (constraint->get_exist_constraint()
+            && constraint->get_constraint_solver() == "NullSpace") {
+            info_fitting
+                = fit_null_space(N,
+                                 M,
+                                 1,
+                                 &amat[0],
+                                 &bvec[0],
+                                 M,
+                                 &param_out[0],
+                                 maxorder,
+                                 fcs,
+                                 constraint,
+                                 verbosity);
+        } else if (constraint->get_exist_constraint()) {
             info_fitting
                 = fit_with_constraints(N,
                                        M,
@@ -329,137 +634,524 @@ int Optimize::least_squares(const int maxorder,
 }
 
 
-int Optimize::elastic_net(const std::string job_prefix,
-                          const int maxorder,
-                          const size_t N_new,
-                          const size_t M,
-                          const Symmetry *symmetry,
-                          const std::vector<std::string> &str_order,
-                          const Fcs *fcs,
-                          Constraint *constraint,
-                          const int verbosity,
-                          std::vector<double> &param_out)
+int Optimize::least_squares_chunked(const int maxorder,
+                                    const size_t N,
+                                    const size_t N_new,
+                                    const DispForceFile &filedata_train,
+                                    const int verbosity,
+                                    const Symmetry *symmetry,
+                                    const Fcs *fcs,
+                                    const Constraint *constraint,
+                                    std::vector<double> &param_out)
 {
-    auto info_fitting = 0;
-
-    std::vector<double> param_tmp(N_new, 0.0);
+    // Ordinary least-squares without storing the whole sensing matrix.
+    // A^T A and A^T b are accumulated over chunks of NDATA_CHUNK entries
+    // so that the memory usage is O(N^2) irrespective of the number of entries.
+    // When the training data is not in memory, it is read from DFSET chunk by chunk.
 
-    // Scale displacements if DNORM is not 1 and the data is not standardized.
-    const int scale_displacement
-        = std::abs(optcontrol.displacement_normalization_factor - 1.0) > eps
-        && optcontrol.standardize == 0;
+    size_t i;
+    const auto algebraic = constraint->get_constraint_algebraic();
 
-    if (scale_displacement) {
-        apply_scalers(maxorder, constraint);
+    if (!algebraic && constraint->get_exist_constraint()) {
+        exit("least_squares_chunked",
+             "NDATA_CHUNK > 0 works only with ICONST = 0, 10, or 11.");
+    }
+    if (optcontrol.use_sparse_solver && verbosity > 0) {
+        std::cout << "  WARNING: SPARSE = 1 is ignored when NDATA_CHUNK > 0." << std::endl;
     }
 
-    if (optcontrol.cross_validation == 0) {
-
-        // Optimize with a given L1 coefficient (l1_alpha)
-        info_fitting = run_elastic_net_optimization(maxorder,
-                                                    M,
-                                                    N_new,
-                                                    fcs,
-                                                    symmetry,
-                                                    constraint,
-                                                    verbosity,
-                                                    param_tmp);
+    const auto ncols = algebraic ? N_new : N;
+    const auto nentry_chunk = static_cast<size_t>(optcontrol.ndata_chunk);
+    const auto read_from_file = u_train.empty();
 
-    } else {
+    std::vector<double> AtA(ncols * ncols, 0.0);
+    std::vector<double> Atb(ncols, 0.0);
+    std::vector<double> amat, bvec;
+    std::vector<std::vector<double>> u_chunk, f_chunk;
+    auto btb = 0.0;
+    auto fnorm2 = 0.0;
+    double fnorm;
+    size_t ndata_done = 0;
+
+    int N_tmp = ncols;
+    int M_tmp;
+    int inc = 1;
+    auto one = 1.0;
+    auto zero = 0.0;
+    char uplo = 'U';
+    char trans = 'T';
+
+    DispForceFileReader reader;
+    if (read_from_file) {
+        reader.open(filedata_train, symmetry->get_nat_prim() * symmetry->get_ntran());
+    }
 
-        // Run cross validation (manually or automatically)
-        info_fitting = run_elastic_net_crossvalidation(job_prefix,
-                                                       maxorder,
-                                                       fcs,
-                                                       symmetry,
-                                                       constraint,
-                                                       verbosity);
+    if (verbosity > 0) {
+        std::cout << "  Entering fitting routine: normal equations accumulated over chunks of "
+            << nentry_chunk << " entries" << std::endl;
+        if (algebraic) {
+            std::cout << "  Constraints are considered algebraically." << std::endl;
+        }
+        std::cout << "  Accumulation of A^T A and A^T b has started ... ";
     }
 
-    if (verbosity > 0 && info_fitting == 0) {
-        size_t iparam = 0;
-        std::vector<int> nzero_lasso(maxorder);
+    while (true) {
 
-        for (auto i = 0; i < maxorder; ++i) {
-            nzero_lasso[i] = 0;
-            for (const auto &it : constraint->get_index_bimap(i)) {
-                const auto inew = it.left + iparam;
-                if (std::abs(param_tmp[inew]) < eps) ++nzero_lasso[i];
-            }
-            iparam += constraint->get_index_bimap(i).size();
+        if (read_from_file) {
+            if (reader.read_next(nentry_chunk, u_chunk, f_chunk) == 0) break;
+        } else {
+            if (ndata_done == u_train.size()) break;
+            const auto iend = std::min<size_t>(ndata_done + nentry_chunk, u_train.size());
+            u_chunk.assign(u_train.begin() + ndata_done, u_train.begin() + iend);
+            f_chunk.assign(f_train.begin() + ndata_done, f_train.begin() + iend);
         }
 
-        for (auto order = 0; order < maxorder; ++order) {
-            std::cout << "  Number of non-zero " << std::setw(9) << str_order[order] << " FCs : "
-                << constraint->get_index_bimap(order).size() - nzero_lasso[order] << std::endl;
+        if (algebraic) {
+            get_matrix_elements_algebraic_constraint(maxorder,
+                                                     amat,
+                                                     bvec,
+                                                     u_chunk,
+                                                     f_chunk,
+                                                     fnorm,
+                                                     symmetry,
+                                                     fcs,
+                                                     constraint);
+            fnorm2 += fnorm * fnorm;
+        } else {
+            get_matrix_elements(maxorder,
+                                amat,
+                                bvec,
+                                u_chunk,
+                                f_chunk,
+                                symmetry,
+                                fcs);
+            for (const auto &it : bvec) fnorm2 += it * it;
         }
-        std::cout << std::endl;
+
+        for (const auto &it : bvec) btb += it * it;
+
+        // AtA += A^T A (upper triangle only), Atb += A^T b
+        M_tmp = bvec.size();
+        dsyrk_(&uplo, &trans, &N_tmp, &M_tmp, &one, &amat[0], &M_tmp,
+               &one, &AtA[0], &N_tmp);
+        dgemv_(&trans, &M_tmp, &N_tmp, &one, &amat[0], &M_tmp,
+               &bvec[0], &inc, &one, &Atb[0], &inc);
+
+        ndata_done += u_chunk.size();
     }
 
-    // Scale back force constants
+    if (read_from_file) reader.close();
+    amat.clear();
+    amat.shrink_to_fit();
 
-    if (scale_displacement) {
-        apply_scaler_force_constants(maxorder,
-                                     optcontrol.displacement_normalization_factor,
-                                     constraint,
-                                     param_tmp);
-        finalize_scalers(maxorder,
-                         constraint);
+    if (verbosity > 0) {
+        std::cout << "finished !" << std::endl;
+        std::cout << "  " << ndata_done << " entries have been processed." << std::endl << std::endl;
     }
 
-    recover_original_forceconstants(maxorder,
-                                    param_tmp,
-                                    param_out,
-                                    fcs->get_nequiv(),
-                                    constraint);
-    return info_fitting;
-}
+    if (ndata_done == 0) {
+        exit("least_squares_chunked", "No training data found.");
+    }
 
-int Optimize::run_elastic_net_crossvalidation(const std::string job_prefix,
-                                              const int maxorder,
-                                              const Fcs *fcs,
-                                              const Symmetry *symmetry,
-                                              const Constraint *constraint,
-                                              const int verbosity)
-{
-    // Cross-validation mode
+    std::vector<double> param_tmp;
+    int nrank;
 
+    const auto INFO = solve_normal_equation(ncols,
+                                            AtA,
+                                            Atb,
+                                            param_tmp,
+                                            nrank,
+                                            verbosity);
 
-    if (verbosity > 0) {
-        std::cout << "  Elastic-net cross-validation with the following parameters:" << std::endl;
-        std::cout << "   L1_RATIO = " << optcontrol.l1_ratio << std::endl;
-        std::cout << "   CV = " << std::setw(15) << optcontrol.cross_validation << std::endl;
-        std::cout << "   CV_MINALPHA = " << std::setw(15) << optcontrol.l1_alpha_min;
-        std::cout << " CV_MAXALPHA = " << std::setw(15) << optcontrol.l1_alpha_max << std::endl;
-        std::cout << "   CV_NALPHA = " << std::setw(5) << optcontrol.num_l1_alpha << std::endl;
-        std::cout << "   CONV_TOL = " << std::setw(15) << optcontrol.tolerance_iteration << std::endl;
-        std::cout << "   MAXITER = " << std::setw(5) << optcontrol.maxnum_iteration << std::endl;
-        std::cout << "   ENET_DNORM = " << std::setw(15) << optcontrol.displacement_normalization_factor << std::endl;
-        std::cout << std::endl;
+    if (static_cast<size_t>(nrank) < ncols) {
+        warn("least_squares_chunked",
+             "Matrix is rank-deficient. Force constants could not be determined uniquely :(");
+    }
 
-        if (optcontrol.standardize) {
-            std::cout << "  STANDARDIZE = 1 : Standardization will be performed for matrix A and vector b." << std::
-                endl;
-            std::cout << "                    The ENET_DNORM-tag will be neglected." << std::endl;
-        } else {
-            std::cout << "  STANDARDIZE = 0 : No standardization of matrix A and vector b." << std::endl;
-            std::cout << "                    Columns of matrix A will be scaled by the ENET_DNORM value." << std::
-                endl;
+    if (static_cast<size_t>(nrank) == ncols && verbosity > 0) {
+        // |Ax - b|^2 = b^T b - 2 x^T A^T b + x^T A^T A x
+        std::vector<double> AtAx(ncols);
+        dsymv_(&uplo, &N_tmp, &one, &AtA[0], &N_tmp, &param_tmp[0], &inc,
+               &zero, &AtAx[0], &inc);
+        auto f_residual = btb;
+        for (i = 0; i < ncols; ++i) {
+            f_residual += param_tmp[i] * (AtAx[i] - 2.0 * Atb[i]);
         }
+        f_residual = std::max<double>(f_residual, 0.0);
+
         std::cout << std::endl;
+        std::cout << "  Residual sum of squares for the solution: "
+            << sqrt(f_residual) << std::endl;
+        std::cout << "  Fitting error (%) : "
+            << sqrt(f_residual / fnorm2) * 100.0 << std::endl;
+    }
 
-        if (optcontrol.cross_validation == -1) {
-            std::cout << "  CV = -1: Manual CV mode." << std::endl;
-            std::cout << "           Validation data is read from DFSET_CV" << std::endl;
-        } else if (optcontrol.cross_validation > 0) {
-            std::cout << "  CV > 0: Automatic CV mode." << std::endl;
+    if (INFO == 0) {
+        if (algebraic) {
+            recover_original_forceconstants(maxorder,
+                                            param_tmp,
+                                            param_out,
+                                            fcs->get_nequiv(),
+                                            constraint);
         } else {
-            exit("run_elastic_net_crossvalidation",
-                 "This cannot happen.");
+            for (i = 0; i < ncols; ++i) param_out[i] = param_tmp[i];
         }
-        std::cout << std::endl;
     }
 
+    return INFO;
+}
+
+
+int Optimize::least_squares_incremental(const int maxorder,
+                                        const size_t N,
+                                        const size_t N_new,
+                                        const int verbosity,
+                                        const Symmetry *symmetry,
+                                        const Fcs *fcs,
+                                        const Constraint *constraint,
+                                        std::vector<double> &param_out)
+{
+    // Only the training entries appended after the previous call are
+    // converted into rows of the sensing matrix, and they are absorbed into
+    // the stored R factor. The cost is O(nrows_new * N^2) instead of
+    // O(nrows_all * N^2) of the fitting from scratch.
+
+    size_t i;
+    int nrank;
+
+    const auto algebraic = constraint->get_constraint_algebraic();
+
+    if (!algebraic && constraint->get_exist_constraint()) {
+        exit("least_squares_incremental",
+             "Incremental fitting is available only when ICONST = 0, 10, 11.");
+    }
+    if (u_train.empty()) {
+        exit("least_squares_incremental",
+             "The training data must be given by set_displacement_and_force.");
+    }
+
+    const auto ncols = algebraic ? N_new : N;
+
+    if (incremental_factor.ncols != ncols
+        || incremental_factor.fcs_generation != fcs->get_generation()
+        || incremental_factor.ndata > u_train.size()) {
+        incremental_factor.reset(ncols, fcs->get_generation());
+    }
+
+    const auto ndata_old = incremental_factor.ndata;
+    const auto ndata_new = u_train.size() - ndata_old;
+
+    if (verbosity > 0) {
+        std::cout << "  Entering fitting routine: incremental QR" << std::endl;
+        std::cout << "  " << ndata_old << " entries are stored in the R factor and "
+            << ndata_new << " entries are appended." << std::endl;
+    }
+
+    if (ndata_new > 0) {
+        std::vector<std::vector<double>> u_new(u_train.begin() + ndata_old, u_train.end());
+        std::vector<std::vector<double>> f_new(f_train.begin() + ndata_old, f_train.end());
+        std::vector<double> amat, bvec;
+
+        if (algebraic) {
+            double fnorm;
+            get_matrix_elements_algebraic_constraint(maxorder,
+                                                     amat,
+                                                     bvec,
+                                                     u_new,
+                                                     f_new,
+                                                     fnorm,
+                                                     symmetry,
+                                                     fcs,
+                                                     constraint);
+            incremental_factor.fnorm2 += fnorm * fnorm;
+        } else {
+            get_matrix_elements(maxorder,
+                                amat,
+                                bvec,
+                                u_new,
+                                f_new,
+                                symmetry,
+                                fcs);
+            for (const auto &it : bvec) incremental_factor.fnorm2 += it * it;
+        }
+
+        update_incremental_factor(bvec.size(), amat, bvec);
+        incremental_factor.ndata = u_train.size();
+    }
+
+    if (verbosity > 0) std::cout << "  Back substitution has started ... ";
+
+    std::vector<double> param_irred(incremental_factor.qtb);
+    const auto INFO = solve_triangular_factor(ncols,
+                                              &incremental_factor.rmat[0],
+                                              ncols,
+                                              &param_irred[0],
+                                              ncols,
+                                              1,
+                                              nrank,
+                                              verbosity);
+
+    if (static_cast<size_t>(nrank) < ncols) {
+        warn("least_squares_incremental",
+             "Matrix is rank-deficient. Force constants could not be determined uniquely :(");
+    }
+
+    if (static_cast<size_t>(nrank) == ncols && verbosity > 0) {
+        std::cout << std::endl;
+        std::cout << "  Residual sum of squares for the solution: "
+            << std::sqrt(incremental_factor.residual2) << std::endl;
+        std::cout << "  Fitting error (%) : "
+            << std::sqrt(incremental_factor.residual2 / incremental_factor.fnorm2) * 100.0 << std::endl;
+    }
+
+    if (INFO == 0) {
+        if (algebraic) {
+            recover_original_forceconstants(maxorder,
+                                            param_irred,
+                                            param_out,
+                                            fcs->get_nequiv(),
+                                            constraint);
+        } else {
+            for (i = 0; i < N; ++i) param_out[i] = param_irred[i];
+        }
+    }
+
+    return INFO;
+}
+
+void Optimize::update_incremental_factor(const size_t nrows,
+                                         std::vector<double> &amat,
+                                         std::vector<double> &bvec)
+{
+    // Householder QR of [R; A_new] exploiting the triangular structure of R.
+    // amat (nrows x ncols, column-major) and bvec are destroyed.
+
+    if (nrows == 0) return;
+
+    char side = 'L';
+    char trans = 'T';
+    int M_tmp = nrows;
+    int N_tmp = incremental_factor.ncols;
+    int L_tmp = 0;
+    int NB = std::min<int>(32, N_tmp);
+    int nrhs = 1;
+    int INFO;
+
+    std::vector<double> tmat(NB * N_tmp);
+    std::vector<double> work(NB * N_tmp);
+
+    dtpqrt_(&M_tmp, &N_tmp, &L_tmp, &NB,
+            &incremental_factor.rmat[0], &N_tmp,
+            &amat[0], &M_tmp,
+            &tmat[0], &NB, &work[0], &INFO);
+
+    // [Q^T b]_old and b_new are transformed by the same reflections.
+    dtpmqrt_(&side, &trans, &M_tmp, &nrhs, &N_tmp, &L_tmp, &NB,
+             &amat[0], &M_tmp, &tmat[0], &NB,
+             &incremental_factor.qtb[0], &N_tmp,
+             &bvec[0], &M_tmp, &work[0], &INFO);
+
+    for (size_t i = 0; i < nrows; ++i) {
+        incremental_factor.residual2 += bvec[i] * bvec[i];
+    }
+}
+
+
+int Optimize::elastic_net(const std::string job_prefix,
+                          const int maxorder,
+                          const size_t N_new,
+                          const size_t M,
+                          const Symmetry *symmetry,
+                          const std::vector<std::string> &str_order,
+                          const Fcs *fcs,
+                          Constraint *constraint,
+                          const int verbosity,
+                          std::vector<double> &param_out)
+{
+    auto info_fitting = 0;
+
+    std::vector<double> param_tmp(N_new, 0.0);
+
+    // Scale displacements if DNORM is not 1 and the data is not standardized.
+    const int scale_displacement
+        = std::abs(optcontrol.displacement_normalization_factor - 1.0) > eps
+        && optcontrol.standardize == 0;
+
+    if (scale_displacement) {
+        apply_scalers(maxorder, constraint);
+    }
+
+    if (optcontrol.use_sparse_solver && optcontrol.enet_solver != "CD" && verbosity > 0) {
+        std::cout << "  WARNING: SPARSE = 1 is supported only with ENET_SOLVER = CD." << std::endl;
+        std::cout << "           The coordinate descent method is used." << std::endl << std::endl;
+    }
+
+    if (optcontrol.cross_validation == 0) {
+
+        // Optimize with a given L1 coefficient (l1_alpha)
+        if (optcontrol.use_sparse_solver) {
+#ifdef WITH_SPARSE_SOLVER
+            info_fitting = run_elastic_net_optimization_sparse(maxorder,
+                                                               M,
+                                                               N_new,
+                                                               fcs,
+                                                               symmetry,
+                                                               constraint,
+                                                               verbosity,
+                                                               param_tmp);
+#else
+            std::cout << " Please recompile the code with -DWITH_SPARSE_SOLVER" << std::endl;
+            exit("elastic_net", "Sparse solver not supported.");
+#endif
+        } else {
+            info_fitting = run_elastic_net_optimization(maxorder,
+                                                        M,
+                                                        N_new,
+                                                        fcs,
+                                                        symmetry,
+                                                        constraint,
+                                                        verbosity,
+                                                        param_tmp);
+        }
+
+    } else {
+
+        // Run cross validation (manually or automatically)
+        info_fitting = run_elastic_net_crossvalidation(job_prefix,
+                                                       maxorder,
+                                                       fcs,
+                                                       symmetry,
+                                                       constraint,
+                                                       verbosity);
+    }
+
+    if (verbosity > 0 && info_fitting == 0) {
+        size_t iparam = 0;
+        std::vector<int> nzero_lasso(maxorder);
+
+        for (auto i = 0; i < maxorder; ++i) {
+            nzero_lasso[i] = 0;
+            for (const auto &it : constraint->get_index_bimap(i)) {
+                const auto inew = it.left + iparam;
+                if (std::abs(param_tmp[inew]) < eps) ++nzero_lasso[i];
+            }
+            iparam += constraint->get_index_bimap(i).size();
+        }
+
+        for (auto order = 0; order < maxorder; ++order) {
+            std::cout << "  Number of non-zero " << std::setw(9) << str_order[order] << " FCs : "
+                << constraint->get_index_bimap(order).size() - nzero_lasso[order] << std::endl;
+        }
+        std::cout << std::endl;
+    }
+
+    // Scale back force constants
+
+    if (scale_displacement) {
+        apply_scaler_force_constants(maxorder,
+                                     optcontrol.displacement_normalization_factor,
+                                     constraint,
+                                     param_tmp);
+        finalize_scalers(maxorder,
+                         constraint);
+    }
+
+    recover_original_forceconstants(maxorder,
+                                    param_tmp,
+                                    param_out,
+                                    fcs->get_nequiv(),
+                                    constraint);
+    return info_fitting;
+}
+
+int Optimize::run_elastic_net_crossvalidation(const std::string job_prefix,
+                                              const int maxorder,
+                                              const Fcs *fcs,
+                                              const Symmetry *symmetry,
+                                              const Constraint *constraint,
+                                              const int verbosity)
+{
+    // Cross-validation mode
+
+
+    if (verbosity > 0) {
+        std::cout << "  Elastic-net cross-validation with the following parameters:" << std::endl;
+        std::cout << "   L1_RATIO = " << optcontrol.l1_ratio << std::endl;
+        std::cout << "   CV = " << std::setw(15) << optcontrol.cross_validation << std::endl;
+        std::cout << "   CV_MINALPHA = " << std::setw(15) << optcontrol.l1_alpha_min;
+        std::cout << " CV_MAXALPHA = " << std::setw(15) << optcontrol.l1_alpha_max << std::endl;
+        std::cout << "   CV_NALPHA = " << std::setw(5) << optcontrol.num_l1_alpha << std::endl;
+        std::cout << "   CONV_TOL = " << std::setw(15) << optcontrol.tolerance_iteration << std::endl;
+        std::cout << "   MAXITER = " << std::setw(5) << optcontrol.maxnum_iteration << std::endl;
+        std::cout << "   ENET_DNORM = " << std::setw(15) << optcontrol.displacement_normalization_factor << std::endl;
+        std::cout << std::endl;
+
+        if (optcontrol.standardize) {
+            std::cout << "  STANDARDIZE = 1 : Standardization will be performed for matrix A and vector b." << std::
+                endl;
+            std::cout << "                    The ENET_DNORM-tag will be neglected." << std::endl;
+        } else {
+            std::cout << "  STANDARDIZE = 0 : No standardization of matrix A and vector b." << std::endl;
+            std::cout << "                    Columns of matrix A will be scaled by the ENET_DNORM value." << std::
+                endl;
+        }
+        std::cout << std::endl;
+
+        if (optcontrol.cross_validation == -1) {
+            std::cout << "  CV = -1: Manual CV mode." << std::endl;
+            std::cout << "           Validation data is read from DFSET_CV" << std::endl;
+        } else if (optcontrol.cross_validation > 0) {
+            std::cout << "  CV > 0: Automatic CV mode." << std::endl;
+        } else {
+            exit("run_elastic_net_crossvalidation",
+                 "This cannot happen.");
+        }
+        std::cout << std::endl;
+    }
+
+
+    if (optcontrol.parallel_cv && optcontrol.use_sparse_solver && verbosity > 0) {
+        std::cout << "  WARNING: CV_PARALLEL = 1 is not supported with SPARSE = 1." << std::endl;
+        std::cout << "           The CV folds are solved one by one." << std::endl << std::endl;
+    }
+
+    if (optcontrol.parallel_cv && optcontrol.enet_solver != "CD" && verbosity > 0) {
+        std::cout << "  WARNING: CV_PARALLEL = 1 is supported only with ENET_SOLVER = CD." << std::endl;
+        std::cout << "           The CV folds are solved one by one." << std::endl << std::endl;
+    }
+
+    // The concurrent CV forms the full A^T A, which must fit in GRAM_CACHE.
+    auto parallel_cv = optcontrol.parallel_cv && optcontrol.enet_solver == "CD"
+                       && !optcontrol.use_sparse_solver && optcontrol.cross_validation > 0;
+
+    if (parallel_cv && optcontrol.gram_cache_mb > 0.0) {
+        size_t N_new = 0;
+        if (constraint->get_constraint_algebraic()) {
+            for (auto i = 0; i < maxorder; ++i) {
+                N_new += constraint->get_index_bimap(i).size();
+            }
+        }
+        const auto memory_mb = static_cast<double>(N_new) * static_cast<double>(N_new)
+            * sizeof(double) / (1024.0 * 1024.0);
+
+        if (memory_mb > optcontrol.gram_cache_mb) {
+            parallel_cv = false;
+            if (verbosity > 0) {
+                std::cout << "  WARNING: A^T A (" << memory_mb << " MB) does not fit in GRAM_CACHE." << std::endl;
+                std::cout << "           The CV folds are solved one by one." << std::endl << std::endl;
+            }
+        }
+    }
+
+    if (optcontrol.cv_patience > 0 && verbosity > 0) {
+        if (optcontrol.use_sparse_solver) {
+            std::cout << "  WARNING: CV_PATIENCE is not supported with SPARSE = 1." << std::endl;
+            std::cout << "           All the L1_ALPHA values are solved." << std::endl << std::endl;
+        } else if (parallel_cv) {
+            std::cout << "  WARNING: CV_PATIENCE is not supported with CV_PARALLEL = 1." << std::endl;
+            std::cout << "           All the L1_ALPHA values are solved." << std::endl << std::endl;
+        }
+    }
 
     if (optcontrol.cross_validation == -1) {
 
@@ -470,6 +1162,15 @@ int Optimize::run_elastic_net_crossvalidation(const std::string job_prefix,
                           constraint,
                           verbosity);
 
+    } else if (parallel_cv) {
+
+        run_enetcv_parallel(job_prefix,
+                            maxorder,
+                            fcs,
+                            symmetry,
+                            constraint,
+                            verbosity);
+
     } else {
 
         run_enetcv_auto(job_prefix,
@@ -506,61 +1207,128 @@ void Optimize::run_enetcv_manual(const std::string job_prefix,
         }
     }
 
-    get_matrix_elements_algebraic_constraint(maxorder,
-                                             amat_1D,
-                                             bvec,
-                                             u_train,
-                                             f_train,
-                                             fnorm,
-                                             symmetry,
-                                             fcs,
-                                             constraint);
+    const auto file_coef = job_prefix + ".solution_path";
 
-    get_matrix_elements_algebraic_constraint(maxorder,
-                                             amat_1D_validation,
-                                             bvec_validation,
-                                             u_validation,
-                                             f_validation,
-                                             fnorm_validation,
-                                             symmetry,
-                                             fcs,
-                                             constraint);
+    compute_alphas(alphas);
 
-    Eigen::MatrixXd A = Eigen::Map<Eigen::MatrixXd>(&amat_1D[0], amat_1D.size() / N_new, N_new);
-    Eigen::VectorXd b = Eigen::Map<Eigen::VectorXd>(&bvec[0], bvec.size());
-    Eigen::MatrixXd A_validation = Eigen::Map<Eigen::MatrixXd>(&amat_1D_validation[0],
-                                                               amat_1D_validation.size() / N_new, N_new);
-    Eigen::VectorXd b_validation = Eigen::Map<Eigen::VectorXd>(&bvec_validation[0], bvec_validation.size());
+    if (optcontrol.use_sparse_solver) {
+#ifdef WITH_SPARSE_SOLVER
+        SpMat A(u_train.size() * u_train[0].size(), N_new);
+        SpMat A_validation(u_validation.size() * u_validation[0].size(), N_new);
+        Eigen::VectorXd b(A.rows()), b_validation(A_validation.rows());
 
-    if (verbosity > 0) {
-        Eigen::VectorXd mean = Eigen::VectorXd::Zero(A.cols());
-        Eigen::VectorXd dev = Eigen::VectorXd::Ones(A.cols());
+        get_matrix_elements_in_sparse_form(maxorder, A, b, u_train, f_train, fnorm,
+                                           symmetry, fcs, constraint);
+        get_matrix_elements_in_sparse_form(maxorder, A_validation, b_validation,
+                                           u_validation, f_validation, fnorm_validation,
+                                           symmetry, fcs, constraint);
 
-        if (optcontrol.standardize) {
-            Eigen::VectorXd factor_std, scale_beta;
-            factor_std.resize(A.cols());
-            scale_beta.resize(A.cols());
+        if (verbosity > 0) {
+            Eigen::VectorXd mean, dev, factor_std, scale_beta;
             get_standardizer(A, mean, dev, factor_std, scale_beta);
+            std::cout << "  Recommended CV_MAXALPHA = "
+                << get_esimated_max_alpha(A, b, mean, dev)
+                << std::endl << std::endl;
         }
-        std::cout << "  Recommended CV_MAXALPHA = "
-            << get_esimated_max_alpha(A, b, mean, dev)
-            << std::endl << std::endl;
-    }
-
-    const auto file_coef = job_prefix + ".solution_path";
-    const auto file_cv = job_prefix + ".enet_cv";
 
-    compute_alphas(alphas);
+        run_enet_solution_path_sparse(maxorder, A, b, A_validation, b_validation,
+                                      fnorm, fnorm_validation,
+                                      file_coef, verbosity,
+                                      constraint,
+                                      alphas,
+                                      training_error, validation_error, nonzeros);
+#else
+        std::cout << " Please recompile the code with -DWITH_SPARSE_SOLVER" << std::endl;
+        exit("run_enetcv_manual", "Sparse solver not supported.");
+#endif
+    } else {
 
-    run_enet_solution_path(maxorder, A, b, A_validation, b_validation,
-                           fnorm, fnorm_validation,
-                           file_coef, verbosity,
-                           constraint,
-                           alphas,
-                           training_error, validation_error, nonzeros);
+        get_matrix_elements_algebraic_constraint(maxorder,
+                                                 amat_1D,
+                                                 bvec,
+                                                 u_train,
+                                                 f_train,
+                                                 fnorm,
+                                                 symmetry,
+                                                 fcs,
+                                                 constraint);
 
-    write_cvresult_to_file(file_cv,
-                           alphas,
+        get_matrix_elements_algebraic_constraint(maxorder,
+                                                 amat_1D_validation,
+                                                 bvec_validation,
+                                                 u_validation,
+                                                 f_validation,
+                                                 fnorm_validation,
+                                                 symmetry,
+                                                 fcs,
+                                                 constraint);
+
+        const Eigen::Map<const Eigen::MatrixXd> A(&amat_1D[0], amat_1D.size() / N_new, N_new);
+        const Eigen::Map<const Eigen::VectorXd> b(&bvec[0], bvec.size());
+        const Eigen::Map<const Eigen::MatrixXd> A_validation(&amat_1D_validation[0],
+                                                             amat_1D_validation.size() / N_new, N_new);
+        const Eigen::Map<const Eigen::VectorXd> b_validation(&bvec_validation[0], bvec_validation.size());
+
+        if (verbosity > 0) {
+            Eigen::VectorXd mean = Eigen::VectorXd::Zero(A.cols());
+            Eigen::VectorXd dev = Eigen::VectorXd::Ones(A.cols());
+
+            if (optcontrol.standardize) {
+                Eigen::VectorXd factor_std, scale_beta;
+                factor_std.resize(A.cols());
+                scale_beta.resize(A.cols());
+                get_standardizer(A, mean, dev, factor_std, scale_beta);
+            }
+            std::cout << "  Recommended CV_MAXALPHA = "
+                << get_esimated_max_alpha(A, b, mean, dev)
+                << std::endl << std::endl;
+        }
+
+        run_enet_solution_path(maxorder, A, b, A_validation, b_validation,
+                               fnorm, fnorm_validation,
+                               file_coef, verbosity,
+                               constraint,
+                               alphas,
+                               training_error, validation_error, nonzeros,
+                               optcontrol.cv_patience);
+
+        if (optcontrol.cv_patience > 0) {
+
+            // Refine the grid around the minimum of the validation error.
+            std::vector<double> alphas_refined, training_error_refined, validation_error_refined;
+            std::vector<std::vector<int>> nonzeros_refined;
+
+            alphas.resize(validation_error.size());
+            refine_alphas(alphas, validation_error, alphas_refined);
+
+            if (verbosity > 0) {
+                std::cout << "  CV_PATIENCE = " << optcontrol.cv_patience << " : " << alphas.size() << " of "
+                    << optcontrol.num_l1_alpha << " L1_ALPHA values have been solved." << std::endl;
+                std::cout << "  " << alphas_refined.size()
+                    << " L1_ALPHA values are added around the minimum of the validation error." << std::endl;
+            }
+
+            run_enet_solution_path(maxorder, A, b, A_validation, b_validation,
+                                   fnorm, fnorm_validation,
+                                   file_coef + ".refined", verbosity,
+                                   constraint,
+                                   alphas_refined,
+                                   training_error_refined, validation_error_refined, nonzeros_refined);
+
+            alphas.insert(alphas.end(), alphas_refined.begin(), alphas_refined.end());
+            training_error.insert(training_error.end(),
+                                  training_error_refined.begin(), training_error_refined.end());
+            validation_error.insert(validation_error.end(),
+                                    validation_error_refined.begin(), validation_error_refined.end());
+            nonzeros.insert(nonzeros.end(), nonzeros_refined.begin(), nonzeros_refined.end());
+            sort_cvresult(alphas, training_error, validation_error, nonzeros);
+        }
+    }
+
+    const auto file_cv = job_prefix + ".enet_cv";
+
+    write_cvresult_to_file(file_cv,
+                           alphas,
                            training_error,
                            validation_error,
                            nonzeros);
@@ -589,7 +1357,7 @@ void Optimize::run_enetcv_auto(const std::string job_prefix,
         }
     }
 
-    const auto nstructures = u_train.size();
+    const auto nstructures = static_cast<int>(u_train.size());
     const auto nsets = optcontrol.cross_validation;
 
     if (nsets > nstructures) {
@@ -609,12 +1377,17 @@ void Optimize::run_enetcv_auto(const std::string job_prefix,
 
     std::vector<double> amat_1D, amat_1D_validation;
     std::vector<double> bvec, bvec_validation;
-    std::vector<double> alphas, training_error, validation_error;
+    std::vector<double> alphas, alphas_refined, training_error, validation_error;
     std::vector<std::vector<int>> nonzeros;
-    std::vector<std::vector<double>> training_error_accum, validation_error_accum;
+    std::vector<std::vector<double>> training_error_accum(nsets), validation_error_accum(nsets);
+    std::vector<std::vector<std::vector<int>>> nonzeros_accum(nsets);
     double fnorm, fnorm_validation;
 
-    auto ishift = 0;
+    // With CV_PATIENCE > 0, the folds are solved twice: first along the alpha grid
+    // until the validation error turns upward, and then at the alphas refined
+    // around the minimum of the averaged validation error.
+    const auto patience = optcontrol.use_sparse_solver ? 0 : optcontrol.cv_patience;
+    const auto npass = patience > 0 ? 2 : 1;
 
     compute_alphas(alphas);
 
@@ -622,101 +1395,332 @@ void Optimize::run_enetcv_auto(const std::string job_prefix,
         std::cout << "  Start " << nsets << "-fold CV" << std::endl;
     }
 
-    for (auto iset = 0; iset < nsets; ++iset) {
+    for (auto ipass = 0; ipass < npass; ++ipass) {
 
-        if (verbosity > 0) {
-            std::cout << std::endl;
-            std::cout << "  SET : " << std::setw(3) << iset + 1 << std::endl;
+        if (ipass == 1) {
+
+            // Keep the alphas solved in all the sets and refine the grid
+            // around the minimum of the averaged validation error.
+            auto nalphas = alphas.size();
+            for (auto iset = 0; iset < nsets; ++iset) {
+                nalphas = std::min(nalphas, validation_error_accum[iset].size());
+            }
+            alphas.resize(nalphas);
+            std::vector<double> validation_error_mean(nalphas, 0.0);
+            for (auto iset = 0; iset < nsets; ++iset) {
+                training_error_accum[iset].resize(nalphas);
+                validation_error_accum[iset].resize(nalphas);
+                nonzeros_accum[iset].resize(nalphas);
+                for (size_t ialpha = 0; ialpha < nalphas; ++ialpha) {
+                    validation_error_mean[ialpha] += validation_error_accum[iset][ialpha];
+                }
+            }
+            refine_alphas(alphas, validation_error_mean, alphas_refined);
+
+            if (verbosity > 0) {
+                std::cout << std::endl;
+                std::cout << "  CV_PATIENCE = " << patience << " : " << nalphas << " of "
+                    << optcontrol.num_l1_alpha << " L1_ALPHA values have been solved." << std::endl;
+                std::cout << "  " << alphas_refined.size()
+                    << " L1_ALPHA values are added around the minimum of the validation error." << std::endl;
+            }
         }
-        const auto istart_validation = ishift;
-        const auto iend_validation = istart_validation + ndata_block[iset];
 
-        u_train_tmp.clear();
-        f_train_tmp.clear();
-        u_validation_tmp.clear();
-        f_validation_tmp.clear();
+        const auto &alphas_pass = ipass == 0 ? alphas : alphas_refined;
+        auto ishift = 0;
+
+        for (auto iset = 0; iset < nsets; ++iset) {
+
+            if (verbosity > 0) {
+                std::cout << std::endl;
+                std::cout << "  SET : " << std::setw(3) << iset + 1 << std::endl;
+            }
+            const auto istart_validation = ishift;
+            const auto iend_validation = istart_validation + ndata_block[iset];
+
+            u_train_tmp.clear();
+            f_train_tmp.clear();
+            u_validation_tmp.clear();
+            f_validation_tmp.clear();
+
+            for (auto idata = 0; idata < nstructures; ++idata) {
+                if (idata >= istart_validation && idata < iend_validation) {
+                    u_validation_tmp.emplace_back(u_train[idata]);
+                    f_validation_tmp.emplace_back(f_train[idata]);
+                } else {
+                    u_train_tmp.emplace_back(u_train[idata]);
+                    f_train_tmp.emplace_back(f_train[idata]);
+                }
+            }
+            ishift += ndata_block[iset];
+
+            const auto file_coef = job_prefix + ".solution_path" + std::to_string(iset + 1)
+                + (ipass == 1 ? ".refined" : "");
+
+            if (optcontrol.use_sparse_solver) {
+#ifdef WITH_SPARSE_SOLVER
+                SpMat A(u_train_tmp.size() * u_train_tmp[0].size(), N_new);
+                SpMat A_validation(u_validation_tmp.size() * u_validation_tmp[0].size(), N_new);
+                Eigen::VectorXd b(A.rows()), b_validation(A_validation.rows());
+
+                get_matrix_elements_in_sparse_form(maxorder, A, b, u_train_tmp, f_train_tmp, fnorm,
+                                                   symmetry, fcs, constraint);
+                get_matrix_elements_in_sparse_form(maxorder, A_validation, b_validation,
+                                                   u_validation_tmp, f_validation_tmp, fnorm_validation,
+                                                   symmetry, fcs, constraint);
+
+                if (verbosity > 0) {
+                    Eigen::VectorXd mean, dev, factor_std, scale_beta;
+                    get_standardizer(A, mean, dev, factor_std, scale_beta);
+                    std::cout << "  Recommended CV_MAXALPHA = "
+                        << get_esimated_max_alpha(A, b, mean, dev)
+                        << std::endl << std::endl;
+                }
 
-        for (auto idata = 0; idata < nstructures; ++idata) {
-            if (idata >= istart_validation && idata < iend_validation) {
-                u_validation_tmp.emplace_back(u_train[idata]);
-                f_validation_tmp.emplace_back(f_train[idata]);
+                run_enet_solution_path_sparse(maxorder, A, b, A_validation, b_validation,
+                                              fnorm, fnorm_validation,
+                                              file_coef, verbosity,
+                                              constraint,
+                                              alphas_pass,
+                                              training_error, validation_error, nonzeros);
+#else
+                std::cout << " Please recompile the code with -DWITH_SPARSE_SOLVER" << std::endl;
+                exit("run_enetcv_auto", "Sparse solver not supported.");
+#endif
             } else {
-                u_train_tmp.emplace_back(u_train[idata]);
-                f_train_tmp.emplace_back(f_train[idata]);
+
+                get_matrix_elements_algebraic_constraint(maxorder,
+                                                         amat_1D,
+                                                         bvec,
+                                                         u_train_tmp,
+                                                         f_train_tmp,
+                                                         fnorm,
+                                                         symmetry,
+                                                         fcs,
+                                                         constraint);
+
+                get_matrix_elements_algebraic_constraint(maxorder,
+                                                         amat_1D_validation,
+                                                         bvec_validation,
+                                                         u_validation_tmp,
+                                                         f_validation_tmp,
+                                                         fnorm_validation,
+                                                         symmetry,
+                                                         fcs,
+                                                         constraint);
+
+                const Eigen::Map<const Eigen::MatrixXd> A(&amat_1D[0], amat_1D.size() / N_new, N_new);
+                const Eigen::Map<const Eigen::VectorXd> b(&bvec[0], bvec.size());
+                const Eigen::Map<const Eigen::MatrixXd> A_validation(&amat_1D_validation[0],
+                                                                     amat_1D_validation.size() / N_new, N_new);
+                const Eigen::Map<const Eigen::VectorXd> b_validation(&bvec_validation[0], bvec_validation.size());
+
+                if (verbosity > 0 && ipass == 0) {
+                    Eigen::VectorXd mean = Eigen::VectorXd::Zero(A.cols());
+                    Eigen::VectorXd dev = Eigen::VectorXd::Ones(A.cols());
+
+                    if (optcontrol.standardize) {
+                        Eigen::VectorXd factor_std, scale_beta;
+                        factor_std.resize(A.cols());
+                        scale_beta.resize(A.cols());
+                        get_standardizer(A, mean, dev, factor_std, scale_beta);
+                    }
+                    std::cout << "  Recommended CV_MAXALPHA = "
+                        << get_esimated_max_alpha(A, b, mean, dev)
+                        << std::endl << std::endl;
+                }
+
+                run_enet_solution_path(maxorder, A, b, A_validation, b_validation,
+                                       fnorm, fnorm_validation,
+                                       file_coef, verbosity,
+                                       constraint,
+                                       alphas_pass,
+                                       training_error, validation_error, nonzeros,
+                                       ipass == 0 ? patience : 0);
+            }
+
+            training_error_accum[iset].insert(training_error_accum[iset].end(),
+                                              training_error.begin(), training_error.end());
+            validation_error_accum[iset].insert(validation_error_accum[iset].end(),
+                                                validation_error.begin(), validation_error.end());
+            nonzeros_accum[iset].insert(nonzeros_accum[iset].end(), nonzeros.begin(), nonzeros.end());
+
+            if (ipass == npass - 1) {
+
+                const auto file_cv = job_prefix + ".enet_cvset" + std::to_string(iset + 1);
+                auto alphas_all = alphas;
+                if (ipass == 1) {
+                    alphas_all.insert(alphas_all.end(), alphas_refined.begin(), alphas_refined.end());
+                    sort_cvresult(alphas_all,
+                                  training_error_accum[iset],
+                                  validation_error_accum[iset],
+                                  nonzeros_accum[iset]);
+                }
+
+                write_cvresult_to_file(file_cv,
+                                       alphas_all,
+                                       training_error_accum[iset],
+                                       validation_error_accum[iset],
+                                       nonzeros_accum[iset]);
+
+                if (verbosity > 0) {
+                    std::cout << "  SET " << std::setw(3) << iset + 1 << " has been finished." << std::endl;
+                    std::cout << "  Minimum validation error at alpha = "
+                        << alphas_all[get_ialpha_at_minimum_validation_error(validation_error_accum[iset])]
+                        << std::endl;
+                    std::cout << "  The CV result is saved in " << file_cv << std::endl << std::endl;
+                    std::cout << "  ---------------------------------------------------" << std::endl;
+                }
             }
         }
-        ishift += ndata_block[iset];
+    }
 
-        get_matrix_elements_algebraic_constraint(maxorder,
-                                                 amat_1D,
-                                                 bvec,
-                                                 u_train_tmp,
-                                                 f_train_tmp,
-                                                 fnorm,
-                                                 symmetry,
-                                                 fcs,
-                                                 constraint);
+    if (npass == 2) {
+        alphas.insert(alphas.end(), alphas_refined.begin(), alphas_refined.end());
+        std::sort(alphas.begin(), alphas.end(), std::greater<double>());
+    }
 
-        get_matrix_elements_algebraic_constraint(maxorder,
-                                                 amat_1D_validation,
-                                                 bvec_validation,
-                                                 u_validation_tmp,
-                                                 f_validation_tmp,
-                                                 fnorm_validation,
-                                                 symmetry,
-                                                 fcs,
-                                                 constraint);
+    const auto file_cvscore = job_prefix + ".cvscore";
+    const auto ialpha_minimum = write_cvscore_to_file(file_cvscore,
+                                                      alphas,
+                                                      training_error_accum,
+                                                      validation_error_accum);
 
-        Eigen::MatrixXd A = Eigen::Map<Eigen::MatrixXd>(&amat_1D[0], amat_1D.size() / N_new, N_new);
-        Eigen::VectorXd b = Eigen::Map<Eigen::VectorXd>(&bvec[0], bvec.size());
+    if (verbosity > 0) {
+        std::cout << " Average and standard deviation of the CV error are" << std::endl;
+        std::cout << " saved in " << file_cvscore << std::endl;
+        std::cout << " Minimum CVSCORE at alpha = " << alphas[ialpha_minimum] << std::endl;
+        std::cout << std::endl;
+    }
+}
 
-        Eigen::MatrixXd A_validation = Eigen::Map<Eigen::MatrixXd>(&amat_1D_validation[0],
-                                                                   amat_1D_validation.size() / N_new, N_new);
-        Eigen::VectorXd b_validation = Eigen::Map<Eigen::VectorXd>(&bvec_validation[0], bvec_validation.size());
+void Optimize::run_enetcv_parallel(const std::string job_prefix,
+                                   const int maxorder,
+                                   const Fcs *fcs,
+                                   const Symmetry *symmetry,
+                                   const Constraint *constraint,
+                                   const int verbosity)
+{
+    // Automatic CV mode where the folds are solved concurrently.
+    // The sensing matrix and its Gram matrix are computed once for all the training data,
+    // and those of each fold are obtained by removing the contribution of the validation block.
 
+    size_t N_new = 0;
+    if (constraint->get_constraint_algebraic()) {
+        for (auto i = 0; i < maxorder; ++i) {
+            N_new += constraint->get_index_bimap(i).size();
+        }
+    }
 
-        if (verbosity > 0) {
-            Eigen::VectorXd mean = Eigen::VectorXd::Zero(A.cols());
-            Eigen::VectorXd dev = Eigen::VectorXd::Ones(A.cols());
+    const auto nstructures = static_cast<int>(u_train.size());
+    const auto nsets = optcontrol.cross_validation;
 
-            if (optcontrol.standardize) {
-                Eigen::VectorXd factor_std, scale_beta;
-                factor_std.resize(A.cols());
-                scale_beta.resize(A.cols());
-                get_standardizer(A, mean, dev, factor_std, scale_beta);
-            }
-            std::cout << "  Recommended CV_MAXALPHA = "
-                << get_esimated_max_alpha(A, b, mean, dev)
-                << std::endl << std::endl;
+    if (nsets > nstructures) {
+        exit("run_elastic_net_crossvalidation",
+             "The input CV is larger than the total number of training data.");
+    }
+
+    std::vector<int> ndata_block(nsets, nstructures / nsets);
+    for (auto iset = 0; iset < nsets; ++iset) {
+        if (nstructures - nsets * (nstructures / nsets) > iset) {
+            ++ndata_block[iset];
+        }
+    }
+
+    std::vector<double> amat_1D, bvec;
+    std::vector<double> alphas, alpha_max(nsets);
+    std::vector<std::vector<std::vector<int>>> nonzeros_accum(nsets);
+    std::vector<std::vector<double>> training_error_accum(nsets), validation_error_accum(nsets);
+    double fnorm;
+
+    compute_alphas(alphas);
+
+    get_matrix_elements_algebraic_constraint(maxorder,
+                                             amat_1D,
+                                             bvec,
+                                             u_train,
+                                             f_train,
+                                             fnorm,
+                                             symmetry,
+                                             fcs,
+                                             constraint);
+
+    const auto M = bvec.size();
+    const auto nrows_per_data = M / nstructures;
+
+    Eigen::Map<const Eigen::MatrixXd> A(&amat_1D[0], M, N_new);
+    Eigen::Map<const Eigen::VectorXd> b(&bvec[0], M);
+
+    // Quantities shared by all the folds
+    Eigen::MatrixXd Gram(N_new, N_new);
+    Gram.noalias() = A.transpose() * A;
+    const Eigen::VectorXd Atb = A.transpose() * b;
+    const Eigen::VectorXd colsum = A.colwise().sum().transpose();
+
+    std::vector<double> fnorm2_data(nstructures, 0.0);
+    for (auto idata = 0; idata < nstructures; ++idata) {
+        for (const auto &it : f_train[idata]) fnorm2_data[idata] += it * it;
+    }
+
+    std::vector<size_t> istart_block(nsets, 0);
+    for (auto iset = 1; iset < nsets; ++iset) {
+        istart_block[iset] = istart_block[iset - 1] + ndata_block[iset - 1];
+    }
+
+    if (verbosity > 0) {
+        std::cout << "  Start " << nsets << "-fold CV (folds are solved concurrently)" << std::endl;
+        std::cout << "  Columns of A^T A computed : " << N_new << std::endl;
+    }
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 1)
+#endif
+    for (auto iset = 0; iset < nsets; ++iset) {
+
+        const auto istart_validation = istart_block[iset];
+        const auto iend_validation = istart_validation + ndata_block[iset];
+
+        auto fnorm2_validation = 0.0;
+        for (auto idata = istart_validation; idata < iend_validation; ++idata) {
+            fnorm2_validation += fnorm2_data[idata];
         }
+        const auto fnorm_validation = std::sqrt(fnorm2_validation);
+        const auto fnorm_training = std::sqrt(std::max(fnorm * fnorm - fnorm2_validation, 0.0));
 
         const auto file_coef = job_prefix + ".solution_path" + std::to_string(iset + 1);
-        const auto file_cv = job_prefix + ".enet_cvset" + std::to_string(iset + 1);
 
+        run_enet_solution_path_downdate(maxorder, A, b, Gram, Atb, colsum,
+                                        istart_validation * nrows_per_data,
+                                        ndata_block[iset] * nrows_per_data,
+                                        fnorm_training, fnorm_validation,
+                                        file_coef,
+                                        constraint,
+                                        alphas,
+                                        training_error_accum[iset],
+                                        validation_error_accum[iset],
+                                        nonzeros_accum[iset],
+                                        alpha_max[iset]);
+    }
 
-        run_enet_solution_path(maxorder, A, b, A_validation, b_validation,
-                               fnorm, fnorm_validation,
-                               file_coef, verbosity,
-                               constraint,
-                               alphas,
-                               training_error, validation_error, nonzeros);
+    for (auto iset = 0; iset < nsets; ++iset) {
+
+        const auto file_cv = job_prefix + ".enet_cvset" + std::to_string(iset + 1);
 
         write_cvresult_to_file(file_cv,
                                alphas,
-                               training_error,
-                               validation_error,
-                               nonzeros);
+                               training_error_accum[iset],
+                               validation_error_accum[iset],
+                               nonzeros_accum[iset]);
 
         if (verbosity > 0) {
+            std::cout << std::endl;
             std::cout << "  SET " << std::setw(3) << iset + 1 << " has been finished." << std::endl;
+            std::cout << "  Recommended CV_MAXALPHA = " << alpha_max[iset] << std::endl;
             std::cout << "  Minimum validation error at alpha = "
-                << alphas[get_ialpha_at_minimum_validation_error(validation_error)] << std::endl;
+                << alphas[get_ialpha_at_minimum_validation_error(validation_error_accum[iset])] << std::endl;
             std::cout << "  The CV result is saved in " << file_cv << std::endl << std::endl;
             std::cout << "  ---------------------------------------------------" << std::endl;
         }
-
-        training_error_accum.emplace_back(training_error);
-        validation_error_accum.emplace_back(validation_error);
     }
 
     const auto file_cvscore = job_prefix + ".cvscore";
@@ -741,7 +1745,7 @@ void Optimize::write_cvresult_to_file(const std::string file_out,
 {
     std::ofstream ofs_cv;
     ofs_cv.open(file_out.c_str(), std::ios::out);
-    ofs_cv << "# Algorithm : Coordinate descent" << std::endl;
+    ofs_cv << "# Algorithm : " << (optcontrol.enet_solver == "CD" ? "Coordinate descent" : optcontrol.enet_solver) << std::endl;
     ofs_cv << "# L1_RATIO = " << optcontrol.l1_ratio << std::endl;
     ofs_cv << "# ENET_DNORM = " << std::setw(15) << optcontrol.displacement_normalization_factor << std::endl;
     ofs_cv << "# STANDARDIZE = " << optcontrol.standardize << std::endl;
@@ -806,11 +1810,15 @@ int Optimize::write_cvscore_to_file(const std::string file_out,
 
     std::ofstream ofs_cv;
     ofs_cv.open(file_out.c_str(), std::ios::out);
-    ofs_cv << "# Algorithm : Coordinate descent" << std::endl;
-    ofs_cv << "# L1_RATIO = " << optcontrol.l1_ratio << std::endl;
-    ofs_cv << "# ENET_DNORM = " << std::setw(15) << optcontrol.displacement_normalization_factor << std::endl;
-    ofs_cv << "# STANDARDIZE = " << optcontrol.standardize << std::endl;
-    ofs_cv << "# CONV_TOL = " << std::setw(15) << optcontrol.tolerance_iteration << std::endl;
+    if (optcontrol.linear_model == 1) {
+        ofs_cv << "# Algorithm : Ordinary least squares (L1 ALPHA = 0)" << std::endl;
+    } else {
+        ofs_cv << "# Algorithm : " << (optcontrol.enet_solver == "CD" ? "Coordinate descent" : optcontrol.enet_solver) << std::endl;
+        ofs_cv << "# L1_RATIO = " << optcontrol.l1_ratio << std::endl;
+        ofs_cv << "# ENET_DNORM = " << std::setw(15) << optcontrol.displacement_normalization_factor << std::endl;
+        ofs_cv << "# STANDARDIZE = " << optcontrol.standardize << std::endl;
+        ofs_cv << "# CONV_TOL = " << std::setw(15) << optcontrol.tolerance_iteration << std::endl;
+    }
     ofs_cv << "# " << nsets << "-fold cross-validation scores" << std::endl;
     ofs_cv << "# L1 ALPHA, Fitting error (mean, std), Validation error (mean, std) " << std::endl;
 
@@ -839,10 +1847,10 @@ int Optimize::get_ialpha_at_minimum_validation_error(const std::vector<double> &
 }
 
 void Optimize::run_enet_solution_path(const int maxorder,
-                                      Eigen::MatrixXd &A,
-                                      Eigen::VectorXd &b,
-                                      Eigen::MatrixXd &A_validation,
-                                      Eigen::VectorXd &b_validation,
+                                      const Eigen::Ref<const Eigen::MatrixXd> &A,
+                                      const Eigen::Ref<const Eigen::VectorXd> &b,
+                                      const Eigen::Ref<const Eigen::MatrixXd> &A_validation,
+                                      const Eigen::Ref<const Eigen::VectorXd> &b_validation,
                                       const double fnorm,
                                       const double fnorm_validation,
                                       const std::string file_coef,
@@ -851,8 +1859,13 @@ void Optimize::run_enet_solution_path(const int maxorder,
                                       const std::vector<double> &alphas,
                                       std::vector<double> &training_error,
                                       std::vector<double> &validation_error,
-                                      std::vector<std::vector<int>> &nonzeros) const
+                                      std::vector<std::vector<int>> &nonzeros,
+                                      const int patience) const
 {
+    // When patience > 0, the path is terminated after the validation error
+    // has increased at patience consecutive alphas, and only the errors of
+    // the alphas solved so far are returned.
+
     int initialize_mode;
 
     std::ofstream ofs_coef;
@@ -860,34 +1873,25 @@ void Optimize::run_enet_solution_path(const int maxorder,
     std::vector<double> params_tmp;
     std::vector<int> nzero_lasso(maxorder);
 
-    bool *has_prod;
-
-    Eigen::MatrixXd Prod;
     Eigen::VectorXd grad0, grad, x;
     Eigen::VectorXd scale_beta, scale_beta_enet;
     Eigen::VectorXd factor_std;
-    Eigen::VectorXd fdiff, fdiff_validation;
     Eigen::VectorXd mean, dev;
+    Eigen::VectorXd res2_training, res2_validation, fdiff_validation;
 
     size_t N_new = A.cols();
     size_t M = A.rows();
-    size_t M_validation = A_validation.rows();
+    const auto nalphas = alphas.size();
 
-    Prod.setZero(N_new, N_new);
     grad0.resize(N_new);
     grad.resize(N_new);
     x.setZero(N_new);
     scale_beta.resize(N_new);
     scale_beta_enet.resize(N_new);
     factor_std.resize(N_new);
-    fdiff.resize(M);
-    fdiff_validation.resize(M_validation);
 
-    allocate(has_prod, N_new);
-
-    for (size_t i = 0; i < N_new; ++i) {
-        has_prod[i] = false;
-    }
+    // Coefficients of all alphas divided by dev, used for the errors after the path.
+    Eigen::MatrixXd Z(N_new, nalphas);
 
     if (optcontrol.save_solution_path) {
         ofs_coef.open(file_coef.c_str(), std::ios::out);
@@ -895,23 +1899,40 @@ void Optimize::run_enet_solution_path(const int maxorder,
         params_tmp.resize(N_new);
     }
 
-    if (optcontrol.standardize) {
-        get_standardizer(A, mean, dev, factor_std, scale_beta);
-        apply_standardizer(A, mean, dev);
-        apply_standardizer(A_validation, mean, dev);
-    } else {
-        get_standardizer(A, mean, dev, factor_std, scale_beta);
-    }
+    // A and A_validation are not modified. The standardization is applied
+    // implicitly through mean and dev.
+    get_standardizer(A, mean, dev, factor_std, scale_beta);
 
     training_error.clear();
     validation_error.clear();
     nonzeros.clear();
 
+    // The columns of A^T A are shared by all alphas.
+    GramCache gram(A, mean, dev, optcontrol.gram_cache_mb);
+
+    Eigen::MatrixXd Gram;
+    double lipschitz = 0.0;
+    if (optcontrol.enet_solver == "FISTA") setup_proximal_gradient(A, mean, dev, Gram, lipschitz);
+
     // Start iteration
 
-    grad0 = A.transpose() * b;
+    grad0 = (A.transpose() * b - b.sum() * mean).cwiseQuotient(dev);
     grad = grad0;
 
+    // The solution is zero for alpha * l1_ratio >= alpha_zero.
+    const auto alpha_zero = grad0.cwiseAbs().maxCoeff() / static_cast<double>(M);
+
+    // The LARS path gives the solutions of all alphas at once.
+    Eigen::MatrixXd X_lars;
+    if (optcontrol.enet_solver == "LARS") {
+        lars_path(A, mean, dev, grad0, alphas, X_lars, verbosity > 1 ? verbosity : 0);
+    }
+
+    auto nsolved = nalphas;
+    auto nrise = 0;
+    auto res2_prev = 0.0;
+    if (patience > 0) res2_validation.resize(nalphas);
+
     if (verbosity == 1) std::cout << std::setw(3);
 
     for (size_t ialpha = 0; ialpha < alphas.size(); ++ialpha) {
@@ -929,28 +1950,33 @@ void Optimize::run_enet_solution_path(const int maxorder,
             scale_beta_enet(i) = 1.0 / (1.0 / scale_beta(i) + (1.0 - optcontrol.l1_ratio) * l1_alpha);
         }
 
-        coordinate_descent(M, N_new, l1_alpha,
-                           initialize_mode,
-                           x, A, b, grad0, has_prod, Prod, grad, fnorm,
-                           scale_beta_enet,
-                           verbosity);
-
-        double correction_intercept = 0.0;
-        for (size_t i = 0; i < N_new; ++i) {
-            correction_intercept += x(i) * mean(i) * factor_std(i);
+        if (optcontrol.enet_solver == "LARS") {
+            x = X_lars.col(ialpha);
+        } else if (l1_alpha * optcontrol.l1_ratio >= alpha_zero) {
+            x.setZero();
+            grad = grad0;
+        } else if (optcontrol.enet_solver == "FISTA") {
+            proximal_gradient(M, N_new, l1_alpha,
+                              initialize_mode,
+                              x, A, b, mean, dev, grad0, Gram, lipschitz, grad, fnorm,
+                              verbosity);
+        } else {
+            coordinate_descent(M, N_new, l1_alpha,
+                               ialpha > 0 ? alphas[ialpha - 1] : 0.0,
+                               initialize_mode,
+                               x, A, b, mean, dev, grad0, gram, grad, fnorm,
+                               scale_beta_enet,
+                               verbosity);
         }
-        fdiff = A * x - b + correction_intercept * Eigen::VectorXd::Ones(M);
-        fdiff_validation = A_validation * x - b_validation + correction_intercept * Eigen::VectorXd::Ones(M_validation);
-        const auto res1 = fdiff.dot(fdiff) / (fnorm * fnorm);
-        const auto res2 = fdiff_validation.dot(fdiff_validation) / (fnorm_validation * fnorm_validation);
+
+        // With the intercept correction, the residual is A * (x / dev) - b.
+        Z.col(ialpha) = x.cwiseQuotient(dev);
 
         get_number_of_zero_coefs(maxorder,
                                  constraint,
                                  x,
                                  nzero_lasso);
 
-        training_error.push_back(std::sqrt(res1));
-        validation_error.push_back(std::sqrt(res2));
         nonzeros.push_back(nzero_lasso);
 
         if (optcontrol.save_solution_path) {
@@ -977,59 +2003,340 @@ void Optimize::run_enet_solution_path(const int maxorder,
                 std::cout << std::setw(3);
             }
         }
+
+        if (patience > 0) {
+            fdiff_validation.noalias() = A_validation * Z.col(ialpha);
+            fdiff_validation -= b_validation;
+            res2_validation(ialpha) = fdiff_validation.squaredNorm();
+            nrise = (ialpha > 0 && res2_validation(ialpha) > res2_prev) ? nrise + 1 : 0;
+            res2_prev = res2_validation(ialpha);
+            if (nrise >= patience) {
+                nsolved = ialpha + 1;
+                break;
+            }
+        }
     }
 
     if (verbosity == 1) std::cout << std::endl;
 
+    // Training and validation errors of all alphas
+    get_residual_norms(A, b, Z.leftCols(nsolved), res2_training);
+    if (patience == 0) get_residual_norms(A_validation, b_validation, Z, res2_validation);
+
+    for (size_t ialpha = 0; ialpha < nsolved; ++ialpha) {
+        training_error.push_back(std::sqrt(res2_training(ialpha) / (fnorm * fnorm)));
+        validation_error.push_back(std::sqrt(res2_validation(ialpha) / (fnorm_validation * fnorm_validation)));
+    }
+
     if (optcontrol.save_solution_path) {
         ofs_coef.close();
         params_tmp.clear();
         params_tmp.shrink_to_fit();
     }
-    deallocate(has_prod);
 }
 
-void Optimize::compute_alphas(std::vector<double> &alphas) const
+void Optimize::run_enet_solution_path_downdate(const int maxorder,
+                                               const Eigen::Ref<const Eigen::MatrixXd> &A,
+                                               const Eigen::Ref<const Eigen::VectorXd> &b,
+                                               const Eigen::MatrixXd &Gram,
+                                               const Eigen::VectorXd &Atb,
+                                               const Eigen::VectorXd &colsum,
+                                               const size_t irow_validation,
+                                               const size_t nrows_validation,
+                                               const double fnorm,
+                                               const double fnorm_validation,
+                                               const std::string file_coef,
+                                               const Constraint *constraint,
+                                               const std::vector<double> &alphas,
+                                               std::vector<double> &training_error,
+                                               std::vector<double> &validation_error,
+                                               std::vector<std::vector<int>> &nonzeros,
+                                               double &alpha_max) const
 {
-    alphas.resize(optcontrol.num_l1_alpha);
-    for (auto ialpha = 0; ialpha < optcontrol.num_l1_alpha; ++ialpha) {
+    // Solution path of a CV fold whose validation data are the rows
+    // [irow_validation, irow_validation + nrows_validation) of A.
+    // A, Gram = A^T A, Atb = A^T b, and colsum are those of all the training data,
+    // and the quantities of the fold are obtained by subtracting the validation block.
+    // The standardization of the fold is applied implicitly to the Gram columns.
 
-        const auto l1_alpha = optcontrol.l1_alpha_min
-            * std::pow(optcontrol.l1_alpha_max / optcontrol.l1_alpha_min,
-                       static_cast<double>(optcontrol.num_l1_alpha - ialpha - 1) /
-                       static_cast<double>(optcontrol.num_l1_alpha));
+    std::ofstream ofs_coef;
 
-        alphas[ialpha] = l1_alpha;
-    }
-}
+    std::vector<double> params_tmp;
+    std::vector<int> nzero_lasso(maxorder);
 
+    const size_t N_new = A.cols();
+    const size_t M_all = A.rows();
+    const auto M = M_all - nrows_validation;
+    const auto inv_M = 1.0 / static_cast<double>(M);
 
-int Optimize::run_elastic_net_optimization(const int maxorder,
-                                           const size_t M,
-                                           const size_t N_new,
-                                           const Fcs *fcs,
-                                           const Symmetry *symmetry,
-                                           const Constraint *constraint,
-                                           const int verbosity,
-                                           std::vector<double> &param_out) const
-{
-    // Start Lasso optimization
-    int i;
-    bool *has_prod;
-    double fnorm;
+    const auto A_validation = A.middleRows(irow_validation, nrows_validation);
+    const auto b_validation = b.segment(irow_validation, nrows_validation);
 
-    Eigen::MatrixXd A, Prod;
-    Eigen::VectorXd b, grad0, grad, x;
-    Eigen::VectorXd scale_beta, factor_std;
-    Eigen::VectorXd fdiff;
-    Eigen::VectorXd mean, dev;
+    Eigen::VectorXd grad0(N_new), grad(N_new), x;
+    Eigen::VectorXd res2_head, res2_validation, res2_tail;
+    Eigen::VectorXd mean(N_new), dev(N_new), scale_beta(N_new), scale_beta_enet(N_new);
 
-    std::vector<double> amat_1D;
-    std::vector<double> bvec;
+    x.setZero(N_new);
 
-    get_matrix_elements_algebraic_constraint(maxorder,
-                                             amat_1D,
-                                             bvec,
+    // Coefficients of all alphas divided by dev
+    Eigen::MatrixXd Z(N_new, alphas.size());
+
+    if (optcontrol.save_solution_path) {
+        ofs_coef.open(file_coef.c_str(), std::ios::out);
+        ofs_coef << "# L1 ALPHA, coefficients" << std::endl;
+        params_tmp.resize(N_new);
+    }
+
+    // Statistics of the columns of the training block (cf. get_standardizer)
+    const Eigen::VectorXd colsum_train = colsum - A_validation.colwise().sum().transpose();
+    for (size_t j = 0; j < N_new; ++j) {
+        const auto sum2 = (Gram(j, j) - A_validation.col(j).squaredNorm()) * inv_M;
+        if (optcontrol.standardize) {
+            mean(j) = colsum_train(j) * inv_M;
+            dev(j) = std::sqrt(sum2 - mean(j) * mean(j));
+            scale_beta(j) = 1.0;
+        } else {
+            mean(j) = 0.0;
+            dev(j) = 1.0;
+            scale_beta(j) = 1.0 / sum2;
+        }
+    }
+
+    // Columns of the standardized Gram matrix of the training block,
+    // D^{-1} (A_t^T A_t - M * mean mean^T) D^{-1} with A_t^T A_t = A^T A - A_v^T A_v.
+    GramCache gram(N_new,
+                   [&](const std::vector<size_t> &columns_in, Eigen::MatrixXd &panel_out)
+                   {
+                       const auto npanel = columns_in.size();
+                       Eigen::MatrixXd A_panel(nrows_validation, npanel);
+                       for (size_t k = 0; k < npanel; ++k) A_panel.col(k) = A_validation.col(columns_in[k]);
+                       panel_out.noalias() = -A_validation.transpose() * A_panel;
+                       for (size_t k = 0; k < npanel; ++k) {
+                           const auto j = columns_in[k];
+                           panel_out.col(k) += Gram.col(j);
+                           if (optcontrol.standardize) {
+                               panel_out.col(k) -= (static_cast<double>(M) * mean(j)) * mean;
+                               panel_out.col(k) = panel_out.col(k).cwiseQuotient(dev) / dev(j);
+                           }
+                       }
+                   },
+                   optcontrol.gram_cache_mb);
+
+    const auto sum_b = b.sum() - b_validation.sum();
+    grad0 = (Atb - A_validation.transpose() * b_validation - sum_b * mean).cwiseQuotient(dev);
+    grad = grad0;
+    alpha_max = grad0.cwiseAbs().maxCoeff() * inv_M;
+
+    training_error.clear();
+    validation_error.clear();
+    nonzeros.clear();
+
+    // The log of coordinate_descent needs the sensing matrix of the fold,
+    // which is not formed here.
+    const Eigen::MatrixXd A_dummy;
+    const Eigen::VectorXd b_dummy;
+
+    for (size_t ialpha = 0; ialpha < alphas.size(); ++ialpha) {
+
+        const auto l1_alpha = alphas[ialpha];
+
+        for (size_t i = 0; i < N_new; ++i) {
+            scale_beta_enet(i) = 1.0 / (1.0 / scale_beta(i) + (1.0 - optcontrol.l1_ratio) * l1_alpha);
+        }
+
+        coordinate_descent(M, N_new, l1_alpha,
+                           ialpha > 0 ? alphas[ialpha - 1] : 0.0,
+                           ialpha > 0,
+                           x, A_dummy, b_dummy, mean, dev, grad0, gram, grad, fnorm,
+                           scale_beta_enet,
+                           0);
+
+        // With the intercept correction, the residual of the standardized problem
+        // is A * (x / dev) - b for both the training and validation blocks.
+        Z.col(ialpha) = x.cwiseQuotient(dev);
+
+        get_number_of_zero_coefs(maxorder,
+                                 constraint,
+                                 x,
+                                 nzero_lasso);
+
+        nonzeros.push_back(nzero_lasso);
+
+        if (optcontrol.save_solution_path) {
+            ofs_coef << std::setw(15) << l1_alpha;
+
+            for (size_t i = 0; i < N_new; ++i) params_tmp[i] = x[i];
+
+            apply_scaler_force_constants(maxorder,
+                                         optcontrol.displacement_normalization_factor,
+                                         constraint,
+                                         params_tmp);
+
+            for (size_t i = 0; i < N_new; ++i) {
+                ofs_coef << std::setw(15) << params_tmp[i];
+            }
+            ofs_coef << std::endl;
+        }
+    }
+
+    // Training and validation errors of all alphas
+    const auto irow_tail = irow_validation + nrows_validation;
+    get_residual_norms(A.topRows(irow_validation), b.head(irow_validation), Z, res2_head);
+    get_residual_norms(A_validation, b_validation, Z, res2_validation);
+    get_residual_norms(A.bottomRows(M_all - irow_tail), b.tail(M_all - irow_tail), Z, res2_tail);
+
+    for (size_t ialpha = 0; ialpha < alphas.size(); ++ialpha) {
+        const auto res_training = res2_head(ialpha) + res2_tail(ialpha);
+        training_error.push_back(std::sqrt(res_training / (fnorm * fnorm)));
+        validation_error.push_back(std::sqrt(res2_validation(ialpha) / (fnorm_validation * fnorm_validation)));
+    }
+
+    if (optcontrol.save_solution_path) ofs_coef.close();
+}
+
+void Optimize::compute_alphas(std::vector<double> &alphas) const
+{
+    alphas.resize(optcontrol.num_l1_alpha);
+    for (auto ialpha = 0; ialpha < optcontrol.num_l1_alpha; ++ialpha) {
+
+        const auto l1_alpha = optcontrol.l1_alpha_min
+            * std::pow(optcontrol.l1_alpha_max / optcontrol.l1_alpha_min,
+                       static_cast<double>(optcontrol.num_l1_alpha - ialpha - 1) /
+                       static_cast<double>(optcontrol.num_l1_alpha));
+
+        alphas[ialpha] = l1_alpha;
+    }
+}
+
+void Optimize::refine_alphas(const std::vector<double> &alphas,
+                             const std::vector<double> &error,
+                             std::vector<double> &alphas_refined) const
+{
+    // New alphas between the neighbors of the minimum of error.
+    // Each of the two intervals of the geometric grid is divided into nsub.
+
+    const auto nsub = 4;
+    const auto nalphas = alphas.size();
+
+    alphas_refined.clear();
+    if (nalphas < 2) return;
+
+    const size_t imin = std::min_element(error.begin(), error.end()) - error.begin();
+    const auto istart = imin > 0 ? imin - 1 : imin;
+    const auto iend = std::min(imin + 1, nalphas - 1);
+
+    for (auto i = istart; i < iend; ++i) {
+        const auto ratio = alphas[i + 1] / alphas[i];
+        for (auto k = 1; k < nsub; ++k) {
+            alphas_refined.push_back(alphas[i] * std::pow(ratio, static_cast<double>(k) / nsub));
+        }
+    }
+}
+
+void Optimize::sort_cvresult(std::vector<double> &alphas,
+                             std::vector<double> &training_error,
+                             std::vector<double> &validation_error,
+                             std::vector<std::vector<int>> &nonzeros) const
+{
+    // Sort the CV results in the descending order of alpha.
+
+    const auto nalphas = alphas.size();
+    std::vector<size_t> order(nalphas);
+    for (size_t i = 0; i < nalphas; ++i) order[i] = i;
+    std::stable_sort(order.begin(), order.end(),
+                     [&alphas](const size_t i, const size_t j) { return alphas[i] > alphas[j]; });
+
+    const auto alphas_tmp = alphas;
+    const auto training_error_tmp = training_error;
+    const auto validation_error_tmp = validation_error;
+    const auto nonzeros_tmp = nonzeros;
+
+    for (size_t i = 0; i < nalphas; ++i) {
+        alphas[i] = alphas_tmp[order[i]];
+        training_error[i] = training_error_tmp[order[i]];
+        validation_error[i] = validation_error_tmp[order[i]];
+        nonzeros[i] = nonzeros_tmp[order[i]];
+    }
+}
+
+void Optimize::get_residual_norms(const Eigen::Ref<const Eigen::MatrixXd> &A,
+                                  const Eigen::Ref<const Eigen::VectorXd> &b,
+                                  const Eigen::Ref<const Eigen::MatrixXd> &Z,
+                                  Eigen::VectorXd &res2) const
+{
+    // res2(k) = |A * Z.col(k) - b|^2 for all the columns of Z by one pass over A.
+    // Only the rows of Z that are nonzero for some k are needed. A is processed
+    // in blocks of rows, and the residuals of a block are obtained by a matrix-matrix product.
+
+    const size_t nrows = A.rows();
+    const size_t nvec = Z.cols();
+    const size_t nrows_block = 256;
+    const auto nblocks = (nrows + nrows_block - 1) / nrows_block;
+
+    std::vector<Eigen::Index> support;
+    for (Eigen::Index j = 0; j < Z.rows(); ++j) {
+        if ((Z.row(j).array() != 0.0).any()) support.push_back(j);
+    }
+    const auto nsupport = support.size();
+
+    Eigen::MatrixXd Z_support(nsupport, nvec);
+    for (size_t k = 0; k < nsupport; ++k) Z_support.row(k) = Z.row(support[k]);
+
+    // The partial sums are added in a fixed order so that the result
+    // does not depend on the number of threads.
+    Eigen::MatrixXd res2_block(nvec, nblocks);
+
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+        Eigen::MatrixXd A_block, R;
+
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+        for (long iblock = 0; iblock < static_cast<long>(nblocks); ++iblock) {
+            const auto irow = iblock * nrows_block;
+            const auto nb = std::min(nrows_block, nrows - irow);
+
+            A_block.resize(nb, nsupport);
+            for (size_t k = 0; k < nsupport; ++k) {
+                A_block.col(k) = A.col(support[k]).segment(irow, nb);
+            }
+            R.noalias() = A_block * Z_support;
+            R.colwise() -= b.segment(irow, nb);
+            res2_block.col(iblock) = R.colwise().squaredNorm().transpose();
+        }
+    }
+
+    res2 = res2_block.rowwise().sum();
+}
+
+
+int Optimize::run_elastic_net_optimization(const int maxorder,
+                                           const size_t M,
+                                           const size_t N_new,
+                                           const Fcs *fcs,
+                                           const Symmetry *symmetry,
+                                           const Constraint *constraint,
+                                           const int verbosity,
+                                           std::vector<double> &param_out) const
+{
+    // Start Lasso optimization
+    int i;
+    double fnorm;
+
+    Eigen::VectorXd grad0, grad, x;
+    Eigen::VectorXd scale_beta, factor_std;
+    Eigen::VectorXd fdiff;
+    Eigen::VectorXd mean, dev;
+
+    std::vector<double> amat_1D;
+    std::vector<double> bvec;
+
+    get_matrix_elements_algebraic_constraint(maxorder,
+                                             amat_1D,
+                                             bvec,
                                              u_train,
                                              f_train,
                                              fnorm,
@@ -1037,1546 +2344,4125 @@ int Optimize::run_elastic_net_optimization(const int maxorder,
                                              fcs,
                                              constraint);
 
-    // Coordinate descent
+    // Coordinate descent
+
+    const Eigen::Map<const Eigen::MatrixXd> A(&amat_1D[0], M, N_new);
+    const Eigen::Map<const Eigen::VectorXd> b(&bvec[0], M);
+
+    grad0.resize(N_new);
+    grad.resize(N_new);
+    x.setZero(N_new);
+    scale_beta.resize(N_new);
+    factor_std.resize(N_new);
+    fdiff.resize(M);
+
+    if (verbosity > 0) {
+        std::cout << "  Elastic-net minimization with the following parameters:" << std::endl;
+        std::cout << "   L1_RATIO = " << optcontrol.l1_ratio << std::endl;
+        std::cout << "   L1_ALPHA = " << std::setw(15) << optcontrol.l1_alpha << std::endl;
+        std::cout << "   CONV_TOL = " << std::setw(15) << optcontrol.tolerance_iteration << std::endl;
+        std::cout << "   MAXITER = " << std::setw(5) << optcontrol.maxnum_iteration << std::endl;
+        std::cout << "   ENET_DNORM = " << std::setw(15) << optcontrol.displacement_normalization_factor << std::endl;
+
+        std::cout << std::endl;
+        if (optcontrol.standardize) {
+            std::cout << " STANDARDIZE = 1 : Standardization will be performed for matrix A and vector b." << std::endl;
+            std::cout << "                   The ENET_DNORM-tag will be neglected." << std::endl;
+        } else {
+            std::cout << " STANDARDIZE = 0 : No standardization of matrix A and vector b." << std::endl;
+            std::cout << "                   Columns of matrix A will be scaled by the ENET_DNORM value." << std::endl;
+        }
+    }
+
+    // Standardize if necessary. A itself is not modified.
+
+    get_standardizer(A, mean, dev, factor_std, scale_beta);
+
+    grad0 = (A.transpose() * b - b.sum() * mean).cwiseQuotient(dev);
+    grad = grad0;
+
+#pragma omp parallel for
+    for (i = 0; i < N_new; ++i) {
+        scale_beta(i) = 1.0 / (1.0 / scale_beta(i) + (1.0 - optcontrol.l1_ratio) * optcontrol.l1_alpha);
+    }
+
+    if (optcontrol.enet_solver == "FISTA") {
+
+        // Accelerated proximal gradient method
+        Eigen::MatrixXd Gram;
+        double lipschitz;
+        setup_proximal_gradient(A, mean, dev, Gram, lipschitz);
+
+        proximal_gradient(M, N_new, optcontrol.l1_alpha,
+                          0,
+                          x, A, b, mean, dev, grad0, Gram, lipschitz, grad, fnorm,
+                          verbosity);
+
+    } else if (optcontrol.enet_solver == "LARS") {
+
+        // Homotopy path from the largest alpha down to L1_ALPHA
+        Eigen::MatrixXd X_lars;
+        lars_path(A, mean, dev, grad0, std::vector<double>(1, optcontrol.l1_alpha), X_lars, verbosity);
+        x = X_lars.col(0);
+
+    } else {
+
+        GramCache gram(A, mean, dev, optcontrol.gram_cache_mb);
+
+        // Coordinate Descent Method
+        coordinate_descent(M, N_new, optcontrol.l1_alpha,
+                           0.0,
+                           0,
+                           x, A, b, mean, dev, grad0, gram, grad, fnorm,
+                           scale_beta,
+                           verbosity);
+
+        if (verbosity > 0) {
+            std::cout << "  Columns of A^T A computed : " << gram.get_number_of_computed_columns()
+                << " (cache size : " << gram.get_max_columns() << " columns)" << std::endl;
+        }
+    }
+
+    for (i = 0; i < N_new; ++i) {
+        param_out[i] = x[i] * factor_std[i];
+    }
+
+    if (verbosity > 0) {
+        // The intercept correction cancels the column means.
+        fdiff = A * x.cwiseQuotient(dev) - b;
+        const auto res1 = fdiff.dot(fdiff) / (fnorm * fnorm);
+        std::cout << "  RESIDUAL (%): " << std::sqrt(res1) * 100.0 << std::endl;
+    }
+
+    if (optcontrol.debiase_after_l1opt) {
+        auto info = run_least_squares_with_nonzero_coefs(A, b,
+                                                         mean, dev,
+                                                         factor_std,
+                                                         param_out,
+                                                         verbosity);
+    }
+
+    return 0;
+}
+
+int Optimize::run_least_squares_with_nonzero_coefs(const Eigen::Ref<const Eigen::MatrixXd> &A_in,
+                                                   const Eigen::VectorXd &b_in,
+                                                   const Eigen::VectorXd &mean,
+                                                   const Eigen::VectorXd &dev,
+                                                   const Eigen::VectorXd &factor_std,
+                                                   std::vector<double> &params_inout,
+                                                   const int verbosity) const
+{
+    // Perform OLS fitting to the features selected by LASSO for reducing the bias.
+
+    if (verbosity > 0) {
+        std::cout << " DEBIAS_OLS = 1: Attempt to reduce the bias of LASSO by performing OLS fitting" << std::endl;
+        std::cout << "                 with features selected by LASSO." << std::endl;
+    }
+
+    const auto N_new = A_in.cols();
+    const auto M = A_in.rows();
+
+    std::vector<int> nonzero_index, zero_index;
+
+    for (auto i = 0; i < N_new; ++i) {
+        if (std::abs(params_inout[i]) >= eps) {
+            nonzero_index.push_back(i);
+        } else {
+            zero_index.push_back(i);
+        }
+    }
+
+    const auto N_nonzero = nonzero_index.size();
+    Eigen::MatrixXd A_nonzero(M, N_nonzero);
+
+    // Only the selected columns are standardized.
+    for (auto i = 0; i < N_nonzero; ++i) {
+        const auto j = nonzero_index[i];
+        A_nonzero.col(i) = (A_in.col(j).array() - mean(j)) / dev(j);
+    }
+    Eigen::VectorXd x_nonzero = A_nonzero.colPivHouseholderQr().solve(b_in);
+
+    for (auto i = 0; i < N_new; ++i) params_inout[i] = 0.0;
+    for (auto i = 0; i < N_nonzero; ++i) {
+        params_inout[nonzero_index[i]] = x_nonzero[i] * factor_std[nonzero_index[i]];
+    }
+
+    return 0;
+}
+
+void Optimize::get_number_of_zero_coefs(const int maxorder,
+                                        const Constraint *constraint,
+                                        const Eigen::VectorXd &x,
+                                        std::vector<int> &nzeros) const
+{
+    // Count the number of zero parameters
+    size_t iparam = 0;
+    nzeros.resize(maxorder);
+    for (auto i = 0; i < maxorder; ++i) {
+        nzeros[i] = 0;
+        for (const auto &it : constraint->get_index_bimap(i)) {
+            const auto inew = it.left + iparam;
+            if (std::abs(x[inew]) < eps) ++nzeros[i];
+
+        }
+        iparam += constraint->get_index_bimap(i).size();
+    }
+}
+
+
+void Optimize::get_standardizer(const Eigen::Ref<const Eigen::MatrixXd> &Amat,
+                                Eigen::VectorXd &mean,
+                                Eigen::VectorXd &dev,
+                                Eigen::VectorXd &factor_std,
+                                Eigen::VectorXd &scale_beta) const
+{
+    const auto nrows = Amat.rows();
+    const auto ncols = Amat.cols();
+
+    if (mean.size() != ncols) mean.resize(ncols);
+    if (dev.size() != ncols) dev.resize(ncols);
+    if (factor_std.size() != ncols) factor_std.resize(ncols);
+    if (scale_beta.size() != ncols) scale_beta.resize(ncols);
+
+    const auto inv_nrows = 1.0 / static_cast<double>(nrows);
+    double sum1, sum2;
+
+    if (optcontrol.standardize) {
+        for (auto j = 0; j < ncols; ++j) {
+            sum1 = Amat.col(j).sum() * inv_nrows;
+            sum2 = Amat.col(j).dot(Amat.col(j)) * inv_nrows;
+            mean(j) = sum1;
+            dev(j) = std::sqrt(sum2 - sum1 * sum1);
+            factor_std(j) = 1.0 / dev(j);
+            scale_beta(j) = 1.0;
+        }
+    } else {
+        for (auto j = 0; j < ncols; ++j) {
+            sum2 = Amat.col(j).dot(Amat.col(j)) * inv_nrows;
+            mean(j) = 0.0;
+            dev(j) = 1.0;
+            factor_std(j) = 1.0;
+            scale_beta(j) = 1.0 / sum2;
+        }
+    }
+}
+
+double Optimize::get_esimated_max_alpha(const Eigen::Ref<const Eigen::MatrixXd> &Amat,
+                                        const Eigen::Ref<const Eigen::VectorXd> &bvec,
+                                        const Eigen::VectorXd &mean,
+                                        const Eigen::VectorXd &dev) const
+{
+    const auto ncols = Amat.cols();
+    const auto nrows = Amat.rows();
+
+    // Standardized A^T b without forming the standardized A
+    const Eigen::VectorXd C = (Amat.transpose() * bvec - bvec.sum() * mean).cwiseQuotient(dev);
+    auto lambda_max = 0.0;
+
+    for (auto i = 0; i < ncols; ++i) {
+        lambda_max = std::max<double>(lambda_max, std::abs(C(i)));
+    }
+    lambda_max /= static_cast<double>(nrows);
+
+    return lambda_max;
+}
+
+void ALM_NS::Optimize::apply_scaler_displacement(std::vector<std::vector<double>> &u_inout,
+                                                 const double normalization_factor,
+                                                 const bool scale_back) const
+{
+    const auto nrows = u_inout.size();
+    const auto ncols = u_inout[0].size();
+
+    if (scale_back) {
+        for (auto i = 0; i < nrows; ++i) {
+            for (auto j = 0; j < ncols; ++j) {
+                u_inout[i][j] *= normalization_factor;
+            }
+        }
+    } else {
+        const auto inv_scale_factor = 1.0 / normalization_factor;
+        for (auto i = 0; i < nrows; ++i) {
+            for (auto j = 0; j < ncols; ++j) {
+                u_inout[i][j] *= inv_scale_factor;
+            }
+        }
+    }
+}
+
+void Optimize::apply_scaler_constraint(const int maxorder,
+                                       const double normalization_factor,
+                                       Constraint *constraint,
+                                       const bool scale_back) const
+{
+    if (scale_back) {
+        for (auto i = 0; i < maxorder; ++i) {
+            const auto scale_factor = 1.0 / std::pow(normalization_factor, i + 1);
+            for (auto j = 0; j < constraint->get_const_fix(i).size(); ++j) {
+                const auto scaled_val = constraint->get_const_fix(i)[j].val_to_fix * scale_factor;
+                constraint->set_const_fix_val_to_fix(i, j, scaled_val);
+            }
+        }
+    } else {
+        for (auto i = 0; i < maxorder; ++i) {
+            const auto scale_factor = std::pow(normalization_factor, i + 1);
+            for (auto j = 0; j < constraint->get_const_fix(i).size(); ++j) {
+                const auto scaled_val = constraint->get_const_fix(i)[j].val_to_fix * scale_factor;
+                constraint->set_const_fix_val_to_fix(i, j, scaled_val);
+            }
+        }
+    }
+}
+
+void Optimize::apply_scaler_force_constants(const int maxorder,
+                                            const double normalization_factor,
+                                            const Constraint *constraint,
+                                            std::vector<double> &param_inout) const
+{
+    auto k = 0;
+    for (auto i = 0; i < maxorder; ++i) {
+        const auto scale_factor = 1.0 / std::pow(normalization_factor, i + 1);
+
+        for (auto j = 0; j < constraint->get_index_bimap(i).size(); ++j) {
+            param_inout[k] *= scale_factor;
+            ++k;
+        }
+    }
+}
+
+void Optimize::apply_scalers(const int maxorder,
+                             Constraint *constraint)
+{
+    apply_scaler_displacement(u_train,
+                              optcontrol.displacement_normalization_factor);
+    apply_scaler_constraint(maxorder,
+                            optcontrol.displacement_normalization_factor,
+                            constraint);
+
+    if (optcontrol.cross_validation == -1) {
+        apply_scaler_displacement(u_validation,
+                                  optcontrol.displacement_normalization_factor);
+
+    }
+}
+
+void ALM_NS::Optimize::finalize_scalers(const int maxorder,
+                                        Constraint *constraint)
+{
+    apply_scaler_displacement(u_train,
+                              optcontrol.displacement_normalization_factor,
+                              true);
+    apply_scaler_constraint(maxorder,
+                            optcontrol.displacement_normalization_factor,
+                            constraint,
+                            true);
+    if (optcontrol.cross_validation == -1) {
+        apply_scaler_displacement(u_validation,
+                                  optcontrol.displacement_normalization_factor,
+                                  true);
+    }
+}
+
+
+void Optimize::set_training_data(const std::vector<std::vector<double>> &u_train_in,
+                                 const std::vector<std::vector<double>> &f_train_in)
+{
+    u_train.clear();
+    f_train.clear();
+    u_train = u_train_in;
+    f_train = f_train_in;
+    u_train.shrink_to_fit();
+    f_train.shrink_to_fit();
+    incremental_factor.reset(0, 0);
+}
+
+void Optimize::append_training_data(const std::vector<std::vector<double>> &u_train_in,
+                                    const std::vector<std::vector<double>> &f_train_in)
+{
+    // The entries already absorbed in incremental_factor are kept as they are.
+    u_train.insert(u_train.end(), u_train_in.begin(), u_train_in.end());
+    f_train.insert(f_train.end(), f_train_in.begin(), f_train_in.end());
+}
+
+void Optimize::reset_incremental_factor()
+{
+    // Called when the constraints or the fixed force constants are changed,
+    // which the R factor of the absorbed entries depends on.
+    incremental_factor.reset(0, 0);
+}
+
+void Optimize::set_validation_data(const std::vector<std::vector<double>> &u_validation_in,
+                                   const std::vector<std::vector<double>> &f_validation_in)
+{
+    u_validation.clear();
+    f_validation.clear();
+    u_validation = u_validation_in;
+    f_validation = f_validation_in;
+    u_validation.shrink_to_fit();
+    f_validation.shrink_to_fit();
+}
+
+std::vector<std::vector<double>> Optimize::get_u_train() const
+{
+    return u_train;
+}
+
+std::vector<std::vector<double>> Optimize::get_f_train() const
+{
+    return f_train;
+}
+
+
+void Optimize::set_fcs_values(const int maxorder,
+                              double *fc_in,
+                              std::vector<size_t> *nequiv,
+                              const Constraint *constraint)
+{
+    // fc_in: irreducible set of force constants
+    // fc_length: dimension of params (can differ from that of fc_in)
+
+    size_t i;
+
+    size_t N = 0;
+    size_t Nirred = 0;
+    for (i = 0; i < maxorder; ++i) {
+        N += nequiv[i].size();
+        Nirred += constraint->get_index_bimap(i).size();
+    }
+
+    std::vector<double> param_in(Nirred, 0.0);
+    std::vector<double> param_out(N, 0.0);
+
+    for (i = 0; i < Nirred; ++i) {
+        param_in[i] = fc_in[i];
+    }
+    recover_original_forceconstants(maxorder,
+                                    param_in,
+                                    param_out,
+                                    nequiv,
+                                    constraint);
+    if (params) {
+        deallocate(params);
+    }
+    allocate(params, N);
+    for (i = 0; i < N; ++i) {
+        params[i] = param_out[i];
+    }
+}
+
+size_t Optimize::get_number_of_rows_sensing_matrix() const
+{
+    // u_train is empty when the training data is read chunk by chunk.
+    if (u_train.empty()) return 0;
+    return u_train.size() * u_train[0].size();
+}
+
+
+int Optimize::run_least_squares_crossvalidation(const std::string file_cvscore,
+                                                const size_t N,
+                                                const size_t M,
+                                                const double *amat,
+                                                const double *bvec,
+                                                const int verbosity) const
+{
+    // CV-fold cross-validation of the ordinary least squares without refitting.
+    // With the thin QR decomposition A = QR of all the training data,
+    // the residual of the validation block V predicted by the fit to the other blocks is
+    //   e_V = (I - Q_V Q_V^T)^{-1} r_V,
+    // where r = b - A x is the residual of the full fit and Q_V Q_V^T is the
+    // diagonal block of the hat matrix. The fitting error of the other blocks is
+    //   |r|^2 + |Q_V^T e_V|^2 - |e_V|^2.
+    // Thus, all the CV errors are obtained from a single QR decomposition.
+    // CV = NDATA corresponds to the leave-one-out CV of the entries.
+
+    const auto nstructures = static_cast<int>(u_train.size());
+    const auto nsets = optcontrol.cross_validation;
+
+    if (nsets < 2 || nsets > nstructures) {
+        warn("run_least_squares_crossvalidation",
+             "CV must be 2 <= CV <= NDATA. The cross-validation is skipped.");
+        return 1;
+    }
+    if (M < N) {
+        warn("run_least_squares_crossvalidation",
+             "The number of rows is smaller than that of parameters. The cross-validation is skipped.");
+        return 1;
+    }
+
+    std::vector<int> ndata_block(nsets, nstructures / nsets);
+    for (auto iset = 0; iset < nsets; ++iset) {
+        if (nstructures - nsets * (nstructures / nsets) > iset) {
+            ++ndata_block[iset];
+        }
+    }
+    std::vector<size_t> istart_block(nsets, 0);
+    for (auto iset = 1; iset < nsets; ++iset) {
+        istart_block[iset] = istart_block[iset - 1] + ndata_block[iset - 1];
+    }
+    const auto nrows_per_data = M / nstructures;
+
+    if (verbosity > 0) {
+        std::cout << "  " << nsets << "-fold CV of the least-squares fitting ... ";
+    }
+
+    // Explicit thin Q factor
+    int M_tmp = M;
+    int N_tmp = N;
+    int INFO;
+    int LWORK = -1;
+    double work_query;
+    std::vector<double> qmat(amat, amat + M * N);
+    std::vector<double> tau(N);
+
+    dgeqrf_(&M_tmp, &N_tmp, &qmat[0], &M_tmp, &tau[0], &work_query, &LWORK, &INFO);
+    auto LWORK_max = static_cast<int>(work_query);
+    dorgqr_(&M_tmp, &N_tmp, &N_tmp, &qmat[0], &M_tmp, &tau[0], &work_query, &LWORK, &INFO);
+    LWORK = std::max<int>(LWORK_max, static_cast<int>(work_query));
+    std::vector<double> work(std::max<int>(LWORK, 3 * N));
+    dgeqrf_(&M_tmp, &N_tmp, &qmat[0], &M_tmp, &tau[0], &work[0], &LWORK, &INFO);
+
+    char norm = '1';
+    char uplo = 'U';
+    char diag = 'N';
+    double rcond;
+    std::vector<int> iwork(N);
+    dtrcon_(&norm, &uplo, &diag, &N_tmp, &qmat[0], &M_tmp, &rcond, &work[0], &iwork[0], &INFO);
+
+    const auto tolerance = static_cast<double>(N) * std::numeric_limits<double>::epsilon();
+    if (rcond < tolerance) {
+        if (verbosity > 0) std::cout << std::endl;
+        warn("run_least_squares_crossvalidation",
+             "Matrix is rank-deficient. The cross-validation is skipped.");
+        return 1;
+    }
+
+    dorgqr_(&M_tmp, &N_tmp, &N_tmp, &qmat[0], &M_tmp, &tau[0], &work[0], &LWORK, &INFO);
+
+    Eigen::Map<const Eigen::MatrixXd> Q(&qmat[0], M, N);
+    Eigen::Map<const Eigen::VectorXd> b(bvec, M);
+    const Eigen::VectorXd qtb = Q.transpose() * b;
+    const Eigen::VectorXd r = b - Q * qtb;
+    const auto res2_all = r.squaredNorm();
+
+    auto fnorm2 = 0.0;
+    std::vector<double> fnorm2_data(nstructures, 0.0);
+    for (auto idata = 0; idata < nstructures; ++idata) {
+        for (const auto &it : f_train[idata]) fnorm2_data[idata] += it * it;
+        fnorm2 += fnorm2_data[idata];
+    }
+
+    const std::vector<double> alphas{0.0};
+    std::vector<std::vector<double>> training_error_accum(nsets, std::vector<double>(1));
+    std::vector<std::vector<double>> validation_error_accum(nsets, std::vector<double>(1));
+    std::vector<int> fold_valid(nsets, 0);
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 1)
+#endif
+    for (auto iset = 0; iset < nsets; ++iset) {
+
+        const auto irow = istart_block[iset] * nrows_per_data;
+        const auto nrows = ndata_block[iset] * nrows_per_data;
+
+        const auto Q_v = Q.middleRows(irow, nrows);
+        const auto r_v = r.segment(irow, nrows);
+        Eigen::VectorXd e_v;
+        bool success;
+
+        if (nrows <= N) {
+            Eigen::MatrixXd S = -Q_v * Q_v.transpose();
+            S.diagonal().array() += 1.0;
+            Eigen::LLT<Eigen::MatrixXd> llt(S);
+            e_v = llt.solve(r_v);
+            success = llt.info() == Eigen::Success;
+        } else {
+            // (I - Q_V Q_V^T)^{-1} = I + Q_V (I - Q_V^T Q_V)^{-1} Q_V^T
+            Eigen::MatrixXd T = -Q_v.transpose() * Q_v;
+            T.diagonal().array() += 1.0;
+            Eigen::LLT<Eigen::MatrixXd> llt(T);
+            e_v = r_v + Q_v * llt.solve(Q_v.transpose() * r_v);
+            success = llt.info() == Eigen::Success;
+        }
+
+        auto fnorm2_validation = 0.0;
+        for (auto idata = istart_block[iset]; idata < istart_block[iset] + ndata_block[iset]; ++idata) {
+            fnorm2_validation += fnorm2_data[idata];
+        }
+
+        if (success) {
+            const auto res2_validation = e_v.squaredNorm();
+            const auto res2_training = std::max(res2_all + (Q_v.transpose() * e_v).squaredNorm()
+                                                - res2_validation, 0.0);
+            validation_error_accum[iset][0] = std::sqrt(res2_validation / fnorm2_validation);
+            training_error_accum[iset][0] = std::sqrt(res2_training / (fnorm2 - fnorm2_validation));
+            fold_valid[iset] = 1;
+        }
+    }
+
+    if (verbosity > 0) std::cout << "done." << std::endl << std::endl;
+
+    // The SETs whose training data do not determine the parameters are
+    // excluded from the CV score.
+    std::vector<std::vector<double>> training_error_valid, validation_error_valid;
+    for (auto iset = 0; iset < nsets; ++iset) {
+        if (fold_valid[iset]) {
+            training_error_valid.push_back(training_error_accum[iset]);
+            validation_error_valid.push_back(validation_error_accum[iset]);
+        } else {
+            const auto message = "The training data without SET " + std::to_string(iset + 1)
+                + " are rank-deficient. The SET is excluded from the CV score.";
+            warn("run_least_squares_crossvalidation", message.c_str());
+        }
+    }
+    if (training_error_valid.empty()) {
+        warn("run_least_squares_crossvalidation",
+             "All the SETs are rank-deficient. The cross-validation is skipped.");
+        return 1;
+    }
+
+    write_cvscore_to_file(file_cvscore,
+                          alphas,
+                          training_error_valid,
+                          validation_error_valid);
+
+    if (verbosity > 0) {
+        std::cout << "  SET, Fitting error (%), Validation error (%)" << std::endl;
+        for (auto iset = 0; iset < nsets; ++iset) {
+            if (!fold_valid[iset]) continue;
+            std::cout << "  " << std::setw(5) << iset + 1
+                << std::setw(15) << training_error_accum[iset][0] * 100.0
+                << std::setw(15) << validation_error_accum[iset][0] * 100.0 << std::endl;
+        }
+        std::cout << "  The CV score is saved in " << file_cvscore << std::endl << std::endl;
+    }
+
+    return 0;
+}
+
+int Optimize::fit_without_constraints(const size_t N,
+                                      const size_t M,
+                                      double *amat,
+                                      const double *bvec,
+                                      double *param_out,
+                                      const int verbosity) const
+{
+    int i;
+    int nrank, INFO;
+    auto f_square = 0.0;
+    std::vector<double> f_residual;
+    double *fsum2;
+
+    const auto LMAX = std::max<int>(M, N);
+
+    if (verbosity > 0) {
+        std::cout << "  Entering fitting routine: "
+            << optcontrol.densesolver << " without constraints" << std::endl;
+    }
+
+    allocate(fsum2, LMAX);
+
+    for (i = 0; i < M; ++i) {
+        fsum2[i] = bvec[i];
+        f_square += std::pow(bvec[i], 2);
+    }
+    for (i = M; i < LMAX; ++i) fsum2[i] = 0.0;
+
+    INFO = solve_dense_least_squares(N, M, 1, amat, fsum2,
+                                     nrank, f_residual, verbosity);
+
+    if (nrank < N)
+        warn("fit_without_constraints",
+             "Matrix is rank-deficient. Force constants could not be determined uniquely :(");
+
+    if (nrank == N && verbosity > 0) {
+        std::cout << std::endl << "  Residual sum of squares for the solution: "
+            << sqrt(f_residual[0]) << std::endl;
+        std::cout << "  Fitting error (%) : "
+            << sqrt(f_residual[0] / f_square) * 100.0 << std::endl;
+    }
+
+    for (i = 0; i < N; ++i) {
+        param_out[i] = fsum2[i];
+    }
+
+    deallocate(fsum2);
+
+    return INFO;
+}
+
+int Optimize::fit_with_constraints(const size_t N,
+                                   const size_t M,
+                                   const size_t P,
+                                   double *amat,
+                                   const double *bvec,
+                                   double *param_out,
+                                   const double * const *cmat,
+                                   double *dvec,
+                                   const int verbosity) const
+{
+    size_t i, j;
+    int N_tmp, M_tmp, P_tmp;
+    double *fsum2;
+    double *mat_tmp;
+
+    if (verbosity > 0) {
+        std::cout << "  Entering fitting routine: QRD with constraints" << std::endl;
+    }
+
+    allocate(fsum2, M);
+    allocate(mat_tmp, (M + P) * N);
+
+    size_t k = 0;
+    size_t l = 0;
+
+    // Concatenate two matrices as 1D array
+    for (j = 0; j < N; ++j) {
+        for (i = 0; i < M; ++i) {
+            mat_tmp[k++] = amat[l++];
+        }
+        for (i = 0; i < P; ++i) {
+            mat_tmp[k++] = cmat[i][j];
+        }
+    }
+
+    const auto nrank = rankQRD((M + P), N, mat_tmp, eps12);
+    deallocate(mat_tmp);
+
+    if (nrank != N) {
+        std::cout << std::endl;
+        std::cout << " **************************************************************************" << std::endl;
+        std::cout << "  WARNING : rank deficient.                                                " << std::endl;
+        std::cout << "  rank ( (A) ) ! = N            A: Fitting matrix     B: Constraint matrix " << std::endl;
+        std::cout << "       ( (B) )                  N: The number of parameters                " << std::endl;
+        std::cout << "  rank = " << nrank << " N = " << N << std::endl << std::endl;
+        std::cout << "  This can cause a difficulty in solving the fitting problem properly      " << std::endl;
+        std::cout << "  with DGGLSE, especially when the difference is large. Please check if    " << std::endl;
+        std::cout << "  you obtain reliable force constants in the .fcs file.                    " << std::endl << std::
+            endl;
+        std::cout << "  You may need to reduce the cutoff radii and/or increase NDATA            " << std::endl;
+        std::cout << "  by giving linearly-independent displacement patterns.                    " << std::endl;
+        std::cout << " **************************************************************************" << std::endl;
+        std::cout << std::endl;
+    }
+
+    auto f_square = 0.0;
+    for (i = 0; i < M; ++i) {
+        fsum2[i] = bvec[i];
+        f_square += std::pow(bvec[i], 2);
+    }
+    if (verbosity > 0) std::cout << "  QR-Decomposition has started ...";
+
+    double *cmat_mod;
+    allocate(cmat_mod, P * N);
+
+    k = 0;
+    for (j = 0; j < N; ++j) {
+        for (i = 0; i < P; ++i) {
+            cmat_mod[k++] = cmat[i][j];
+        }
+    }
+
+    // Fitting
+
+    auto LWORK = static_cast<int>(P) + std::min<int>(M, N) + 10 * std::max<int>(M, N);
+    int INFO;
+    double *WORK, *x;
+    allocate(WORK, LWORK);
+    allocate(x, N);
+
+    // M_tmp, N_tmp, P_tmp are prepared to cast N, M, P to (non-const)
+    // int.
+    M_tmp = M;
+    N_tmp = N;
+    P_tmp = P;
+    dgglse_(&M_tmp, &N_tmp, &P_tmp, amat, &M_tmp, cmat_mod, &P_tmp,
+            fsum2, dvec, x, WORK, &LWORK, &INFO);
+
+    if (verbosity > 0) std::cout << " finished. " << std::endl;
+
+    auto f_residual = 0.0;
+    for (i = N - P; i < M; ++i) {
+        f_residual += std::pow(fsum2[i], 2);
+    }
+
+    if (verbosity > 0) {
+        std::cout << std::endl << "  Residual sum of squares for the solution: "
+            << sqrt(f_residual) << std::endl;
+        std::cout << "  Fitting error (%) : "
+            << std::sqrt(f_residual / f_square) * 100.0 << std::endl;
+    }
+
+    // copy fcs to bvec
+    for (i = 0; i < N; ++i) {
+        param_out[i] = x[i];
+    }
+
+    deallocate(cmat_mod);
+    deallocate(WORK);
+    deallocate(x);
+    deallocate(fsum2);
+
+    return INFO;
+}
+
+int Optimize::fit_null_space(const size_t N,
+                             const size_t M,
+                             const size_t nrhs,
+                             const double *amat,
+                             const double *bvec,
+                             const size_t ldb,
+                             double *param_out,
+                             const int maxorder,
+                             const Fcs *fcs,
+                             const Constraint *constraint,
+                             const int verbosity) const
+{
+    // Least-squares fitting with the numerical constraints (CONST_SOLVER = NullSpace).
+    // With x = x0 + Z y, min |A x - b| subject to C x = d is reduced to
+    // the unconstrained problem min |(A Z) y - (b - A x0)|, which is solved by DENSESOLVER.
+    // bvec holds nrhs right-hand sides with the leading dimension ldb.
+    // param_out (N x nrhs) holds the full set of parameters on output.
+
+    size_t i, j, k;
+    const auto &zmat = constraint->get_null_space();
+    const auto nfree = zmat.get_nfree();
+
+    if (zmat.nparams != N) {
+        exit("fit_null_space",
+             "The null space of the constraints is not ready.");
+    }
+
+    if (verbosity > 0) {
+        std::cout << "  Entering fitting routine: " << optcontrol.densesolver
+            << " in the null space of the constraints" << std::endl;
+        std::cout << "  Number of free parameters : " << nfree << std::endl;
+    }
+
+    // Force constants fixed by FC2XML or FC3XML
+
+    std::vector<double> x0(N, 0.0);
+
+    if (constraint->get_fix_harmonic()) {
+        for (const auto &p : constraint->get_const_fix(0)) {
+            x0[p.p_index_target] = p.val_to_fix;
+        }
+    }
+    if (constraint->get_fix_cubic() && maxorder > 1) {
+        const auto ishift = fcs->get_nequiv()[0].size();
+        for (const auto &p : constraint->get_const_fix(1)) {
+            x0[p.p_index_target + ishift] = p.val_to_fix;
+        }
+    }
+
+    std::vector<double> amat_z(M * nfree, 0.0);
+
+#pragma omp parallel for private(i, j)
+    for (long icol = 0; icol < static_cast<long>(nfree); ++icol) {
+        auto *col = &amat_z[M * icol];
+        for (j = zmat.col_ptr[icol]; j < zmat.col_ptr[icol + 1]; ++j) {
+            const auto *acol = amat + M * zmat.row_index[j];
+            const auto val = zmat.values[j];
+            for (i = 0; i < M; ++i) col[i] += val * acol[i];
+        }
+    }
+
+    std::vector<double> ax0(M, 0.0);
+    for (j = 0; j < N; ++j) {
+        if (x0[j] == 0.0) continue;
+        for (i = 0; i < M; ++i) ax0[i] += amat[M * j + i] * x0[j];
+    }
+
+    const auto LMAX = std::max<size_t>(M, nfree);
+    std::vector<double> fsum2(LMAX * nrhs, 0.0);
+    std::vector<double> f_square(nrhs, 0.0);
+
+    for (k = 0; k < nrhs; ++k) {
+        for (i = 0; i < M; ++i) {
+            fsum2[LMAX * k + i] = bvec[ldb * k + i] - ax0[i];
+            f_square[k] += bvec[ldb * k + i] * bvec[ldb * k + i];
+        }
+    }
+
+    auto INFO = 0;
+    int nrank = nfree;
+    std::vector<double> f_residual(nrhs, 0.0);
+
+    if (nfree > 0) {
+        INFO = solve_dense_least_squares(nfree, M, nrhs, &amat_z[0], &fsum2[0],
+                                         nrank, f_residual, verbosity);
+    } else {
+        for (k = 0; k < nrhs; ++k) {
+            for (i = 0; i < M; ++i) f_residual[k] += std::pow(fsum2[LMAX * k + i], 2);
+        }
+    }
+    amat_z.clear();
+    amat_z.shrink_to_fit();
+
+    if (static_cast<size_t>(nrank) < nfree)
+        warn("fit_null_space",
+             "Matrix is rank-deficient. Force constants could not be determined uniquely :(");
+
+    if (static_cast<size_t>(nrank) == nfree && verbosity > 0) {
+        std::cout << std::endl;
+        if (nrhs == 1) {
+            std::cout << "  Residual sum of squares for the solution: "
+                << std::sqrt(f_residual[0]) << std::endl;
+            std::cout << "  Fitting error (%) : "
+                << std::sqrt(f_residual[0] / f_square[0]) * 100.0 << std::endl;
+        } else {
+            for (k = 0; k < nrhs; ++k) {
+                std::cout << "  Force set " << std::setw(4) << k + 1
+                    << " : residual sum of squares = " << std::sqrt(f_residual[k])
+                    << ", fitting error (%) = "
+                    << std::sqrt(f_residual[k] / f_square[k]) * 100.0 << std::endl;
+            }
+        }
+    }
+
+    for (k = 0; k < nrhs; ++k) {
+        auto *x = param_out + N * k;
+        for (j = 0; j < N; ++j) x[j] = x0[j];
+        for (size_t icol = 0; icol < nfree; ++icol) {
+            const auto y = fsum2[LMAX * k + icol];
+            for (j = zmat.col_ptr[icol]; j < zmat.col_ptr[icol + 1]; ++j) {
+                x[zmat.row_index[j]] += zmat.values[j] * y;
+            }
+        }
+    }
+
+    return INFO;
+}
+
+int Optimize::fit_algebraic_constraints(const size_t N,
+                                        const size_t M,
+                                        double *amat,
+                                        const double *bvec,
+                                        std::vector<double> &param_out,
+                                        const double fnorm,
+                                        const int maxorder,
+                                        const Fcs *fcs,
+                                        const Constraint *constraint,
+                                        const int verbosity) const
+{
+    int i;
+    int nrank, INFO;
+    std::vector<double> f_residual;
+    double *fsum2;
+
+    if (verbosity > 0) {
+        std::cout << "  Entering fitting routine: " << optcontrol.densesolver
+            << " with constraints considered algebraically." << std::endl;
+    }
+
+    auto LMIN = std::min<int>(M, N);
+    auto LMAX = std::max<int>(M, N);
+
+    allocate(fsum2, LMAX);
+
+    for (i = 0; i < M; ++i) {
+        fsum2[i] = bvec[i];
+    }
+    for (i = M; i < LMAX; ++i) fsum2[i] = 0.0;
+
+    INFO = solve_dense_least_squares(N, M, 1, amat, fsum2,
+                                     nrank, f_residual, verbosity);
+
+    if (nrank < N) {
+        warn("fit_without_constraints",
+             "Matrix is rank-deficient. Force constants could not be determined uniquely :(");
+    }
+
+    if (nrank == N && verbosity > 0) {
+        std::cout << std::endl;
+        std::cout << "  Residual sum of squares for the solution: "
+            << sqrt(f_residual[0]) << std::endl;
+        std::cout << "  Fitting error (%) : "
+            << sqrt(f_residual[0] / (fnorm * fnorm)) * 100.0 << std::endl;
+    }
+
+    if (INFO == 0) {
+        std::vector<double> param_irred(N, 0.0);
+        for (i = 0; i < LMIN; ++i) param_irred[i] = fsum2[i];
+
+        // Recover reducible set of force constants
+
+        recover_original_forceconstants(maxorder,
+                                        param_irred,
+                                        param_out,
+                                        fcs->get_nequiv(),
+                                        constraint);
+    }
+    deallocate(fsum2);
+
+    return INFO;
+}
+
+
+int Optimize::solve_dense_least_squares(const size_t N,
+                                        const size_t M,
+                                        const size_t nrhs,
+                                        double *amat,
+                                        double *fsum2,
+                                        int &nrank,
+                                        std::vector<double> &f_residual,
+                                        const int verbosity) const
+{
+    // Solve min |A x - b| for the column-major M x N matrix amat.
+    // fsum2 holds nrhs right-hand sides with the leading dimension max(M, N).
+    // On input, fsum2[0:M] of each column holds b. On output, fsum2[0:N]
+    // holds x and f_residual[k] is the residual sum of squares |A x - b|^2.
+    // A is factorized once for all right-hand sides.
+    // The QR and Cholesky modes fall back to SVD when A is rank-deficient
+    // or too ill-conditioned for them, so that the minimum-norm solution
+    // is always returned as in the SVD mode.
+
+    size_t i, k;
+    int nrhs_tmp = nrhs;
+    int INFO;
+    int M_tmp = M;
+    int N_tmp = N;
+    auto LMAX = std::max<int>(M, N);
+    auto rcond = -1.0;
+
+    f_residual.assign(nrhs, 0.0);
+
+    if (optcontrol.densesolver == "Cholesky" && M >= N) {
+
+        if (verbosity > 0) std::cout << "  Forming the normal equation ... ";
+
+        // A^T A (upper triangle) and A^T B by BLAS level 3
+        char uplo = 'U';
+        char trans = 'T';
+        char notrans = 'N';
+        double one = 1.0;
+        double zero = 0.0;
+        std::vector<double> AtA(N * N, 0.0);
+        std::vector<double> Atb(N * nrhs, 0.0);
+
+        dsyrk_(&uplo, &trans, &N_tmp, &M_tmp, &one, amat, &M_tmp,
+               &zero, &AtA[0], &N_tmp);
+        dgemm_(&trans, &notrans, &N_tmp, &nrhs_tmp, &M_tmp, &one, amat, &M_tmp,
+               fsum2, &LMAX, &zero, &Atb[0], &N_tmp);
+
+        if (verbosity > 0) {
+            std::cout << "done." << std::endl;
+            std::cout << "  Cholesky decomposition has started ... ";
+        }
+
+        if (solve_cholesky(N, AtA, Atb, rcond, nrhs)) {
+
+            // Residual B - A X. amat is not modified above.
+            double minus_one = -1.0;
+            dgemm_(&notrans, &notrans, &M_tmp, &nrhs_tmp, &N_tmp, &minus_one, amat, &M_tmp,
+                   &Atb[0], &N_tmp, &one, fsum2, &LMAX);
+            for (k = 0; k < nrhs; ++k) {
+                for (i = 0; i < M; ++i) f_residual[k] += fsum2[LMAX * k + i] * fsum2[LMAX * k + i];
+                for (i = 0; i < N; ++i) fsum2[LMAX * k + i] = Atb[N * k + i];
+            }
+            nrank = N;
+
+            if (verbosity > 0) {
+                std::cout << "finished !" << std::endl << std::endl;
+                std::cout << "  RANK of the matrix = " << nrank << std::endl;
+            }
+            return 0;
+        }
+
+        if (verbosity > 0) {
+            std::cout << "failed !" << std::endl;
+            std::cout << "  A^T A is singular or ill-conditioned (RCOND = "
+                << rcond << "). Switch to SVD." << std::endl;
+        }
+
+    } else if (optcontrol.densesolver == "SketchLSQR" && M > 4 * N) {
+
+        // LSQR preconditioned by the R factor of a sketch S A of 4N rows
+        // as in Blendenpik. All right-hand sides share the preconditioner.
+
+        if (verbosity > 0) std::cout << "  Sketching and QR decomposition ... ";
+
+        const Eigen::Map<const Eigen::MatrixXd> A(amat, M, N);
+        Eigen::MatrixXd rfac;
+
+        get_sketch(A, rfac);
+
+        if (get_sketch_preconditioner(rfac, rcond)) {
+
+            const auto R = rfac.triangularView<Eigen::Upper>();
+            const auto Rt = rfac.transpose().triangularView<Eigen::Lower>();
+            auto converged = true;
+            int niter;
+            auto niter_max = 0;
+            Eigen::VectorXd y, x;
+
+            if (verbosity > 0) {
+                std::cout << "done." << std::endl;
+                std::cout << "  LSQR iteration has started ... ";
+            }
+
+            for (k = 0; k < nrhs; ++k) {
+                Eigen::Map<Eigen::VectorXd> b(fsum2 + LMAX * k, M);
+
+                converged = run_lsqr([&A, &R](const Eigen::VectorXd &v, Eigen::VectorXd &u) {
+                                         u.noalias() = A * R.solve(v);
+                                     },
+                                     [&A, &Rt](const Eigen::VectorXd &u, Eigen::VectorXd &v) {
+                                         v = Rt.solve(Eigen::VectorXd(A.transpose() * u));
+                                     },
+                                     N, b, y, niter) && converged;
+                niter_max = std::max<int>(niter_max, niter);
+
+                x = R.solve(y);
+                f_residual[k] = (b - A * x).squaredNorm();
+                b.head(N) = x;
+            }
+
+            // Numerical rank estimated from the diagonal of the sketch R
+            const Eigen::VectorXd rdiag = rfac.diagonal().cwiseAbs();
+            const auto tolerance = static_cast<double>(N) * std::numeric_limits<double>::epsilon()
+                * rdiag.maxCoeff();
+            nrank = 0;
+            for (i = 0; i < N; ++i) {
+                if (rdiag(i) > tolerance) ++nrank;
+            }
+
+            if (verbosity > 0) {
+                std::cout << "finished !" << std::endl << std::endl;
+                std::cout << "  Number of iterations : " << niter_max << std::endl;
+                std::cout << "  RANK of the matrix = " << nrank << std::endl;
+            }
+            if (!converged) {
+                warn("solve_dense_least_squares",
+                     "LSQR did not converge within MAXITER iterations.");
+            }
+            return 0;
+        }
+
+        if (verbosity > 0) {
+            std::cout << "failed !" << std::endl;
+            std::cout << "  The sketch of A is singular or ill-conditioned (RCOND = "
+                << rcond << "). Switch to SVD." << std::endl;
+        }
+
+    } else if ((optcontrol.densesolver == "QR" || optcontrol.densesolver == "TSQR"
+        || optcontrol.densesolver == "SketchLSQR") && M >= N) {
+
+        // A = QR by Householder transformations, which is what dgels does.
+        // The condition number of R is checked before the back substitution.
+        // With TSQR, the row blocks of A are factorized in parallel and
+        // the R factors are reduced in a binary tree.
+        // SketchLSQR comes here when A has at most 4N rows.
+
+        int ldr = M_tmp;
+
+        if (verbosity > 0) {
+            std::cout << "  " << (optcontrol.densesolver == "TSQR" ? "TSQR" : "QR")
+                << " decomposition has started ... ";
+        }
+
+        if (optcontrol.densesolver == "TSQR") {
+            factorize_tsqr(N, M, nrhs, amat, fsum2, f_residual);
+            ldr = N_tmp;
+        } else {
+            factorize_qr(M, N, amat, M, fsum2, M, nrhs);
+            for (k = 0; k < nrhs; ++k) {
+                for (i = N; i < M; ++i) f_residual[k] += fsum2[M * k + i] * fsum2[M * k + i];
+            }
+        }
+
+        return solve_triangular_factor(N, amat, ldr, fsum2, M_tmp, nrhs, nrank, verbosity);
+    }
+
+    // Fitting with singular value decomposition
+
+    const auto LMIN = std::min<int>(M_tmp, N_tmp);
+    const auto LMAX_work = std::max<int>(M_tmp, N_tmp);
+    int LWORK = 3 * LMIN + std::max<int>(std::max<int>(2 * LMIN, LMAX_work), nrhs_tmp);
+    LWORK = 2 * LWORK;
+
+    double *WORK, *S;
+    allocate(WORK, LWORK);
+    allocate(S, LMIN);
+
+    if (verbosity > 0) std::cout << "  SVD has started ... ";
+
+    rcond = -1.0;
+    dgelss_(&M_tmp, &N_tmp, &nrhs_tmp, amat, &M_tmp, fsum2, &LMAX,
+            S, &rcond, &nrank, WORK, &LWORK, &INFO);
+
+    deallocate(WORK);
+    deallocate(S);
+
+    if (verbosity > 0) {
+        std::cout << "finished !" << std::endl << std::endl;
+        std::cout << "  RANK of the matrix = " << nrank << std::endl;
+    }
+
+    if (static_cast<size_t>(nrank) == N) {
+        for (k = 0; k < nrhs; ++k) {
+            for (i = N; i < M; ++i) f_residual[k] += fsum2[LMAX * k + i] * fsum2[LMAX * k + i];
+        }
+    }
+
+    return INFO;
+}
+
+
+int Optimize::solve_triangular_factor(const size_t N,
+                                      const double *rmat,
+                                      const int ldr,
+                                      double *rhs,
+                                      const int ldrhs,
+                                      const size_t nrhs,
+                                      int &nrank,
+                                      const int verbosity) const
+{
+    // Solve R x = c for the upper-triangular R of a QR decomposition.
+    // rhs holds nrhs columns of c on input and x on output. When R is singular or
+    // ill-conditioned, the minimum-norm solution is obtained by SVD of R,
+    // which is the same as that of the original least-squares problem because
+    // |A x - b|^2 = |R x - (Q^T b)[0:N]|^2 + |(Q^T b)[N:M]|^2.
+    // rmat is not modified.
+
+    size_t i, j;
+    int N_tmp = N;
+    int ldr_tmp = ldr;
+    int ldrhs_tmp = ldrhs;
+    int nrhs_tmp = nrhs;
+    int INFO;
+    char uplo = 'U';
+    char notrans = 'N';
+    char diag = 'N';
+    char norm = '1';
+    auto rcond = 0.0;
+    const auto tolerance = static_cast<double>(N) * std::numeric_limits<double>::epsilon();
+
+    std::vector<double> work(3 * N);
+    std::vector<int> iwork(N);
+
+    dtrcon_(&norm, &uplo, &diag, &N_tmp, const_cast<double *>(rmat), &ldr_tmp, &rcond,
+            &work[0], &iwork[0], &INFO);
+
+    if (rcond > tolerance) {
+        dtrtrs_(&uplo, &notrans, &diag, &N_tmp, &nrhs_tmp, const_cast<double *>(rmat), &ldr_tmp,
+                rhs, &ldrhs_tmp, &INFO);
+        nrank = N;
+
+        if (verbosity > 0) {
+            std::cout << "finished !" << std::endl << std::endl;
+            std::cout << "  RANK of the matrix = " << nrank << std::endl;
+        }
+        return INFO;
+    }
+
+    if (verbosity > 0) {
+        std::cout << "failed !" << std::endl;
+        std::cout << "  R is singular or ill-conditioned (RCOND = "
+            << rcond << "). Switch to SVD." << std::endl;
+        std::cout << "  SVD has started ... ";
+    }
+
+    std::vector<double> rmat_full(N * N, 0.0);
+    for (j = 0; j < N; ++j) {
+        for (i = 0; i <= j; ++i) {
+            rmat_full[N * j + i] = rmat[ldr * j + i];
+        }
+    }
+
+    int LWORK = 10 * N + nrhs;
+    std::vector<double> S(N);
+    work.resize(LWORK);
+    rcond = -1.0;
+
+    dgelss_(&N_tmp, &N_tmp, &nrhs_tmp, &rmat_full[0], &N_tmp, rhs, &ldrhs_tmp,
+            &S[0], &rcond, &nrank, &work[0], &LWORK, &INFO);
+
+    if (verbosity > 0) {
+        std::cout << "finished !" << std::endl << std::endl;
+        std::cout << "  RANK of the matrix = " << nrank << std::endl;
+    }
+
+    return INFO;
+}
+
+
+void Optimize::factorize_qr(const size_t M,
+                            const size_t N,
+                            double *amat,
+                            const size_t lda,
+                            double *bvec,
+                            const size_t ldb,
+                            const size_t nrhs) const
+{
+    // Householder QR of the M x N matrix amat (M >= N) in place.
+    // On return, the upper triangle of amat[0:N, 0:N] is R and each of
+    // the nrhs columns of bvec is overwritten by Q^T b, whose last M - N
+    // elements are the residual.
+
+    char side = 'L';
+    char trans = 'T';
+    int M_tmp = M;
+    int N_tmp = N;
+    int lda_tmp = lda;
+    int ldb_tmp = ldb;
+    int nrhs_tmp = nrhs;
+    int INFO;
+    int LWORK = -1;
+    double work_query;
+    std::vector<double> tau(N);
+
+    dgeqrf_(&M_tmp, &N_tmp, amat, &lda_tmp, &tau[0], &work_query, &LWORK, &INFO);
+    auto LWORK_max = static_cast<int>(work_query);
+    dormqr_(&side, &trans, &M_tmp, &nrhs_tmp, &N_tmp, amat, &lda_tmp, &tau[0],
+            bvec, &ldb_tmp, &work_query, &LWORK, &INFO);
+    LWORK = std::max<int>(LWORK_max, static_cast<int>(work_query));
+    std::vector<double> work(LWORK);
+
+    dgeqrf_(&M_tmp, &N_tmp, amat, &lda_tmp, &tau[0], &work[0], &LWORK, &INFO);
+    dormqr_(&side, &trans, &M_tmp, &nrhs_tmp, &N_tmp, amat, &lda_tmp, &tau[0],
+            bvec, &ldb_tmp, &work[0], &LWORK, &INFO);
+}
+
+
+void Optimize::factorize_tsqr(const size_t N,
+                              const size_t M,
+                              const size_t nrhs,
+                              double *amat,
+                              double *fsum2,
+                              std::vector<double> &f_residual) const
+{
+    // Tall-skinny QR of the column-major M x N matrix amat.
+    // Each row block is factorized in place by a thread, and pairs of
+    // the N x N R factors are stacked and factorized again until one is left.
+    // fsum2 holds nrhs right-hand sides with the leading dimension M.
+    // On return, amat[0:N*N] holds R with the leading dimension N,
+    // fsum2[0:N] of each column holds the first N elements of Q^T b, and
+    // f_residual[k] is the sum of squares of the rest.
+
+    size_t i, j, k;
+    long ib;
+
+    // The block indices are signed for the OpenMP loops.
+#ifdef _OPENMP
+    const long nthreads = omp_get_max_threads();
+#else
+    const long nthreads = 1;
+#endif
+    const auto nblocks = std::max<long>(1, std::min<long>(nthreads, static_cast<long>(M / (2 * N))));
+
+    std::vector<std::vector<double>> rfac(nblocks, std::vector<double>(N * N, 0.0));
+    std::vector<std::vector<double>> cvec(nblocks, std::vector<double>(N * nrhs));
+    std::vector<std::vector<double>> residual(nblocks, std::vector<double>(nrhs, 0.0));
+
+#ifdef _OPENMP
+#pragma omp parallel for private(i, j, k) schedule(static)
+#endif
+    for (ib = 0; ib < nblocks; ++ib) {
+        const auto row_begin = M * ib / nblocks;
+        const auto row_end = M * (ib + 1) / nblocks;
+
+        factorize_qr(row_end - row_begin, N, amat + row_begin, M,
+                     fsum2 + row_begin, M, nrhs);
+
+        for (j = 0; j < N; ++j) {
+            for (i = 0; i <= j; ++i) {
+                rfac[ib][N * j + i] = amat[M * j + row_begin + i];
+            }
+        }
+        for (k = 0; k < nrhs; ++k) {
+            const auto *bcol = fsum2 + M * k;
+            std::copy(bcol + row_begin, bcol + row_begin + N, cvec[ib].begin() + N * k);
+            for (i = row_begin + N; i < row_end; ++i) {
+                residual[ib][k] += bcol[i] * bcol[i];
+            }
+        }
+    }
+
+    for (long stride = 1; stride < nblocks; stride *= 2) {
+
+#ifdef _OPENMP
+#pragma omp parallel for private(i, j, k) schedule(static)
+#endif
+        for (ib = 0; ib < nblocks; ib += 2 * stride) {
+            const auto jb = ib + stride;
+            if (jb >= nblocks) continue;
+
+            // [R_ib; R_jb] = Q R
+            std::vector<double> rstack(2 * N * N, 0.0);
+            std::vector<double> cstack(2 * N * nrhs);
+            for (j = 0; j < N; ++j) {
+                for (i = 0; i <= j; ++i) {
+                    rstack[2 * N * j + i] = rfac[ib][N * j + i];
+                    rstack[2 * N * j + N + i] = rfac[jb][N * j + i];
+                }
+            }
+            for (k = 0; k < nrhs; ++k) {
+                std::copy(cvec[ib].begin() + N * k, cvec[ib].begin() + N * (k + 1),
+                          cstack.begin() + 2 * N * k);
+                std::copy(cvec[jb].begin() + N * k, cvec[jb].begin() + N * (k + 1),
+                          cstack.begin() + 2 * N * k + N);
+            }
+
+            factorize_qr(2 * N, N, &rstack[0], 2 * N, &cstack[0], 2 * N, nrhs);
+
+            for (j = 0; j < N; ++j) {
+                for (i = 0; i <= j; ++i) {
+                    rfac[ib][N * j + i] = rstack[2 * N * j + i];
+                }
+            }
+            for (k = 0; k < nrhs; ++k) {
+                std::copy(cstack.begin() + 2 * N * k, cstack.begin() + 2 * N * k + N,
+                          cvec[ib].begin() + N * k);
+                residual[ib][k] += residual[jb][k];
+                for (i = N; i < 2 * N; ++i) {
+                    residual[ib][k] += cstack[2 * N * k + i] * cstack[2 * N * k + i];
+                }
+            }
+        }
+    }
+
+    std::copy(rfac[0].begin(), rfac[0].end(), amat);
+    for (k = 0; k < nrhs; ++k) {
+        std::copy(cvec[0].begin() + N * k, cvec[0].begin() + N * (k + 1), fsum2 + M * k);
+    }
+    f_residual = residual[0];
+}
+
+
+bool Optimize::solve_cholesky(const size_t N,
+                              std::vector<double> &mat,
+                              std::vector<double> &rhs,
+                              double &rcond,
+                              const size_t nrhs) const
+{
+    // Solve mat * x = rhs for a symmetric positive definite mat whose upper
+    // triangle is given. rhs holds nrhs columns of length N. mat is
+    // overwritten by the Cholesky factor and rhs by the solutions. Returns false without solving when mat is singular
+    // or its reciprocal condition number is below N * epsilon.
+
+    int N_tmp = N;
+    int nrhs_tmp = nrhs;
+    int INFO;
+    char uplo = 'U';
+    char norm = '1';
+    const auto tolerance = static_cast<double>(N) * std::numeric_limits<double>::epsilon();
+
+    std::vector<double> work(3 * N);
+    std::vector<int> iwork(N);
+
+    auto anorm = dlansy_(&norm, &uplo, &N_tmp, &mat[0], &N_tmp, &work[0]);
+    dpotrf_(&uplo, &N_tmp, &mat[0], &N_tmp, &INFO);
+
+    rcond = 0.0;
+    if (INFO == 0) {
+        dpocon_(&uplo, &N_tmp, &mat[0], &N_tmp, &anorm, &rcond,
+                &work[0], &iwork[0], &INFO);
+    }
+
+    if (INFO != 0 || rcond <= tolerance) return false;
+
+    dpotrs_(&uplo, &N_tmp, &nrhs_tmp, &mat[0], &N_tmp, &rhs[0], &N_tmp, &INFO);
+
+    return INFO == 0;
+}
+
+
+int Optimize::solve_normal_equation(const size_t N,
+                                    const std::vector<double> &AtA,
+                                    const std::vector<double> &Atb,
+                                    std::vector<double> &param_out,
+                                    int &nrank,
+                                    const int verbosity) const
+{
+    // Solve (A^T A) x = A^T b with the Cholesky decomposition.
+    // Only the upper triangle of AtA is referenced.
+    // When A^T A is singular or too ill-conditioned, the minimum-norm solution
+    // is obtained with SVD instead.
+
+    size_t i, j;
+    int N_tmp = N;
+    int nrhs = 1;
+    int INFO;
+    double rcond;
+    const auto tolerance = static_cast<double>(N) * std::numeric_limits<double>::epsilon();
+
+    std::vector<double> mat(AtA);
+
+    param_out = Atb;
+
+    if (verbosity > 0) std::cout << "  Cholesky decomposition has started ... ";
+
+    if (solve_cholesky(N, mat, param_out, rcond, 1)) {
+        nrank = N;
+
+        if (verbosity > 0) {
+            std::cout << "finished !" << std::endl << std::endl;
+            std::cout << "  RANK of the matrix = " << nrank << std::endl;
+        }
+        return 0;
+    }
+
+    if (verbosity > 0) {
+        std::cout << "failed !" << std::endl;
+        std::cout << "  A^T A is singular or ill-conditioned (RCOND = " << rcond << ")." << std::endl;
+        std::cout << "  SVD has started ... ";
+    }
+
+    // dgelss requires the full matrix
+    for (j = 0; j < N; ++j) {
+        for (i = 0; i <= j; ++i) {
+            mat[N * j + i] = AtA[N * j + i];
+            mat[N * i + j] = AtA[N * j + i];
+        }
+    }
+    param_out = Atb;
+
+    int LWORK = 10 * N;
+    std::vector<double> S(N);
+    std::vector<double> work(LWORK);
+    rcond = tolerance;
+
+    dgelss_(&N_tmp, &N_tmp, &nrhs, &mat[0], &N_tmp, &param_out[0], &N_tmp,
+            &S[0], &rcond, &nrank, &work[0], &LWORK, &INFO);
+
+    if (verbosity > 0) {
+        std::cout << "finished !" << std::endl << std::endl;
+        std::cout << "  RANK of the matrix = " << nrank << std::endl;
+    }
+
+    return INFO;
+}
+
+
+void Optimize::get_matrix_elements(const int maxorder,
+                                   std::vector<double> &amat,
+                                   std::vector<double> &bvec,
+                                   const std::vector<std::vector<double>> &u_in,
+                                   const std::vector<std::vector<double>> &f_in,
+                                   const Symmetry *symmetry,
+                                   const Fcs *fcs) const
+{
+    size_t i, j;
+    long ipanel;
+    const auto natmin = symmetry->get_nat_prim();
+    const auto natmin3 = 3 * natmin;
+
+    if (u_in.size() != f_in.size()) {
+        exit("get_matrix_elements",
+             "The lengths of displacement array and force array are diferent.");
+    }
+
+    const auto ndata_fit = u_in.size();
+    const auto ntran = symmetry->get_ntran();
+    const auto ncycle = ndata_fit * ntran;
+    const auto nrows = ndata_fit * u_in[0].size();
+    size_t ncols = 0;
+    for (i = 0; i < maxorder; ++i) {
+        ncols += fcs->get_nequiv()[i].size();
+    }
+
+    if (amat.size() != nrows * ncols) {
+        amat.resize(nrows * ncols, 0.0);
+    }
+    if (bvec.size() != nrows) {
+        bvec.resize(nrows, 0.0);
+    }
+
+    SensingMatrixPlan plan_tmp;
+    const auto &plan = get_sensing_matrix_plan(maxorder, symmetry, fcs, plan_tmp);
+
+    // Each thread assembles a panel of consecutive row blocks in a column-major tile
+    // and copies every column of the tile into amat as a contiguous segment.
+    const auto nblock_panel = get_number_of_blocks_per_panel(ncycle, natmin3, ncols);
+    const long npanel = (ncycle + nblock_panel - 1) / nblock_panel;
+
+#ifdef _OPENMP
+#pragma omp parallel private(ipanel, i, j)
+#endif
+    {
+        int iat;
+        size_t im, irow;
+        double *amat_tile;
+
+        std::vector<int> disp_nonzero;
+
+        allocate(amat_tile, natmin3 * nblock_panel * ncols);
+
+#ifdef _OPENMP
+#pragma omp for schedule(guided)
+#endif
+        for (ipanel = 0; ipanel < npanel; ++ipanel) {
+
+            const size_t irow_s = ipanel * nblock_panel;
+            const auto irow_e = std::min<size_t>(irow_s + nblock_panel, ncycle);
+            const auto ld_tile = natmin3 * (irow_e - irow_s);
+
+            std::fill(amat_tile, amat_tile + ld_tile * ncols, 0.0);
+
+            for (irow = irow_s; irow < irow_e; ++irow) {
+
+                // The irow-th structure is the (irow % ntran)-th translation of the
+                // (irow / ntran)-th entry. The translation is applied through index_tran.
+                const auto &u_now = u_in[irow / ntran];
+                const auto &f_now = f_in[irow / ntran];
+                const auto *index_tran = plan.index_tran[irow % ntran].data();
+
+                // generate r.h.s vector B
+                for (i = 0; i < natmin; ++i) {
+                    iat = symmetry->get_map_p2s()[i][0];
+                    for (j = 0; j < 3; ++j) {
+                        im = 3 * i + j + natmin3 * irow;
+                        bvec[im] = f_now[index_tran[3 * iat + j]];
+                    }
+                }
+
+                // generate l.h.s. matrix A
+
+                // The nonzero displacements of this (structure, translation) pair
+                // are listed once and shared by all orders.
+                const auto use_index = get_nonzero_displacements(plan, u_now, index_tran,
+                                                                 disp_nonzero);
+                accumulate_sensing_matrix_rows(plan, u_now, index_tran,
+                                               disp_nonzero, use_index,
+                                               amat_tile + natmin3 * (irow - irow_s), ld_tile);
+            }
+
+            for (j = 0; j < ncols; ++j) {
+                std::copy(amat_tile + ld_tile * j, amat_tile + ld_tile * (j + 1),
+                          &amat[nrows * j + natmin3 * irow_s]);
+            }
+        }
+
+        deallocate(amat_tile);
+    }
+}
+
+
+void Optimize::get_force_vector(const int maxorder,
+                                const std::vector<std::vector<double>> &f_in,
+                                std::vector<double> &fvec,
+                                const Symmetry *symmetry,
+                                const Fcs *fcs) const
+{
+    // Forces in the row order of the sensing matrix, i.e., the r.h.s. vector
+    // of get_matrix_elements without the fixed force constants.
+
+    size_t i, j, irow;
+    const auto natmin = symmetry->get_nat_prim();
+    const auto natmin3 = 3 * natmin;
+    const auto ntran = symmetry->get_ntran();
+    const auto ncycle = f_in.size() * ntran;
+
+    SensingMatrixPlan plan_tmp;
+    const auto &plan = get_sensing_matrix_plan(maxorder, symmetry, fcs, plan_tmp);
+
+    fvec.resize(natmin3 * ncycle);
+
+    for (irow = 0; irow < ncycle; ++irow) {
+        const auto &f_now = f_in[irow / ntran];
+        const auto *index_tran = plan.index_tran[irow % ntran].data();
+
+        for (i = 0; i < natmin; ++i) {
+            const auto iat = symmetry->get_map_p2s()[i][0];
+            for (j = 0; j < 3; ++j) {
+                fvec[natmin3 * irow + 3 * i + j] = f_now[index_tran[3 * iat + j]];
+            }
+        }
+    }
+}
+
+
+void Optimize::get_matrix_elements_algebraic_constraint(const int maxorder,
+                                                        std::vector<double> &amat,
+                                                        std::vector<double> &bvec,
+                                                        const std::vector<std::vector<double>> &u_in,
+                                                        const std::vector<std::vector<double>> &f_in,
+                                                        double &fnorm,
+                                                        const Symmetry *symmetry,
+                                                        const Fcs *fcs,
+                                                        const Constraint *constraint) const
+{
+    size_t i, j;
+    long ipanel;
+
+    if (u_in.size() != f_in.size()) {
+        exit("get_matrix_elements",
+             "The lengths of displacement array and force array are diferent.");
+    }
+
+    const auto ndata_fit = u_in.size();
+    const auto natmin = symmetry->get_nat_prim();
+    const auto natmin3 = 3 * natmin;
+    const auto nrows = u_in.size() * u_in[0].size();
+    size_t ncols = 0;
+    size_t ncols_new = 0;
+
+    for (i = 0; i < maxorder; ++i) {
+        ncols += fcs->get_nequiv()[i].size();
+        ncols_new += constraint->get_index_bimap(i).size();
+    }
+
+    const auto ntran = symmetry->get_ntran();
+    const auto ncycle = ndata_fit * ntran;
+
+    if (amat.size() != nrows * ncols_new) {
+        amat.resize(nrows * ncols_new, 0.0);
+    }
+    if (bvec.size() != nrows) {
+        bvec.resize(nrows, 0.0);
+    }
+
+    std::vector<double> bvec_orig(nrows, 0.0);
+
+    SensingMatrixPlan plan_tmp;
+    const auto &plan = get_sensing_matrix_plan(maxorder, symmetry, fcs, plan_tmp);
+
+    ConstraintTransform transform;
+    build_constraint_transform(maxorder, fcs, constraint, transform);
+
+    // Each thread assembles a panel of consecutive row blocks in a column-major tile
+    // and copies every column of the tile into amat as a contiguous segment.
+    const auto nblock_panel = get_number_of_blocks_per_panel(ncycle, natmin3, ncols_new);
+    const long npanel = (ncycle + nblock_panel - 1) / nblock_panel;
+
+#ifdef _OPENMP
+#pragma omp parallel private(ipanel, i, j)
+#endif
+    {
+        int iat;
+        size_t im, irow;
+        double *amat_tile;
+
+        std::vector<int> disp_nonzero;
+
+        allocate(amat_tile, natmin3 * nblock_panel * ncols_new);
+
+#ifdef _OPENMP
+#pragma omp for schedule(guided)
+#endif
+        for (ipanel = 0; ipanel < npanel; ++ipanel) {
+
+            const size_t irow_s = ipanel * nblock_panel;
+            const auto irow_e = std::min<size_t>(irow_s + nblock_panel, ncycle);
+            const auto ld_tile = natmin3 * (irow_e - irow_s);
+
+            std::fill(amat_tile, amat_tile + ld_tile * ncols_new, 0.0);
+
+            for (irow = irow_s; irow < irow_e; ++irow) {
+
+                // The irow-th structure is the (irow % ntran)-th translation of the
+                // (irow / ntran)-th entry. The translation is applied through index_tran.
+                const auto &u_now = u_in[irow / ntran];
+                const auto &f_now = f_in[irow / ntran];
+                const auto *index_tran = plan.index_tran[irow % ntran].data();
+
+                // generate r.h.s vector B
+                for (i = 0; i < natmin; ++i) {
+                    iat = symmetry->get_map_p2s()[i][0];
+                    for (j = 0; j < 3; ++j) {
+                        im = 3 * i + j + natmin3 * irow;
+                        bvec[im] = f_now[index_tran[3 * iat + j]];
+                        bvec_orig[im] = f_now[index_tran[3 * iat + j]];
+                    }
+                }
+
+                // generate l.h.s. matrix A for the free parameters
+
+                const auto use_index = get_nonzero_displacements(plan, u_now, index_tran,
+                                                                 disp_nonzero);
+                accumulate_reduced_sensing_matrix_rows(plan, transform, u_now, index_tran,
+                                                       disp_nonzero, use_index,
+                                                       amat_tile + natmin3 * (irow - irow_s),
+                                                       ld_tile,
+                                                       &bvec[natmin3 * irow]);
+            }
+
+            for (j = 0; j < ncols_new; ++j) {
+                std::copy(amat_tile + ld_tile * j, amat_tile + ld_tile * (j + 1),
+                          &amat[nrows * j + natmin3 * irow_s]);
+            }
+        }
+
+        deallocate(amat_tile);
+    }
+
+    fnorm = 0.0;
+    for (i = 0; i < bvec_orig.size(); ++i) {
+        fnorm += bvec_orig[i] * bvec_orig[i];
+    }
+    fnorm = std::sqrt(fnorm);
+}
+
+#ifdef WITH_SPARSE_SOLVER
+void Optimize::get_matrix_elements_in_sparse_form(const int maxorder,
+                                                  SpMat &sp_amat,
+                                                  Eigen::VectorXd &sp_bvec,
+                                                  const std::vector<std::vector<double>> &u_in,
+                                                  const std::vector<std::vector<double>> &f_in,
+                                                  double &fnorm,
+                                                  const Symmetry *symmetry,
+                                                  const Fcs *fcs,
+                                                  const Constraint *constraint) const
+{
+    size_t i, j;
+    long irow;
+
+    if (u_in.size() != f_in.size()) {
+        exit("get_matrix_elements",
+             "The lengths of displacement array and force array are diferent.");
+    }
+
+    const auto ndata_fit = u_in.size();
+    const auto natmin = symmetry->get_nat_prim();
+    const auto natmin3 = 3 * natmin;
+    const auto nrows = u_in.size() * u_in[0].size();
+
+    size_t ncols = 0;
+    size_t ncols_new = 0;
+
+    for (i = 0; i < maxorder; ++i) {
+        ncols += fcs->get_nequiv()[i].size();
+        ncols_new += constraint->get_index_bimap(i).size();
+    }
+
+    const auto ntran = symmetry->get_ntran();
+    const auto ncycle = ndata_fit * ntran;
+
+    std::vector<double> bvec_orig(nrows, 0.0);
+
+    SensingMatrixPlan plan_tmp;
+    const auto &plan = get_sensing_matrix_plan(maxorder, symmetry, fcs, plan_tmp);
+
+    ConstraintTransform transform;
+    build_constraint_transform(maxorder, fcs, constraint, transform);
+
+    // Elements of a row block that can be nonzero (ncols_new * row + column).
+    // They are common to all row blocks, and only these are visited and reset to zero.
+    // The row-major order makes the row indices ascending within each column.
+    std::vector<size_t> index_nonzero;
+    for (auto order = 0; order < maxorder; ++order) {
+        for (i = 0; i < plan.row[order].size(); ++i) {
+            const auto iold = plan.col[order][i];
+            for (j = transform.row_ptr[iold]; j < transform.row_ptr[iold + 1]; ++j) {
+                index_nonzero.push_back(ncols_new * plan.row[order][i] + transform.col_index[j]);
+            }
+        }
+    }
+    std::sort(index_nonzero.begin(), index_nonzero.end());
+    index_nonzero.erase(std::unique(index_nonzero.begin(), index_nonzero.end()),
+                        index_nonzero.end());
+
+    // Each thread assembles a contiguous range of row blocks and keeps the nonzero
+    // elements in the row-major order. The number of nonzero elements is counted
+    // for each column and thread, from which the position of every element in
+    // the CSC arrays of sp_amat is known. The elements are then copied in parallel.
+
+#ifdef _OPENMP
+    const auto nthreads_max = omp_get_max_threads();
+#else
+    const auto nthreads_max = 1;
+#endif
+    std::vector<std::vector<SpMat::StorageIndex>> nnz_thread(nthreads_max);
+    sp_amat.resize(nrows, ncols_new);
+
+#ifdef _OPENMP
+#pragma omp parallel private(irow, i, j)
+#endif
+    {
+        int iat;
+        size_t im;
+        size_t idata;
+        double *amat_mod_tmp;
+
+#ifdef _OPENMP
+        const auto ithread = omp_get_thread_num();
+        const auto nthreads = omp_get_num_threads();
+#else
+        const auto ithread = 0;
+        const auto nthreads = 1;
+#endif
+        const long irow_s = ncycle * ithread / nthreads;
+        const long irow_e = ncycle * (ithread + 1) / nthreads;
+
+        std::vector<SpMat::StorageIndex> row_omp, col_omp;
+        std::vector<double> val_omp;
+        std::vector<int> disp_nonzero;
+        auto &nnz_col = nnz_thread[ithread];
+        nnz_col.assign(ncols_new, 0);
+
+        allocate(amat_mod_tmp, natmin3 * ncols_new);
+        std::fill(amat_mod_tmp, amat_mod_tmp + natmin3 * ncols_new, 0.0);
+
+        for (irow = irow_s; irow < irow_e; ++irow) {
+
+            // The irow-th structure is the (irow % ntran)-th translation of the
+            // (irow / ntran)-th entry. The translation is applied through index_tran.
+            const auto &u_now = u_in[irow / ntran];
+            const auto &f_now = f_in[irow / ntran];
+            const auto *index_tran = plan.index_tran[irow % ntran].data();
+
+            // generate r.h.s vector B
+            for (i = 0; i < natmin; ++i) {
+                iat = symmetry->get_map_p2s()[i][0];
+                for (j = 0; j < 3; ++j) {
+                    im = 3 * i + j + natmin3 * irow;
+                    sp_bvec(im) = f_now[index_tran[3 * iat + j]];
+                    bvec_orig[im] = f_now[index_tran[3 * iat + j]];
+                }
+            }
+
+            // generate l.h.s. matrix A for the free parameters
+
+            idata = natmin3 * irow;
+
+            const auto use_index = get_nonzero_displacements(plan, u_now, index_tran,
+                                                             disp_nonzero);
+            accumulate_reduced_sensing_matrix_rows(plan, transform, u_now, index_tran,
+                                                   disp_nonzero, use_index,
+                                                   amat_mod_tmp, natmin3,
+                                                   sp_bvec.data() + idata);
+
+            for (const auto &it : index_nonzero) {
+                const auto icol = it % ncols_new;
+                auto &val = amat_mod_tmp[natmin3 * icol + it / ncols_new];
+                if (std::abs(val) > eps) {
+                    row_omp.push_back(idata + it / ncols_new);
+                    col_omp.push_back(icol);
+                    val_omp.push_back(val);
+                    ++nnz_col[icol];
+                }
+                val = 0.0;
+            }
+        }
+
+        deallocate(amat_mod_tmp);
+
+#ifdef _OPENMP
+#pragma omp barrier
+#pragma omp single
+#endif
+        {
+            // Column pointers of sp_amat and the first position of each thread in each column
+            SpMat::StorageIndex offset = 0;
+            for (j = 0; j < ncols_new; ++j) {
+                sp_amat.outerIndexPtr()[j] = offset;
+                for (auto ith = 0; ith < nthreads; ++ith) {
+                    const auto n = nnz_thread[ith][j];
+                    nnz_thread[ith][j] = offset;
+                    offset += n;
+                }
+            }
+            sp_amat.outerIndexPtr()[ncols_new] = offset;
+            sp_amat.resizeNonZeros(offset);
+        }
+
+        auto *inner = sp_amat.innerIndexPtr();
+        auto *values = sp_amat.valuePtr();
+
+        for (i = 0; i < row_omp.size(); ++i) {
+            const auto pos = nnz_col[col_omp[i]]++;
+            inner[pos] = row_omp[i];
+            values[pos] = val_omp[i];
+        }
+    }
+
+    fnorm = 0.0;
+    for (i = 0; i < bvec_orig.size(); ++i) {
+        fnorm += bvec_orig[i] * bvec_orig[i];
+    }
+    fnorm = std::sqrt(fnorm);
+}
+#endif
+
 
-    A = Eigen::Map<Eigen::MatrixXd>(&amat_1D[0], M, N_new);
-    b = Eigen::Map<Eigen::VectorXd>(&bvec[0], M);
+void Optimize::recover_original_forceconstants(const int maxorder,
+                                               const std::vector<double> &param_in,
+                                               std::vector<double> &param_out,
+                                               const std::vector<size_t> *nequiv,
+                                               const Constraint *constraint) const
+{
+    // Expand the given force constants into the larger sets
+    // by using the constraint matrix.
 
-    Prod.setZero(N_new, N_new);
-    grad0.resize(N_new);
-    grad.resize(N_new);
-    x.setZero(N_new);
-    scale_beta.resize(N_new);
-    factor_std.resize(N_new);
-    fdiff.resize(M);
+    size_t i, j, k;
+    size_t ishift = 0;
+    size_t iparam = 0;
+    double tmp;
+    size_t inew, iold;
 
-    allocate(has_prod, N_new);
+    size_t nparams = 0;
 
-    for (i = 0; i < N_new; ++i) {
-        has_prod[i] = false;
-    }
+    for (i = 0; i < maxorder; ++i) nparams += nequiv[i].size();
 
-    if (verbosity > 0) {
-        std::cout << "  Elastic-net minimization with the following parameters:" << std::endl;
-        std::cout << "   L1_RATIO = " << optcontrol.l1_ratio << std::endl;
-        std::cout << "   L1_ALPHA = " << std::setw(15) << optcontrol.l1_alpha << std::endl;
-        std::cout << "   CONV_TOL = " << std::setw(15) << optcontrol.tolerance_iteration << std::endl;
-        std::cout << "   MAXITER = " << std::setw(5) << optcontrol.maxnum_iteration << std::endl;
-        std::cout << "   ENET_DNORM = " << std::setw(15) << optcontrol.displacement_normalization_factor << std::endl;
+    param_out.resize(nparams, 0.0);
 
-        std::cout << std::endl;
-        if (optcontrol.standardize) {
-            std::cout << " STANDARDIZE = 1 : Standardization will be performed for matrix A and vector b." << std::endl;
-            std::cout << "                   The ENET_DNORM-tag will be neglected." << std::endl;
-        } else {
-            std::cout << " STANDARDIZE = 0 : No standardization of matrix A and vector b." << std::endl;
-            std::cout << "                   Columns of matrix A will be scaled by the ENET_DNORM value." << std::endl;
+    for (i = 0; i < maxorder; ++i) {
+        for (j = 0; j < constraint->get_const_fix(i).size(); ++j) {
+            param_out[constraint->get_const_fix(i)[j].p_index_target + ishift]
+                = constraint->get_const_fix(i)[j].val_to_fix;
         }
-    }
 
-    // Standardize if necessary
+        for (const auto &it : constraint->get_index_bimap(i)) {
+            inew = it.left + iparam;
+            iold = it.right + ishift;
 
-    if (optcontrol.standardize) {
-        get_standardizer(A, mean, dev, factor_std, scale_beta);
-        apply_standardizer(A, mean, dev);
-    } else {
-        get_standardizer(A, mean, dev, factor_std, scale_beta);
-    }
+            param_out[iold] = param_in[inew];
+        }
 
-    grad0 = A.transpose() * b;
-    grad = grad0;
+        for (j = 0; j < constraint->get_const_relate(i).size(); ++j) {
+            tmp = 0.0;
 
-#pragma omp parallel for
-    for (i = 0; i < N_new; ++i) {
-        scale_beta(i) = 1.0 / (1.0 / scale_beta(i) + (1.0 - optcontrol.l1_ratio) * optcontrol.l1_alpha);
+            for (k = 0; k < constraint->get_const_relate(i)[j].alpha.size(); ++k) {
+                tmp += constraint->get_const_relate(i)[j].alpha[k]
+                    * param_out[constraint->get_const_relate(i)[j].p_index_orig[k] + ishift];
+            }
+            param_out[constraint->get_const_relate(i)[j].p_index_target + ishift] = -tmp;
+        }
+
+        ishift += nequiv[i].size();
+        iparam += constraint->get_index_bimap(i).size();
     }
+}
 
-    // Coordinate Descent Method
-    coordinate_descent(M, N_new, optcontrol.l1_alpha,
-                       0,
-                       x, A, b, grad0, has_prod, Prod, grad, fnorm,
-                       scale_beta,
-                       verbosity);
 
-    for (i = 0; i < N_new; ++i) {
-        param_out[i] = x[i] * factor_std[i];
-    }
+int Optimize::inprim_index(const int n,
+                           const Symmetry *symmetry) const
+{
+    auto in = -1;
+    const auto atmn = n / 3;
+    const auto crdn = n % 3;
 
-    if (verbosity > 0) {
-        double correction_intercept = 0.0;
-        for (size_t i = 0; i < N_new; ++i) {
-            correction_intercept += x(i) * mean(i) * factor_std(i);
+    for (size_t i = 0; i < symmetry->get_nat_prim(); ++i) {
+        if (symmetry->get_map_p2s()[i][0] == atmn) {
+            in = 3 * i + crdn;
+            break;
         }
-        fdiff = A * x - b + correction_intercept * Eigen::VectorXd::Ones(M);
-        const auto res1 = fdiff.dot(fdiff) / (fnorm * fnorm);
-        std::cout << "  RESIDUAL (%): " << std::sqrt(res1) * 100.0 << std::endl;
     }
+    return in;
+}
 
-    deallocate(has_prod);
+void Optimize::update_sensing_matrix_plan(const int maxorder,
+                                          const Symmetry *symmetry,
+                                          const Fcs *fcs)
+{
+    // Compile the sensing matrix plan only when the force constant table or
+    // the symmetry has been regenerated.
 
-    if (optcontrol.debiase_after_l1opt) {
-        auto info = run_least_squares_with_nonzero_coefs(A, b,
-                                                         factor_std,
-                                                         param_out,
-                                                         verbosity);
+    if (!matrix_plan.is_built_for(maxorder, symmetry, fcs)) {
+        build_sensing_matrix_plan(maxorder, symmetry, fcs, matrix_plan);
     }
-
-    return 0;
 }
 
-int Optimize::run_least_squares_with_nonzero_coefs(const Eigen::MatrixXd &A_in,
-                                                   const Eigen::VectorXd &b_in,
-                                                   const Eigen::VectorXd &factor_std,
-                                                   std::vector<double> &params_inout,
-                                                   const int verbosity) const
+const SensingMatrixPlan& Optimize::get_sensing_matrix_plan(const int maxorder,
+                                                           const Symmetry *symmetry,
+                                                           const Fcs *fcs,
+                                                           SensingMatrixPlan &plan_tmp) const
 {
-    // Perform OLS fitting to the features selected by LASSO for reducing the bias.
+    // Return the stored plan if it is built for the given fcs and symmetry.
+    // Otherwise, compile a temporary one so that the caller is still served correctly.
 
-    if (verbosity > 0) {
-        std::cout << " DEBIAS_OLS = 1: Attempt to reduce the bias of LASSO by performing OLS fitting" << std::endl;
-        std::cout << "                 with features selected by LASSO." << std::endl;
-    }
+    if (matrix_plan.is_built_for(maxorder, symmetry, fcs)) return matrix_plan;
 
-    const auto N_new = A_in.cols();
-    const auto M = A_in.rows();
+    build_sensing_matrix_plan(maxorder, symmetry, fcs, plan_tmp);
+    return plan_tmp;
+}
 
-    std::vector<int> nonzero_index, zero_index;
+void Optimize::build_sensing_matrix_plan(const int maxorder,
+                                         const Symmetry *symmetry,
+                                         const Fcs *fcs,
+                                         SensingMatrixPlan &plan_out) const
+{
+    // Precompute the row index, column index, prefactor (gamma * sign), and
+    // the displacement indices of every term in fc_table.
+    // These quantities do not depend on the displacement data and are
+    // therefore computed only once and reused for all rows of the sensing matrix.
 
-    for (auto i = 0; i < N_new; ++i) {
-        if (std::abs(params_inout[i]) >= eps) {
-            nonzero_index.push_back(i);
-        } else {
-            zero_index.push_back(i);
+    const auto natmin = symmetry->get_nat_prim();
+    const auto nat = natmin * symmetry->get_ntran();
+
+    std::vector<int> index_in_prim(3 * nat, -1);
+    for (size_t i = 0; i < natmin; ++i) {
+        const auto iat = symmetry->get_map_p2s()[i][0];
+        for (auto j = 0; j < 3; ++j) {
+            index_in_prim[3 * iat + j] = 3 * i + j;
         }
     }
 
-    const auto N_nonzero = nonzero_index.size();
-    Eigen::MatrixXd A_nonzero(M, N_nonzero);
-
-    for (auto i = 0; i < N_nonzero; ++i) {
-        A_nonzero.col(i) = A_in.col(nonzero_index[i]);
+    // index_tran[itran][3 * n_mapped + k] = 3 * j + k, where n_mapped is the atom
+    // to which atom j is moved by the itran-th pure translation.
+    const auto ntran = symmetry->get_ntran();
+    plan_out.index_tran.assign(ntran, std::vector<int>(3 * nat));
+    for (size_t itran = 0; itran < ntran; ++itran) {
+        for (size_t j = 0; j < nat; ++j) {
+            const auto n_mapped = symmetry->get_map_sym()[j][symmetry->get_symnum_tran()[itran]];
+            for (auto k = 0; k < 3; ++k) {
+                plan_out.index_tran[itran][3 * n_mapped + k] = 3 * j + k;
+            }
+        }
     }
-    Eigen::VectorXd x_nonzero = A_nonzero.colPivHouseholderQr().solve(b_in);
 
-    for (auto i = 0; i < N_new; ++i) params_inout[i] = 0.0;
-    for (auto i = 0; i < N_nonzero; ++i) {
-        params_inout[nonzero_index[i]] = x_nonzero[i] * factor_std[nonzero_index[i]];
-    }
+    plan_out.maxorder = maxorder;
+    plan_out.fcs_generation = fcs->get_generation();
+    plan_out.symmetry_generation = symmetry->get_generation();
+    plan_out.row.resize(maxorder);
+    plan_out.col.resize(maxorder);
+    plan_out.coef.resize(maxorder);
+    plan_out.disp.resize(maxorder);
+    plan_out.term_ptr.resize(maxorder);
+    plan_out.term_index.resize(maxorder);
+
+    std::vector<int> ind(maxorder + 1);
+    size_t iparam = 0;
 
-    return 0;
-}
+    for (auto order = 0; order < maxorder; ++order) {
 
-void Optimize::get_number_of_zero_coefs(const int maxorder,
-                                        const Constraint *constraint,
-                                        const Eigen::VectorXd &x,
-                                        std::vector<int> &nzeros) const
-{
-    // Count the number of zero parameters
-    size_t iparam = 0;
-    nzeros.resize(maxorder);
-    for (auto i = 0; i < maxorder; ++i) {
-        nzeros[i] = 0;
-        for (const auto &it : constraint->get_index_bimap(i)) {
-            const auto inew = it.left + iparam;
-            if (std::abs(x[inew]) < eps) ++nzeros[i];
+        const auto nterms = fcs->get_fc_table()[order].size();
 
-        }
-        iparam += constraint->get_index_bimap(i).size();
-    }
-}
+        plan_out.row[order].resize(nterms);
+        plan_out.col[order].resize(nterms);
+        plan_out.coef[order].resize(nterms);
+        plan_out.disp[order].resize((order + 1) * nterms);
 
+        size_t mm = 0;
 
-void Optimize::get_standardizer(const Eigen::MatrixXd &Amat,
-                                Eigen::VectorXd &mean,
-                                Eigen::VectorXd &dev,
-                                Eigen::VectorXd &factor_std,
-                                Eigen::VectorXd &scale_beta) const
-{
-    const auto nrows = Amat.rows();
-    const auto ncols = Amat.cols();
+        for (const auto &iter : fcs->get_nequiv()[order]) {
+            for (size_t i = 0; i < iter; ++i) {
+                const auto &fc = fcs->get_fc_table()[order][mm];
 
-    if (mean.size() != ncols) mean.resize(ncols);
-    if (dev.size() != ncols) dev.resize(ncols);
-    if (factor_std.size() != ncols) factor_std.resize(ncols);
-    if (scale_beta.size() != ncols) scale_beta.resize(ncols);
+                for (auto j = 0; j < order + 2; ++j) ind[j] = fc.elems[j];
+                for (auto j = 1; j < order + 2; ++j) {
+                    plan_out.disp[order][(order + 1) * mm + j - 1] = fc.elems[j];
+                }
+                plan_out.row[order][mm] = index_in_prim[fc.elems[0]];
+                plan_out.col[order][mm] = iparam;
+                plan_out.coef[order][mm] = -(gamma(order + 2, &ind[0]) * fc.sign);
+                ++mm;
+            }
+            ++iparam;
+        }
 
-    const auto inv_nrows = 1.0 / static_cast<double>(nrows);
-    double sum1, sum2;
+        // Inverted index by the first displacement of each term
 
-    if (optcontrol.standardize) {
-        for (auto j = 0; j < ncols; ++j) {
-            sum1 = Amat.col(j).sum() * inv_nrows;
-            sum2 = Amat.col(j).dot(Amat.col(j)) * inv_nrows;
-            mean(j) = sum1;
-            dev(j) = std::sqrt(sum2 - sum1 * sum1);
-            factor_std(j) = 1.0 / dev(j);
-            scale_beta(j) = 1.0;
+        auto &term_ptr = plan_out.term_ptr[order];
+        auto &term_index = plan_out.term_index[order];
+        term_ptr.assign(3 * nat + 1, 0);
+        term_index.resize(nterms);
+
+        for (size_t iterm = 0; iterm < nterms; ++iterm) {
+            ++term_ptr[plan_out.disp[order][(order + 1) * iterm] + 1];
         }
-    } else {
-        for (auto j = 0; j < ncols; ++j) {
-            sum2 = Amat.col(j).dot(Amat.col(j)) * inv_nrows;
-            mean(j) = 0.0;
-            dev(j) = 1.0;
-            factor_std(j) = 1.0;
-            scale_beta(j) = 1.0 / sum2;
+        for (size_t idisp = 0; idisp < 3 * nat; ++idisp) {
+            term_ptr[idisp + 1] += term_ptr[idisp];
+        }
+        std::vector<size_t> pos(term_ptr.begin(), term_ptr.end() - 1);
+        for (size_t iterm = 0; iterm < nterms; ++iterm) {
+            term_index[pos[plan_out.disp[order][(order + 1) * iterm]]++] = iterm;
         }
     }
+    plan_out.ncols = iparam;
 }
 
-void Optimize::apply_standardizer(Eigen::MatrixXd &Amat,
-                                  const Eigen::VectorXd &mean,
-                                  const Eigen::VectorXd &dev) const
+bool Optimize::get_nonzero_displacements(const SensingMatrixPlan &plan,
+                                         const std::vector<double> &u_in,
+                                         const int *index_tran,
+                                         std::vector<int> &disp_nonzero) const
 {
-    const auto ncols = Amat.cols();
-    const auto nrows = Amat.rows();
-    if (mean.size() != ncols || dev.size() != ncols) {
-        exit("apply_standardizer", "The number of colums is inconsistent.");
-    }
-
-    for (auto i = 0; i < nrows; ++i) {
-        for (auto j = 0; j < ncols; ++j) {
-            Amat(i, j) = (Amat(i, j) - mean(j)) / dev(j);
+    // List the nonzero displacements of the translated structure.
+    // Returns true when they are so few (less than a quarter of all) that
+    // the row kernels should visit the terms through the inverted index,
+    // which is the case for the displacement patterns generated by MODE = suggest.
+
+    const auto ndisp = plan.term_ptr.empty() ? 0 : plan.term_ptr[0].size() - 1;
+
+    disp_nonzero.clear();
+    for (size_t idisp = 0; idisp < ndisp; ++idisp) {
+        if (u_in[index_tran[idisp]] != 0.0) {
+            disp_nonzero.push_back(idisp);
+            if (4 * disp_nonzero.size() >= ndisp) return false;
         }
     }
+    return true;
 }
 
-double Optimize::get_esimated_max_alpha(const Eigen::MatrixXd &Amat,
-                                        const Eigen::VectorXd &bvec,
-                                        const Eigen::VectorXd &mean,
-                                        const Eigen::VectorXd &dev) const
+void Optimize::accumulate_sensing_matrix_rows(const SensingMatrixPlan &plan,
+                                              const std::vector<double> &u_in,
+                                              const int *index_tran,
+                                              const std::vector<int> &disp_nonzero,
+                                              const bool use_index,
+                                              double *amat_block,
+                                              const size_t ld) const
 {
-    const auto ncols = Amat.cols();
-    const auto nrows = Amat.rows();
-    Eigen::MatrixXd C = Amat;
-
-    for (auto i = 0; i < nrows; ++i) {
-        for (auto j = 0; j < ncols; ++j) {
-            C(i, j) = (C(i, j) - mean(j)) / dev(j);
+    // Add the contribution of the displacement u_in to the row block
+    // of the sensing matrix. The block has 3 * natmin rows and ncols columns and
+    // is stored in column-major order with the leading dimension ld.
+    // The displacement of the translated structure at 3 * iat + xyz is
+    // u_in[index_tran[3 * iat + xyz]].
+    // When use_index is true, only the terms whose first displacement is
+    // in disp_nonzero (see get_nonzero_displacements) are visited.
+
+    for (auto order = 0; order < plan.maxorder; ++order) {
+
+        const auto nelems = order + 1;
+        const auto nterms = plan.row[order].size();
+        const auto *row = plan.row[order].data();
+        const auto *col = plan.col[order].data();
+        const auto *coef = plan.coef[order].data();
+        const auto *disp = plan.disp[order].data();
+
+        const auto add_term = [&](const size_t iterm)
+        {
+            auto amat_tmp = 1.0;
+            for (auto j = 0; j < nelems; ++j) {
+                amat_tmp *= u_in[index_tran[disp[nelems * iterm + j]]];
+            }
+            amat_block[ld * col[iterm] + row[iterm]] += coef[iterm] * amat_tmp;
+        };
+
+        if (use_index) {
+            const auto *term_ptr = plan.term_ptr[order].data();
+            const auto *term_index = plan.term_index[order].data();
+            for (const auto idisp : disp_nonzero) {
+                for (auto k = term_ptr[idisp]; k < term_ptr[idisp + 1]; ++k) {
+                    add_term(term_index[k]);
+                }
+            }
+        } else {
+            for (size_t iterm = 0; iterm < nterms; ++iterm) add_term(iterm);
         }
     }
+}
 
-    C = C.transpose() * bvec;
-    auto lambda_max = 0.0;
+void Optimize::build_constraint_transform(const int maxorder,
+                                          const Fcs *fcs,
+                                          const Constraint *constraint,
+                                          ConstraintTransform &transform_out) const
+{
+    // Compile const_fix, const_relate, and index_bimap into x = T y + x0.
+    // A free parameter is mapped to itself, and the target of const_relate
+    // is mapped to -sum_j alpha_j y[orig_j]. The fixed values are taken at this point
+    // because they may be rescaled after the setup of the constraints.
 
-    for (auto i = 0; i < ncols; ++i) {
-        lambda_max = std::max<double>(lambda_max, std::abs(C(i)));
+    size_t i, j;
+    size_t ishift = 0;
+    size_t iparam = 0;
+
+    size_t ncols = 0;
+    size_t ncols_new = 0;
+    for (auto order = 0; order < maxorder; ++order) {
+        ncols += fcs->get_nequiv()[order].size();
+        ncols_new += constraint->get_index_bimap(order).size();
     }
-    lambda_max /= static_cast<double>(nrows);
 
-    return lambda_max;
-}
+    std::vector<std::vector<std::pair<size_t, double>>> t_rows(ncols);
 
-void ALM_NS::Optimize::apply_scaler_displacement(std::vector<std::vector<double>> &u_inout,
-                                                 const double normalization_factor,
-                                                 const bool scale_back) const
-{
-    const auto nrows = u_inout.size();
-    const auto ncols = u_inout[0].size();
+    transform_out.ncols = ncols;
+    transform_out.ncols_new = ncols_new;
+    transform_out.offset.assign(ncols, 0.0);
 
-    if (scale_back) {
-        for (auto i = 0; i < nrows; ++i) {
-            for (auto j = 0; j < ncols; ++j) {
-                u_inout[i][j] *= normalization_factor;
-            }
-        }
-    } else {
-        const auto inv_scale_factor = 1.0 / normalization_factor;
-        for (auto i = 0; i < nrows; ++i) {
-            for (auto j = 0; j < ncols; ++j) {
-                u_inout[i][j] *= inv_scale_factor;
-            }
-        }
-    }
-}
+    for (auto order = 0; order < maxorder; ++order) {
 
-void Optimize::apply_scaler_constraint(const int maxorder,
-                                       const double normalization_factor,
-                                       Constraint *constraint,
-                                       const bool scale_back) const
-{
-    if (scale_back) {
-        for (auto i = 0; i < maxorder; ++i) {
-            const auto scale_factor = 1.0 / std::pow(normalization_factor, i + 1);
-            for (auto j = 0; j < constraint->get_const_fix(i).size(); ++j) {
-                const auto scaled_val = constraint->get_const_fix(i)[j].val_to_fix * scale_factor;
-                constraint->set_const_fix_val_to_fix(i, j, scaled_val);
-            }
+        const auto &index_bimap = constraint->get_index_bimap(order);
+
+        for (const auto &p : constraint->get_const_fix(order)) {
+            transform_out.offset[ishift + p.p_index_target] = p.val_to_fix;
         }
-    } else {
-        for (auto i = 0; i < maxorder; ++i) {
-            const auto scale_factor = std::pow(normalization_factor, i + 1);
-            for (auto j = 0; j < constraint->get_const_fix(i).size(); ++j) {
-                const auto scaled_val = constraint->get_const_fix(i)[j].val_to_fix * scale_factor;
-                constraint->set_const_fix_val_to_fix(i, j, scaled_val);
+
+        for (const auto &it : index_bimap) {
+            t_rows[it.right + ishift].emplace_back(it.left + iparam, 1.0);
+        }
+
+        for (const auto &p : constraint->get_const_relate(order)) {
+            auto &t_row = t_rows[p.p_index_target + ishift];
+            for (j = 0; j < p.alpha.size(); ++j) {
+                t_row.emplace_back(index_bimap.right.at(p.p_index_orig[j]) + iparam,
+                                   -p.alpha[j]);
             }
         }
+
+        ishift += fcs->get_nequiv()[order].size();
+        iparam += index_bimap.size();
     }
-}
 
-void Optimize::apply_scaler_force_constants(const int maxorder,
-                                            const double normalization_factor,
-                                            const Constraint *constraint,
-                                            std::vector<double> &param_inout) const
-{
-    auto k = 0;
-    for (auto i = 0; i < maxorder; ++i) {
-        const auto scale_factor = 1.0 / std::pow(normalization_factor, i + 1);
+    transform_out.row_ptr.resize(ncols + 1);
+    transform_out.col_index.clear();
+    transform_out.values.clear();
+    transform_out.row_ptr[0] = 0;
 
-        for (auto j = 0; j < constraint->get_index_bimap(i).size(); ++j) {
-            param_inout[k] *= scale_factor;
-            ++k;
+    for (i = 0; i < ncols; ++i) {
+        for (const auto &it : t_rows[i]) {
+            transform_out.col_index.push_back(it.first);
+            transform_out.values.push_back(it.second);
         }
+        transform_out.row_ptr[i + 1] = transform_out.col_index.size();
     }
 }
 
-void Optimize::apply_scalers(const int maxorder,
-                             Constraint *constraint)
+void Optimize::accumulate_reduced_sensing_matrix_rows(const SensingMatrixPlan &plan,
+                                                      const ConstraintTransform &transform,
+                                                      const std::vector<double> &u_in,
+                                                      const int *index_tran,
+                                                      const std::vector<int> &disp_nonzero,
+                                                      const bool use_index,
+                                                      double *amat_block,
+                                                      const size_t ld,
+                                                      double *bvec_block) const
 {
-    apply_scaler_displacement(u_train,
-                              optcontrol.displacement_normalization_factor);
-    apply_scaler_constraint(maxorder,
-                            optcontrol.displacement_normalization_factor,
-                            constraint);
+    // Same as accumulate_sensing_matrix_rows, but each term is added directly to
+    // the columns of the free parameters through the row of T for its parameter.
+    // The contribution of the fixed parameters is subtracted from bvec_block.
 
-    if (optcontrol.cross_validation == -1) {
-        apply_scaler_displacement(u_validation,
-                                  optcontrol.displacement_normalization_factor);
+    for (auto order = 0; order < plan.maxorder; ++order) {
+
+        const auto nelems = order + 1;
+        const auto nterms = plan.row[order].size();
+        const auto *row = plan.row[order].data();
+        const auto *col = plan.col[order].data();
+        const auto *coef = plan.coef[order].data();
+        const auto *disp = plan.disp[order].data();
+
+        const auto add_term = [&](const size_t iterm)
+        {
+            auto amat_tmp = coef[iterm];
+            for (auto j = 0; j < nelems; ++j) {
+                amat_tmp *= u_in[index_tran[disp[nelems * iterm + j]]];
+            }
+            if (amat_tmp == 0.0) return;
 
+            const auto iold = col[iterm];
+            for (auto k = transform.row_ptr[iold]; k < transform.row_ptr[iold + 1]; ++k) {
+                amat_block[ld * transform.col_index[k] + row[iterm]] += transform.values[k] * amat_tmp;
+            }
+            if (transform.offset[iold] != 0.0) {
+                bvec_block[row[iterm]] -= transform.offset[iold] * amat_tmp;
+            }
+        };
+
+        if (use_index) {
+            const auto *term_ptr = plan.term_ptr[order].data();
+            const auto *term_index = plan.term_index[order].data();
+            for (const auto idisp : disp_nonzero) {
+                for (auto k = term_ptr[idisp]; k < term_ptr[idisp + 1]; ++k) {
+                    add_term(term_index[k]);
+                }
+            }
+        } else {
+            for (size_t iterm = 0; iterm < nterms; ++iterm) add_term(iterm);
+        }
     }
 }
 
-void ALM_NS::Optimize::finalize_scalers(const int maxorder,
-                                        Constraint *constraint)
+size_t Optimize::get_number_of_blocks_per_panel(const size_t nblocks,
+                                                const size_t nrows_block,
+                                                const size_t ncols) const
 {
-    apply_scaler_displacement(u_train,
-                              optcontrol.displacement_normalization_factor,
-                              true);
-    apply_scaler_constraint(maxorder,
-                            optcontrol.displacement_normalization_factor,
-                            constraint,
-                            true);
-    if (optcontrol.cross_validation == -1) {
-        apply_scaler_displacement(u_validation,
-                                  optcontrol.displacement_normalization_factor,
-                                  true);
+    // Number of row blocks assembled at once by a thread in the dense builders.
+    // By default, the panel has about 256 rows unless the tile exceeds 8 MB.
+
+    size_t nrows_panel = optcontrol.nrows_panel;
+    if (nrows_panel == 0) {
+        nrows_panel = std::min<size_t>(256, (static_cast<size_t>(1) << 20) / std::max<size_t>(ncols, 1));
     }
-}
 
+    auto nblock_panel = std::max<size_t>(1, nrows_panel / nrows_block);
 
-void Optimize::set_training_data(const std::vector<std::vector<double>> &u_train_in,
-                                 const std::vector<std::vector<double>> &f_train_in)
-{
-    u_train.clear();
-    f_train.clear();
-    u_train = u_train_in;
-    f_train = f_train_in;
-    u_train.shrink_to_fit();
-    f_train.shrink_to_fit();
-}
+    // Keep all threads busy
+#ifdef _OPENMP
+    const size_t nthreads = omp_get_max_threads();
+#else
+    const size_t nthreads = 1;
+#endif
+    nblock_panel = std::min<size_t>(nblock_panel, std::max<size_t>(1, (nblocks + nthreads - 1) / nthreads));
 
-void Optimize::set_validation_data(const std::vector<std::vector<double>> &u_validation_in,
-                                   const std::vector<std::vector<double>> &f_validation_in)
-{
-    u_validation.clear();
-    f_validation.clear();
-    u_validation = u_validation_in;
-    f_validation = f_validation_in;
-    u_validation.shrink_to_fit();
-    f_validation.shrink_to_fit();
+    return nblock_panel;
 }
 
-std::vector<std::vector<double>> Optimize::get_u_train() const
+double Optimize::gamma(const int n,
+                       const int *arr) const
 {
-    return u_train;
-}
+    int *arr_tmp, *nsame;
+    int i;
 
-std::vector<std::vector<double>> Optimize::get_f_train() const
-{
-    return f_train;
-}
+    allocate(arr_tmp, n);
+    allocate(nsame, n);
 
+    for (i = 0; i < n; ++i) {
+        arr_tmp[i] = arr[i];
+        nsame[i] = 0;
+    }
 
-void Optimize::set_fcs_values(const int maxorder,
-                              double *fc_in,
-                              std::vector<size_t> *nequiv,
-                              const Constraint *constraint)
-{
-    // fc_in: irreducible set of force constants
-    // fc_length: dimension of params (can differ from that of fc_in)
+    const auto ind_front = arr[0];
+    auto nsame_to_front = 1;
 
-    size_t i;
+    insort(n, arr_tmp);
 
-    size_t N = 0;
-    size_t Nirred = 0;
-    for (i = 0; i < maxorder; ++i) {
-        N += nequiv[i].size();
-        Nirred += constraint->get_index_bimap(i).size();
-    }
+    auto nuniq = 1;
+    auto iuniq = 0;
 
-    std::vector<double> param_in(Nirred, 0.0);
-    std::vector<double> param_out(N, 0.0);
+    nsame[0] = 1;
 
-    for (i = 0; i < Nirred; ++i) {
-        param_in[i] = fc_in[i];
-    }
-    recover_original_forceconstants(maxorder,
-                                    param_in,
-                                    param_out,
-                                    nequiv,
-                                    constraint);
-    if (params) {
-        deallocate(params);
+    for (i = 1; i < n; ++i) {
+        if (arr_tmp[i] == arr_tmp[i - 1]) {
+            ++nsame[iuniq];
+        } else {
+            ++nsame[++iuniq];
+            ++nuniq;
+        }
+
+        if (arr[i] == ind_front) ++nsame_to_front;
     }
-    allocate(params, N);
-    for (i = 0; i < N; ++i) {
-        params[i] = param_out[i];
+
+    auto denom = 1;
+
+    for (i = 0; i < nuniq; ++i) {
+        denom *= factorial(nsame[i]);
     }
+
+    deallocate(arr_tmp);
+    deallocate(nsame);
+
+    return static_cast<double>(nsame_to_front) / static_cast<double>(denom);
 }
 
-size_t Optimize::get_number_of_rows_sensing_matrix() const
+
+double* Optimize::get_params() const
 {
-    return u_train.size() * u_train[0].size();
+    return params;
 }
 
-
-int Optimize::fit_without_constraints(const size_t N,
-                                      const size_t M,
-                                      double *amat,
-                                      const double *bvec,
-                                      double *param_out,
-                                      const int verbosity) const
+int Optimize::factorial(const int n) const
 {
-    int i;
-    int nrhs = 1, nrank, INFO, M_tmp, N_tmp;
-    auto rcond = -1.0;
-    auto f_square = 0.0;
-    double *WORK, *S, *fsum2;
+    if (n == 1 || n == 0) {
+        return 1;
+    }
+    return n * factorial(n - 1);
+}
 
 
-    const auto LMIN = std::min<int>(M, N);
-    auto LMAX = std::max<int>(M, N);
+int Optimize::rankQRD(const size_t m,
+                      const size_t n,
+                      double *mat,
+                      const double tolerance) const
+{
+    // Return the rank of matrix mat revealed by the column pivoting QR decomposition
+    // The matrix mat is destroyed.
 
-    auto LWORK = 3 * LMIN + std::max<int>(2 * LMIN, LMAX);
-    LWORK = 2 * LWORK;
+    auto m_ = static_cast<int>(m);
+    auto n_ = static_cast<int>(n);
 
-    if (verbosity > 0) {
-        std::cout << "  Entering fitting routine: SVD without constraints" << std::endl;
-    }
+    auto LDA = m_;
+
+    auto LWORK = 10 * n_;
+    int INFO;
+    int *JPVT;
+    double *WORK, *TAU;
 
+    const auto nmin = std::min<int>(m_, n_);
 
+    allocate(JPVT, n_);
     allocate(WORK, LWORK);
-    allocate(S, LMIN);
-    allocate(fsum2, LMAX);
+    allocate(TAU, nmin);
 
-    for (i = 0; i < M; ++i) {
-        fsum2[i] = bvec[i];
-        f_square += std::pow(bvec[i], 2);
-    }
-    for (i = M; i < LMAX; ++i) fsum2[i] = 0.0;
+    for (auto i = 0; i < n_; ++i) JPVT[i] = 0;
 
-    if (verbosity > 0) std::cout << "  SVD has started ... ";
+    dgeqp3_(&m_, &n_, mat, &LDA, JPVT, TAU, WORK, &LWORK, &INFO);
 
-    // Fitting with singular value decomposition
-    // M_tmp and N_tmp are prepared to cast N and M to (non-const) int.
-    M_tmp = M;
-    N_tmp = N;
-    dgelss_(&M_tmp, &N_tmp, &nrhs, amat, &M_tmp, fsum2, &LMAX,
-            S, &rcond, &nrank, WORK, &LWORK, &INFO);
+    deallocate(JPVT);
+    deallocate(WORK);
+    deallocate(TAU);
 
-    if (verbosity > 0) {
-        std::cout << "finished !" << std::endl << std::endl;
-        std::cout << "  RANK of the matrix = " << nrank << std::endl;
-    }
+    if (std::abs(mat[0]) < eps) return 0;
 
-    if (nrank < N)
-        warn("fit_without_constraints",
-             "Matrix is rank-deficient. Force constants could not be determined uniquely :(");
+    double **mat_tmp;
+    allocate(mat_tmp, m_, n_);
 
-    if (nrank == N && verbosity > 0) {
-        auto f_residual = 0.0;
-        for (i = N; i < M; ++i) {
-            f_residual += std::pow(fsum2[i], 2);
+    unsigned long k = 0;
+
+    for (auto j = 0; j < n_; ++j) {
+        for (auto i = 0; i < m_; ++i) {
+            mat_tmp[i][j] = mat[k++];
         }
-        std::cout << std::endl << "  Residual sum of squares for the solution: "
-            << sqrt(f_residual) << std::endl;
-        std::cout << "  Fitting error (%) : "
-            << sqrt(f_residual / f_square) * 100.0 << std::endl;
     }
 
-    for (i = 0; i < N; ++i) {
-        param_out[i] = fsum2[i];
+    auto nrank = 0;
+    for (auto i = 0; i < nmin; ++i) {
+        if (std::abs(mat_tmp[i][i]) > tolerance * std::abs(mat[0])) ++nrank;
     }
 
-    deallocate(WORK);
-    deallocate(S);
-    deallocate(fsum2);
+    deallocate(mat_tmp);
 
-    return INFO;
+    return nrank;
 }
 
-int Optimize::fit_with_constraints(const size_t N,
-                                   const size_t M,
-                                   const size_t P,
-                                   double *amat,
-                                   const double *bvec,
-                                   double *param_out,
-                                   const double * const *cmat,
-                                   double *dvec,
-                                   const int verbosity) const
+
+#ifdef WITH_SPARSE_SOLVER
+int Optimize::run_sparse_solver(const SpMat &sp_mat,
+                                const Eigen::VectorXd &sp_bvec,
+                                std::vector<double> &param_out,
+                                const double fnorm,
+                                const int maxorder,
+                                const Fcs *fcs,
+                                const Constraint *constraint,
+                                const int verbosity) const
 {
-    size_t i, j;
-    int N_tmp, M_tmp, P_tmp;
-    double *fsum2;
-    double *mat_tmp;
+    // Solve the least-squares problem with the sparse solver given by SPARSESOLVER.
+    // LSQR, SketchLSQR, LeastSquaresConjugateGradient, and SparseQR work on the sensing matrix directly,
+    // whereas the other solvers are applied to the normal equation A^T A x = A^T b.
+
+    const auto &solver = optcontrol.sparsesolver;
+
+    if (verbosity > 0) {
+        std::cout << "  Solve least-squares problem by sparse solver : " << solver << std::endl;
+    }
+
+    Eigen::VectorXd x = Eigen::VectorXd::Zero(sp_mat.cols());
+    const Eigen::VectorXd AtB = sp_mat.transpose() * sp_bvec;
+    auto success = false;
+    auto niter = -1;
+
+    const auto time_start = std::chrono::steady_clock::now();
+
+    if (solver == "LSQR") {
 
-    if (verbosity > 0) {
-        std::cout << "  Entering fitting routine: QRD with constraints" << std::endl;
-    }
+        success = run_lsqr(sp_mat, sp_bvec, x, niter);
 
-    allocate(fsum2, M);
-    allocate(mat_tmp, (M + P) * N);
+    } else if (solver == "SketchLSQR") {
 
-    size_t k = 0;
-    size_t l = 0;
+        success = run_sketch_lsqr(sp_mat, sp_bvec, x, niter, verbosity);
 
-    // Concatenate two matrices as 1D array
-    for (j = 0; j < N; ++j) {
-        for (i = 0; i < M; ++i) {
-            mat_tmp[k++] = amat[l++];
+    } else if (solver == "LeastSquaresConjugateGradient") {
+
+        Eigen::LeastSquaresConjugateGradient<SpMat> lscg;
+        lscg.setTolerance(optcontrol.tolerance_iteration);
+        lscg.setMaxIterations(optcontrol.maxnum_iteration);
+        lscg.compute(sp_mat);
+        x = lscg.solve(sp_bvec);
+        niter = lscg.iterations();
+        success = lscg.info() == Eigen::Success;
+
+    } else if (solver == "SparseQR") {
+
+        SpMat sp_mat_tmp(sp_mat);
+        sp_mat_tmp.makeCompressed();
+        Eigen::SparseQR<SpMat, Eigen::COLAMDOrdering<int>> qr(sp_mat_tmp);
+        if (qr.info() == Eigen::Success) {
+            x = qr.solve(sp_bvec);
+            success = qr.info() == Eigen::Success;
         }
-        for (i = 0; i < P; ++i) {
-            mat_tmp[k++] = cmat[i][j];
+
+    } else {
+
+        SpMat AtA;
+        get_normal_matrix(sp_mat, AtA);
+
+        if (solver == "SimplicialLDLT") {
+            Eigen::SimplicialLDLT<SpMat> ldlt(AtA);
+            x = ldlt.solve(AtB);
+            success = ldlt.info() == Eigen::Success;
+        } else if (solver == "SimplicialLLT") {
+            Eigen::SimplicialLLT<SpMat> llt(AtA);
+            x = llt.solve(AtB);
+            success = llt.info() == Eigen::Success;
+#ifdef WITH_CHOLMOD
+        } else if (solver == "CholmodSupernodalLLT") {
+            Eigen::CholmodSupernodalLLT<SpMat> llt(AtA);
+            x = llt.solve(AtB);
+            success = llt.info() == Eigen::Success;
+#endif
+        } else if (solver == "ConjugateGradient") {
+            // Lower|Upper enables the multithreaded matrix-vector product.
+            Eigen::ConjugateGradient<SpMat, Eigen::Lower | Eigen::Upper> cg;
+            cg.setTolerance(optcontrol.tolerance_iteration);
+            cg.setMaxIterations(optcontrol.maxnum_iteration);
+            cg.compute(AtA);
+            x = cg.solve(AtB);
+            niter = cg.iterations();
+            success = cg.info() == Eigen::Success;
+        } else if (solver == "BiCGSTAB") {
+            Eigen::BiCGSTAB<SpMat> bicg;
+            bicg.setTolerance(optcontrol.tolerance_iteration);
+            bicg.setMaxIterations(optcontrol.maxnum_iteration);
+            bicg.compute(AtA);
+            x = bicg.solve(AtB);
+            niter = bicg.iterations();
+            success = bicg.info() == Eigen::Success;
+        } else {
+            exit("run_sparse_solver", "Unsupported sparse solver: ", solver.c_str());
         }
     }
 
-    const auto nrank = rankQRD((M + P), N, mat_tmp, eps12);
-    deallocate(mat_tmp);
+    const std::chrono::duration<double> time_solver = std::chrono::steady_clock::now() - time_start;
 
-    if (nrank != N) {
-        std::cout << std::endl;
-        std::cout << " **************************************************************************" << std::endl;
-        std::cout << "  WARNING : rank deficient.                                                " << std::endl;
-        std::cout << "  rank ( (A) ) ! = N            A: Fitting matrix     B: Constraint matrix " << std::endl;
-        std::cout << "       ( (B) )                  N: The number of parameters                " << std::endl;
-        std::cout << "  rank = " << nrank << " N = " << N << std::endl << std::endl;
-        std::cout << "  This can cause a difficulty in solving the fitting problem properly      " << std::endl;
-        std::cout << "  with DGGLSE, especially when the difference is large. Please check if    " << std::endl;
-        std::cout << "  you obtain reliable force constants in the .fcs file.                    " << std::endl << std::
-            endl;
-        std::cout << "  You may need to reduce the cutoff radii and/or increase NDATA            " << std::endl;
-        std::cout << "  by giving linearly-independent displacement patterns.                    " << std::endl;
-        std::cout << " **************************************************************************" << std::endl;
-        std::cout << std::endl;
+    const Eigen::VectorXd res = sp_bvec - sp_mat * x;
+    const auto res2norm = res.squaredNorm();
+    const auto AtBnorm = AtB.norm();
+    const auto normal_residual = AtBnorm > 0.0 ? (sp_mat.transpose() * res).norm() / AtBnorm : 0.0;
+
+    if (verbosity > 0) {
+        std::cout << "  Time spent by the solver : " << time_solver.count() << " sec." << std::endl;
+        if (niter >= 0) {
+            std::cout << "  Number of iterations : " << niter << std::endl;
+        }
+        std::cout << "  Relative residual of the normal equation |A^T(Ax-b)|/|A^T b| : "
+            << normal_residual << std::endl;
     }
 
-    auto f_square = 0.0;
-    for (i = 0; i < M; ++i) {
-        fsum2[i] = bvec[i];
-        f_square += std::pow(bvec[i], 2);
+    const auto nparams = x.size();
+    std::vector<double> param_irred(nparams);
+
+    for (auto i = 0; i < nparams; ++i) {
+        param_irred[i] = x(i);
     }
-    if (verbosity > 0) std::cout << "  QR-Decomposition has started ...";
 
-    double *cmat_mod;
-    allocate(cmat_mod, P * N);
+    if (success) {
+        // Recover reducible set of force constants
 
-    k = 0;
-    for (j = 0; j < N; ++j) {
-        for (i = 0; i < P; ++i) {
-            cmat_mod[k++] = cmat[i][j];
+        recover_original_forceconstants(maxorder,
+                                        param_irred,
+                                        param_out,
+                                        fcs->get_nequiv(),
+                                        constraint);
+
+        if (verbosity > 0) {
+            std::cout << "  Residual sum of squares for the solution: "
+                << sqrt(res2norm) << std::endl;
+            std::cout << "  Fitting error (%) : "
+                << sqrt(res2norm / (fnorm * fnorm)) * 100.0 << std::endl;
         }
-    }
 
-    // Fitting
+        return 0;
 
-    auto LWORK = static_cast<int>(P) + std::min<int>(M, N) + 10 * std::max<int>(M, N);
-    int INFO;
-    double *WORK, *x;
-    allocate(WORK, LWORK);
-    allocate(x, N);
+    } else {
 
-    // M_tmp, N_tmp, P_tmp are prepared to cast N, M, P to (non-const)
-    // int.
-    M_tmp = M;
-    N_tmp = N;
-    P_tmp = P;
-    dgglse_(&M_tmp, &N_tmp, &P_tmp, amat, &M_tmp, cmat_mod, &P_tmp,
-            fsum2, dvec, x, WORK, &LWORK, &INFO);
+        std::cerr << "  Fitting by " << solver << " failed." << std::endl;
 
-    if (verbosity > 0) std::cout << " finished. " << std::endl;
+        return 1;
+    }
+}
 
-    auto f_residual = 0.0;
-    for (i = N - P; i < M; ++i) {
-        f_residual += std::pow(fsum2[i], 2);
+void Optimize::get_normal_matrix(const SpMat &A,
+                                 SpMat &AtA) const
+{
+    // A^T A accumulated over panels of rows, A^T A = sum_p A_p^T A_p.
+    // The rows of a panel A_p are gathered from the columns of A, so that
+    // only a panel and not the whole A is held in the row-major order.
+    // The upper triangle of the j-th column of A_p^T A_p is the sum of the
+    // rows of A_p weighted by A_p(:, j), which is accumulated in a dense work
+    // array of each thread and merged into the j-th column of A^T A.
+    // The lower triangle is filled by symmetry at the end.
+
+    const auto nrows = A.rows();
+    const auto ncols = A.cols();
+    const auto inner = A.innerIndexPtr();
+    const auto values = A.valuePtr();
+
+    std::vector<SpMat::StorageIndex> col_end(ncols);
+    std::vector<SpMat::StorageIndex> nnz_row(nrows, 0);
+    for (long j = 0; j < ncols; ++j) {
+        col_end[j] = A.isCompressed()
+                     ? A.outerIndexPtr()[j + 1]
+                     : A.outerIndexPtr()[j] + A.innerNonZeroPtr()[j];
+        for (auto k = A.outerIndexPtr()[j]; k < col_end[j]; ++k) ++nnz_row[inner[k]];
     }
+    const auto nnz_panel_max = std::max<long>(A.nonZeros() / 16, 1L << 20);
 
-    if (verbosity > 0) {
-        std::cout << std::endl << "  Residual sum of squares for the solution: "
-            << sqrt(f_residual) << std::endl;
-        std::cout << "  Fitting error (%) : "
-            << std::sqrt(f_residual / f_square) * 100.0 << std::endl;
+    // Elements of the j-th column in the current panel are [seg_begin[j], seg_end[j]).
+    std::vector<SpMat::StorageIndex> seg_begin(ncols);
+    std::vector<SpMat::StorageIndex> seg_end(A.outerIndexPtr(), A.outerIndexPtr() + ncols);
+
+    std::vector<long> panel_ptr, panel_next;
+    std::vector<SpMat::StorageIndex> panel_col;
+    std::vector<double> panel_val;
+
+    std::vector<std::vector<SpMat::StorageIndex>> index_col(ncols);
+    std::vector<std::vector<double>> val_col(ncols);
+
+    long row_s = 0;
+    while (row_s < nrows) {
+
+        auto row_e = row_s;
+        long nnz_panel = 0;
+        while (row_e < nrows
+            && (row_e == row_s || nnz_panel + nnz_row[row_e] <= nnz_panel_max)) {
+            nnz_panel += nnz_row[row_e];
+            ++row_e;
+        }
+
+        // Rows [row_s, row_e) in the CSR format with sorted column indices
+        panel_ptr.assign(row_e - row_s + 1, 0);
+        for (auto r = row_s; r < row_e; ++r) {
+            panel_ptr[r - row_s + 1] = panel_ptr[r - row_s] + nnz_row[r];
+        }
+        panel_next.assign(panel_ptr.begin(), panel_ptr.end() - 1);
+        panel_col.resize(nnz_panel);
+        panel_val.resize(nnz_panel);
+
+        for (long j = 0; j < ncols; ++j) {
+            auto k = seg_end[j];
+            seg_begin[j] = k;
+            while (k < col_end[j] && inner[k] < row_e) {
+                const auto m = panel_next[inner[k] - row_s]++;
+                panel_col[m] = static_cast<SpMat::StorageIndex>(j);
+                panel_val[m] = values[k];
+                ++k;
+            }
+            seg_end[j] = k;
+        }
+
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+        {
+            std::vector<double> work(ncols, 0.0);
+            std::vector<char> touched(ncols, 0);
+            std::vector<SpMat::StorageIndex> index_touched;
+            std::vector<SpMat::StorageIndex> index_merged;
+            std::vector<double> val_merged;
+
+#ifdef _OPENMP
+#pragma omp for schedule(guided)
+#endif
+            for (long j = 0; j < ncols; ++j) {
+                for (auto k = seg_begin[j]; k < seg_end[j]; ++k) {
+                    const auto a_rj = values[k];
+                    const auto r = inner[k] - row_s;
+                    for (auto m = panel_ptr[r]; m < panel_ptr[r + 1]; ++m) {
+                        const auto i = panel_col[m];
+                        if (i > j) break;
+                        if (!touched[i]) {
+                            touched[i] = 1;
+                            index_touched.push_back(i);
+                        }
+                        work[i] += a_rj * panel_val[m];
+                    }
+                }
+                if (index_touched.empty()) continue;
+
+                std::sort(index_touched.begin(), index_touched.end());
+
+                // Merge into the j-th column accumulated over the previous panels
+                auto &index_j = index_col[j];
+                auto &val_j = val_col[j];
+                index_merged.clear();
+                val_merged.clear();
+                size_t ipos = 0;
+                for (const auto i : index_touched) {
+                    while (ipos < index_j.size() && index_j[ipos] < i) {
+                        index_merged.push_back(index_j[ipos]);
+                        val_merged.push_back(val_j[ipos]);
+                        ++ipos;
+                    }
+                    if (ipos < index_j.size() && index_j[ipos] == i) {
+                        index_merged.push_back(i);
+                        val_merged.push_back(val_j[ipos] + work[i]);
+                        ++ipos;
+                    } else {
+                        index_merged.push_back(i);
+                        val_merged.push_back(work[i]);
+                    }
+                    work[i] = 0.0;
+                    touched[i] = 0;
+                }
+                index_merged.insert(index_merged.end(), index_j.begin() + ipos, index_j.end());
+                val_merged.insert(val_merged.end(), val_j.begin() + ipos, val_j.end());
+                index_j.assign(index_merged.begin(), index_merged.end());
+                val_j.assign(val_merged.begin(), val_merged.end());
+                index_touched.clear();
+            }
+        }
+
+        row_s = row_e;
     }
 
-    // copy fcs to bvec
-    for (i = 0; i < N; ++i) {
-        param_out[i] = x[i];
+    SpMat AtA_upper(ncols, ncols);
+    AtA_upper.outerIndexPtr()[0] = 0;
+    for (long j = 0; j < ncols; ++j) {
+        AtA_upper.outerIndexPtr()[j + 1] = AtA_upper.outerIndexPtr()[j] + index_col[j].size();
     }
+    AtA_upper.resizeNonZeros(AtA_upper.outerIndexPtr()[ncols]);
 
-    deallocate(cmat_mod);
-    deallocate(WORK);
-    deallocate(x);
-    deallocate(fsum2);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+    for (long j = 0; j < ncols; ++j) {
+        const auto pos = AtA_upper.outerIndexPtr()[j];
+        std::copy(index_col[j].begin(), index_col[j].end(), AtA_upper.innerIndexPtr() + pos);
+        std::copy(val_col[j].begin(), val_col[j].end(), AtA_upper.valuePtr() + pos);
+    }
 
-    return INFO;
+    AtA = AtA_upper.selfadjointView<Eigen::Upper>();
 }
 
-int Optimize::fit_algebraic_constraints(const size_t N,
-                                        const size_t M,
-                                        double *amat,
-                                        const double *bvec,
-                                        std::vector<double> &param_out,
-                                        const double fnorm,
-                                        const int maxorder,
-                                        const Fcs *fcs,
-                                        const Constraint *constraint,
-                                        const int verbosity) const
+bool Optimize::run_lsqr(const SpMat &sp_mat,
+                        const Eigen::VectorXd &sp_bvec,
+                        Eigen::VectorXd &x,
+                        int &niter) const
 {
-    int i;
-    int nrhs = 1, nrank, INFO, M_tmp, N_tmp;
-    auto rcond = -1.0;
-    double *WORK, *S, *fsum2;
+    // The columns of A are scaled to unit norm as a diagonal preconditioner.
 
-    if (verbosity > 0) {
-        std::cout << "  Entering fitting routine: SVD with constraints considered algebraically." << std::endl;
+    const auto ncols = sp_mat.cols();
+
+    Eigen::VectorXd scale(ncols);
+    for (auto j = 0; j < ncols; ++j) {
+        const auto colnorm = sp_mat.col(j).norm();
+        scale(j) = colnorm > 0.0 ? 1.0 / colnorm : 1.0;
     }
 
-    auto LMIN = std::min<int>(M, N);
-    auto LMAX = std::max<int>(M, N);
+    Eigen::VectorXd y;
+    const auto converged
+        = run_lsqr([&sp_mat, &scale](const Eigen::VectorXd &v, Eigen::VectorXd &u) {
+                       u = sp_mat * scale.cwiseProduct(v);
+                   },
+                   [&sp_mat, &scale](const Eigen::VectorXd &u, Eigen::VectorXd &v) {
+                       v = scale.cwiseProduct(sp_mat.transpose() * u);
+                   },
+                   ncols, sp_bvec, y, niter);
 
-    auto LWORK = 3 * LMIN + std::max<int>(2 * LMIN, LMAX);
-    LWORK = 2 * LWORK;
+    x = scale.cwiseProduct(y);
 
-    allocate(WORK, LWORK);
-    allocate(S, LMIN);
-    allocate(fsum2, LMAX);
+    return converged;
+}
 
-    for (i = 0; i < M; ++i) {
-        fsum2[i] = bvec[i];
-    }
-    for (i = M; i < LMAX; ++i) fsum2[i] = 0.0;
+bool Optimize::run_sketch_lsqr(const SpMat &sp_mat,
+                               const Eigen::VectorXd &sp_bvec,
+                               Eigen::VectorXd &x,
+                               int &niter,
+                               const int verbosity) const
+{
+    // LSQR preconditioned by the R factor of a sketch of A.
 
-    if (verbosity > 0) std::cout << "  SVD has started ... ";
+    Eigen::MatrixXd rfac;
+    double rcond;
 
-    // Fitting with singular value decomposition
-    // M_tmp and N_tmp are prepared to cast N and M to (non-const) int.
-    M_tmp = M;
-    N_tmp = N;
-    dgelss_(&M_tmp, &N_tmp, &nrhs, amat, &M_tmp, fsum2, &LMAX,
-            S, &rcond, &nrank, WORK, &LWORK, &INFO);
+    get_sketch(sp_mat, rfac);
+    if (!get_sketch_preconditioner(rfac, rcond)) {
+        if (verbosity > 0) {
+            std::cout << "  The sketch of A is singular or ill-conditioned (RCOND = "
+                << rcond << ")." << std::endl;
+            std::cout << "  Switch to LSQR with the column scaling." << std::endl;
+        }
+        return run_lsqr(sp_mat, sp_bvec, x, niter);
+    }
 
-    deallocate(WORK);
-    deallocate(S);
+    const auto R = rfac.triangularView<Eigen::Upper>();
+    const auto Rt = rfac.transpose().triangularView<Eigen::Lower>();
+    Eigen::VectorXd y;
+    const auto converged
+        = run_lsqr([&sp_mat, &R](const Eigen::VectorXd &v, Eigen::VectorXd &u) {
+                       u = sp_mat * Eigen::VectorXd(R.solve(v));
+                   },
+                   [&sp_mat, &Rt](const Eigen::VectorXd &u, Eigen::VectorXd &v) {
+                       v = Rt.solve(Eigen::VectorXd(sp_mat.transpose() * u));
+                   },
+                   sp_mat.cols(), sp_bvec, y, niter);
+
+    x = R.solve(y);
+
+    return converged;
+}
 
-    if (verbosity > 0) {
-        std::cout << "finished !" << std::endl << std::endl;
-        std::cout << "  RANK of the matrix = " << nrank << std::endl;
-    }
+void Optimize::get_sketch(const SpMat &A,
+                          Eigen::MatrixXd &SA) const
+{
+    const size_t nrows = A.rows();
+    const long ncols = A.cols();
+    std::vector<int> rows;
+    std::vector<double> values;
+    long j;
 
-    if (nrank < N) {
-        warn("fit_without_constraints",
-             "Matrix is rank-deficient. Force constants could not be determined uniquely :(");
-    }
+    get_sketch_embedding(nrows, ncols, rows, values);
+    const auto nnz = rows.size() / nrows;
 
-    if (nrank == N && verbosity > 0) {
-        auto f_residual = 0.0;
-        for (i = N; i < M; ++i) {
-            f_residual += std::pow(fsum2[i], 2);
+    SA.setZero(4 * ncols, ncols);
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for (j = 0; j < ncols; ++j) {
+        for (SpMat::InnerIterator it(A, j); it; ++it) {
+            const auto *rows_now = &rows[nnz * it.row()];
+            const auto *values_now = &values[nnz * it.row()];
+            for (size_t k = 0; k < nnz; ++k) {
+                SA(rows_now[k], j) += values_now[k] * it.value();
+            }
         }
-        std::cout << std::endl;
-        std::cout << "  Residual sum of squares for the solution: "
-            << sqrt(f_residual) << std::endl;
-        std::cout << "  Fitting error (%) : "
-            << sqrt(f_residual / (fnorm * fnorm)) * 100.0 << std::endl;
     }
+}
 
-    if (INFO == 0) {
-        std::vector<double> param_irred(N, 0.0);
-        for (i = 0; i < LMIN; ++i) param_irred[i] = fsum2[i];
-        deallocate(fsum2);
+#endif
 
-        // Recover reducible set of force constants
 
-        recover_original_forceconstants(maxorder,
-                                        param_irred,
-                                        param_out,
-                                        fcs->get_nequiv(),
-                                        constraint);
+bool Optimize::run_lsqr(const std::function<void(const Eigen::VectorXd &, Eigen::VectorXd &)> &apply_A,
+                        const std::function<void(const Eigen::VectorXd &, Eigen::VectorXd &)> &apply_At,
+                        const size_t ncols,
+                        const Eigen::VectorXd &bvec,
+                        Eigen::VectorXd &y,
+                        int &niter) const
+{
+    // LSQR algorithm of Paige and Saunders, ACM Trans. Math. Softw. 8, 43 (1982).
+    // Only the products u = A v and v = A^T u are used through apply_A and
+    // apply_At, so that A^T A is never formed. When A is preconditioned
+    // as A P, y is the solution in the preconditioned variables.
+
+    const auto tolerance = optcontrol.tolerance_iteration;
+
+    y.setZero(ncols);
+    Eigen::VectorXd u = bvec;
+    Eigen::VectorXd v(ncols);
+    Eigen::VectorXd tmp;
+    auto beta = u.norm();
+    const auto bnorm = beta;
+
+    niter = 0;
+    if (bnorm == 0.0) return true;
+
+    u /= beta;
+    apply_At(u, v);
+    auto alpha = v.norm();
+    if (alpha == 0.0) return true;
+    v /= alpha;
+
+    Eigen::VectorXd w = v;
+    auto phibar = beta;
+    auto rhobar = alpha;
+    auto anorm2 = 0.0;
+    auto converged = false;
+
+    for (niter = 1; niter <= optcontrol.maxnum_iteration; ++niter) {
+
+        // Golub-Kahan bidiagonalization
+        apply_A(v, tmp);
+        u = tmp - alpha * u;
+        beta = u.norm();
+        if (beta > 0.0) u /= beta;
+
+        anorm2 += alpha * alpha + beta * beta;
+
+        apply_At(u, tmp);
+        v = tmp - beta * v;
+        alpha = v.norm();
+        if (alpha > 0.0) v /= alpha;
+
+        // Plane rotation to eliminate the subdiagonal element
+        const auto rho = std::sqrt(rhobar * rhobar + beta * beta);
+        const auto c = rhobar / rho;
+        const auto s = beta / rho;
+        const auto theta = s * alpha;
+        rhobar = -c * alpha;
+        const auto phi = c * phibar;
+        phibar = s * phibar;
+
+        y += (phi / rho) * w;
+        w = v - (theta / rho) * w;
+
+        // Stopping criteria: |r| is small, or |A^T r| / (|A||r|) is small.
+        const auto rnorm = phibar;
+        const auto arnorm = phibar * alpha * std::abs(c);
+        const auto anorm = std::sqrt(anorm2);
+
+        if (rnorm <= tolerance * (bnorm + anorm * y.norm())
+            || arnorm <= tolerance * anorm * rnorm) {
+            converged = true;
+            break;
+        }
     }
 
-    return INFO;
+    return converged;
 }
 
 
-void Optimize::get_matrix_elements(const int maxorder,
-                                   std::vector<double> &amat,
-                                   std::vector<double> &bvec,
-                                   const std::vector<std::vector<double>> &u_in,
-                                   const std::vector<std::vector<double>> &f_in,
-                                   const Symmetry *symmetry,
-                                   const Fcs *fcs) const
+void Optimize::get_sketch_embedding(const size_t nrows,
+                                    const size_t ncols,
+                                    std::vector<int> &rows,
+                                    std::vector<double> &values) const
 {
-    size_t i, j;
-    long irow;
-    const auto natmin = symmetry->get_nat_prim();
-    const auto natmin3 = 3 * natmin;
-    std::vector<std::vector<double>> u_multi, f_multi;
+    // Sparse sign embedding S of 4 * ncols rows with a fixed number of
+    // nonzeros (+-1/sqrt(nnz)) per column. The k-th nonzero of the
+    // column irow is at row rows[nnz * irow + k] of S.
+    // The rows are given by a hash of (irow, k), so that the sketch is
+    // reproducible and does not depend on the number of threads.
 
-    if (u_in.size() != f_in.size()) {
-        exit("get_matrix_elements",
-             "The lengths of displacement array and force array are diferent.");
-    }
+    const size_t nnz = 8;
+    const auto nrows_sketch = static_cast<uint64_t>(4 * ncols);
+    const auto value = 1.0 / std::sqrt(static_cast<double>(nnz));
+    long i;
 
-    const auto ndata_fit = u_in.size();
-    const auto ncycle = ndata_fit * symmetry->get_ntran();
-    const auto nrows = ndata_fit * u_in[0].size();
-    size_t ncols = 0;
-    for (i = 0; i < maxorder; ++i) {
-        ncols += fcs->get_nequiv()[i].size();
-    }
+    rows.resize(nnz * nrows);
+    values.resize(nnz * nrows);
 
-    if (amat.size() != nrows * ncols) {
-        amat.resize(nrows * ncols, 0.0);
-    }
-    if (bvec.size() != nrows) {
-        bvec.resize(nrows, 0.0);
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (i = 0; i < static_cast<long>(nnz * nrows); ++i) {
+        // splitmix64
+        uint64_t z = static_cast<uint64_t>(i) + 0x9e3779b97f4a7c15ULL;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        z = z ^ (z >> 31);
+        rows[i] = static_cast<int>((z >> 1) % nrows_sketch);
+        values[i] = (z & 1) ? value : -value;
     }
+}
 
-    data_multiplier(u_in, u_multi, symmetry);
-    data_multiplier(f_in, f_multi, symmetry);
 
+void Optimize::get_sketch(const Eigen::Ref<const Eigen::MatrixXd> &A,
+                          Eigen::MatrixXd &SA) const
+{
+    // SA = S A with the sparse sign embedding S.
+    // Each thread accumulates its own columns of SA.
 
-#ifdef _OPENMP
-#pragma omp parallel private(irow, i, j)
-#endif
-    {
-        int *ind;
-        int mm, order, iat, k;
-        size_t im, iparam;
-        size_t idata;
-        double amat_tmp;
-        double **amat_orig_tmp;
+    const size_t nrows = A.rows();
+    const long ncols = A.cols();
+    std::vector<int> rows;
+    std::vector<double> values;
+    long j;
 
-        allocate(ind, maxorder + 1);
-        allocate(amat_orig_tmp, natmin3, ncols);
+    get_sketch_embedding(nrows, ncols, rows, values);
+    const auto nnz = rows.size() / nrows;
+
+    SA.setZero(4 * ncols, ncols);
 
 #ifdef _OPENMP
-#pragma omp for schedule(guided)
+#pragma omp parallel for schedule(static)
 #endif
-        for (irow = 0; irow < ncycle; ++irow) {
-
-            // generate r.h.s vector B
-            for (i = 0; i < natmin; ++i) {
-                iat = symmetry->get_map_p2s()[i][0];
-                for (j = 0; j < 3; ++j) {
-                    im = 3 * i + j + natmin3 * irow;
-                    bvec[im] = f_multi[irow][3 * iat + j];
-                }
+    for (j = 0; j < ncols; ++j) {
+        const auto *acol = A.col(j).data();
+        auto *sacol = SA.col(j).data();
+        for (size_t i = 0; i < nrows; ++i) {
+            for (size_t k = 0; k < nnz; ++k) {
+                sacol[rows[nnz * i + k]] += values[nnz * i + k] * acol[i];
             }
+        }
+    }
+}
+
+
+bool Optimize::get_sketch_preconditioner(Eigen::MatrixXd &SA,
+                                         double &rcond) const
+{
+    // QR decomposition of the sketch SA. On return, the upper triangle
+    // of SA[0:N, 0:N] is R, so that A R^-1 is well conditioned.
+    // Returns false when R is singular or ill-conditioned.
 
-            for (i = 0; i < natmin3; ++i) {
-                for (j = 0; j < ncols; ++j) {
-                    amat_orig_tmp[i][j] = 0.0;
-                }
-            }
+    int N_tmp = SA.cols();
+    int ldr = SA.rows();
+    int INFO;
+    char uplo = 'U';
+    char diag = 'N';
+    char norm = '1';
+    const auto tolerance = static_cast<double>(N_tmp) * std::numeric_limits<double>::epsilon();
 
-            // generate l.h.s. matrix A
+    Eigen::HouseholderQR<Eigen::Ref<Eigen::MatrixXd>> qr(SA);
 
-            idata = natmin3 * irow;
-            iparam = 0;
+    std::vector<double> work(3 * N_tmp);
+    std::vector<int> iwork(N_tmp);
 
-            for (order = 0; order < maxorder; ++order) {
+    rcond = 0.0;
+    dtrcon_(&norm, &uplo, &diag, &N_tmp, SA.data(), &ldr, &rcond,
+            &work[0], &iwork[0], &INFO);
 
-                mm = 0;
+    SA.conservativeResize(N_tmp, N_tmp);
 
-                for (const auto &iter : fcs->get_nequiv()[order]) {
-                    for (i = 0; i < iter; ++i) {
-                        ind[0] = fcs->get_fc_table()[order][mm].elems[0];
-                        k = inprim_index(ind[0], symmetry);
-                        amat_tmp = 1.0;
-                        for (j = 1; j < order + 2; ++j) {
-                            ind[j] = fcs->get_fc_table()[order][mm].elems[j];
-                            amat_tmp *= u_multi[irow][fcs->get_fc_table()[order][mm].elems[j]];
-                        }
-                        amat_orig_tmp[k][iparam] -= gamma(order + 2, ind) * fcs->get_fc_table()[order][mm].sign *
-                            amat_tmp;
-                        ++mm;
-                    }
-                    ++iparam;
-                }
-            }
+    return INFO == 0 && rcond > tolerance;
+}
 
-            for (i = 0; i < natmin3; ++i) {
-                for (j = 0; j < ncols; ++j) {
-                    // Transpose here for later use of lapack without transpose
-                    amat[natmin3 * ncycle * j + i + idata] = amat_orig_tmp[i][j];
-                }
-            }
+
+
+void Optimize::set_optimizer_control(const OptimizerControl &optcontrol_in)
+{
+    // Check the validity of the options before copying it.
+
+    if (optcontrol_in.cross_validation < -1) {
+        exit("set_optimizer_control", "cross_validation must be -1, 0, or larger");
+    }
+    if (optcontrol_in.cv_patience < 0) {
+        exit("set_optimizer_control", "CV_PATIENCE must be 0 or positive.");
+    }
+    if (optcontrol_in.parallel_cv != 0 && optcontrol_in.parallel_cv != 1) {
+        exit("set_optimizer_control", "CV_PARALLEL must be 0 or 1.");
+    }
+    if (optcontrol_in.ndata_chunk < 0) {
+        exit("set_optimizer_control", "NDATA_CHUNK must be 0 or larger.");
+    }
+    if (optcontrol_in.nrows_panel < 0) {
+        exit("set_optimizer_control", "nrows_panel must be 0 or larger.");
+    }
+    if (optcontrol_in.densesolver != "SVD"
+        && optcontrol_in.densesolver != "QR"
+        && optcontrol_in.densesolver != "TSQR"
+        && optcontrol_in.densesolver != "Cholesky"
+        && optcontrol_in.densesolver != "SketchLSQR") {
+        exit("set_optimizer_control", "Unsupported dense solver: ",
+             optcontrol_in.densesolver.c_str());
+    }
+    if (optcontrol_in.use_sparse_solver) {
+        const std::vector<std::string> sparse_solvers{
+            "SimplicialLDLT", "SimplicialLLT", "SparseQR",
+            "ConjugateGradient", "LeastSquaresConjugateGradient", "BiCGSTAB", "LSQR", "SketchLSQR"
+#ifdef WITH_CHOLMOD
+            , "CholmodSupernodalLLT"
+#endif
+        };
+        if (std::find(sparse_solvers.begin(), sparse_solvers.end(),
+                      optcontrol_in.sparsesolver) == sparse_solvers.end()) {
+            exit("set_optimizer_control", "Unsupported sparse solver: ",
+                 optcontrol_in.sparsesolver.c_str());
+        }
+    }
+    if (optcontrol_in.enet_solver != "CD" && optcontrol_in.enet_solver != "FISTA"
+        && optcontrol_in.enet_solver != "LARS") {
+        exit("set_optimizer_control", "Unsupported elastic-net solver: ",
+             optcontrol_in.enet_solver.c_str());
+    }
+    if (optcontrol_in.linear_model == 2 && optcontrol_in.enet_solver == "LARS"
+        && optcontrol_in.l1_ratio != 1.0) {
+        exit("set_optimizer_control", "ENET_SOLVER = LARS is available only for L1_RATIO = 1.");
+    }
+    if (optcontrol_in.linear_model == 2) {
+        if (optcontrol_in.l1_ratio <= eps || optcontrol_in.l1_ratio > 1.0) {
+            exit("set_optimizer_control", "L1_RATIO must be 0 < L1_RATIO <= 1.");
         }
 
-        deallocate(ind);
-        deallocate(amat_orig_tmp);
+        if (optcontrol_in.cross_validation >= 1 || optcontrol_in.cross_validation == -1) {
+            if (optcontrol_in.l1_alpha_min >= optcontrol_in.l1_alpha_max) {
+                exit("set_optimizer_control", "L1_ALPHA_MIN must be smaller than L1_ALPHA_MAX.");
+            }
+        }
     }
 
-    u_multi.clear();
-    f_multi.clear();
+    optcontrol = optcontrol_in;
 }
 
-
-void Optimize::get_matrix_elements_algebraic_constraint(const int maxorder,
-                                                        std::vector<double> &amat,
-                                                        std::vector<double> &bvec,
-                                                        const std::vector<std::vector<double>> &u_in,
-                                                        const std::vector<std::vector<double>> &f_in,
-                                                        double &fnorm,
-                                                        const Symmetry *symmetry,
-                                                        const Fcs *fcs,
-                                                        const Constraint *constraint) const
+OptimizerControl Optimize::get_optimizer_control() const
 {
-    size_t i, j;
-    long irow;
+    return optcontrol;
+}
 
-    if (u_in.size() != f_in.size()) {
-        exit("get_matrix_elements",
-             "The lengths of displacement array and force array are diferent.");
+
+GramCache::GramCache(const Eigen::Ref<const Eigen::MatrixXd> &A_in,
+                     const Eigen::VectorXd &mean,
+                     const Eigen::VectorXd &dev,
+                     const double memory_mb)
+    : GramCache(A_in.cols(), standardized_panel(A_in, mean, dev), memory_mb) {}
+
+GramCache::GramCache(const size_t ncols_in,
+                     std::function<void(const std::vector<size_t> &, Eigen::MatrixXd &)> compute_panel_in,
+                     const double memory_mb) : compute_panel(std::move(compute_panel_in))
+{
+    ncols = ncols_in;
+    ncomputed = 0;
+    isweep = 0;
+    icol_prev = 0;
+
+    if (memory_mb > 0.0) {
+        const auto bytes_per_column = static_cast<double>(ncols) * sizeof(double);
+        max_columns = static_cast<size_t>(memory_mb * 1024.0 * 1024.0 / bytes_per_column);
+        max_columns = std::min<size_t>(max_columns, ncols);
+    } else {
+        max_columns = ncols;
     }
+    npanel_max = std::max<size_t>(1, std::min<size_t>(64, max_columns / 4));
 
-    const auto ndata_fit = u_in.size();
-    const auto natmin = symmetry->get_nat_prim();
-    const auto natmin3 = 3 * natmin;
-    const auto nrows = u_in.size() * u_in[0].size();
-    size_t ncols = 0;
-    size_t ncols_new = 0;
+    slot_of_column.assign(ncols, -1);
+}
 
-    for (i = 0; i < maxorder; ++i) {
-        ncols += fcs->get_nequiv()[i].size();
-        ncols_new += constraint->get_index_bimap(i).size();
+Eigen::Ref<const Eigen::VectorXd> GramCache::get_column(const size_t icol,
+                                                        const Eigen::VectorXd &beta)
+{
+    size_t k;
+
+    // The coordinate descent visits the columns in ascending order.
+    if (icol <= icol_prev) ++isweep;
+    icol_prev = icol;
+
+    const auto islot = slot_of_column[icol];
+
+    if (islot >= 0) {
+        sweep_of_slot[islot] = isweep;
+        lru.splice(lru.begin(), lru, lru_pos[islot]);
+        return columns[islot];
     }
 
-    const auto ncycle = ndata_fit * symmetry->get_ntran();
+    for (k = 0; k < panel_columns.size(); ++k) {
+        if (panel_columns[k] == icol) return panel.col(k);
+    }
 
-    if (amat.size() != nrows * ncols_new) {
-        amat.resize(nrows * ncols_new, 0.0);
+    // Compute the missing column together with those of the following
+    // nonzero coefficients, which are likely to be needed in the same sweep.
+    panel_columns.assign(1, icol);
+    for (auto j = icol + 1; j < ncols && panel_columns.size() < npanel_max; ++j) {
+        if (slot_of_column[j] < 0 && beta(j) != 0.0) panel_columns.push_back(j);
     }
-    if (bvec.size() != nrows) {
-        bvec.resize(nrows, 0.0);
+
+    const auto npanel = panel_columns.size();
+    panel.resize(ncols, npanel);
+    compute_panel(panel_columns, panel);
+    ncomputed += npanel;
+
+    for (k = 0; k < npanel; ++k) {
+        const auto jslot = get_free_slot();
+        if (jslot < 0) break;
+        columns[jslot] = panel.col(k);
+        slot_of_column[panel_columns[k]] = jslot;
+        column_of_slot[jslot] = panel_columns[k];
+        sweep_of_slot[jslot] = isweep;
     }
 
-    std::vector<double> bvec_orig(nrows, 0.0);
-    std::vector<std::vector<double>> u_multi, f_multi;
+    return panel.col(0);
+}
 
-    data_multiplier(u_in, u_multi, symmetry);
-    data_multiplier(f_in, f_multi, symmetry);
+long GramCache::get_free_slot()
+{
+    long islot;
+
+    if (columns.size() < max_columns) {
+        islot = columns.size();
+        columns.emplace_back();
+        column_of_slot.push_back(0);
+        sweep_of_slot.push_back(isweep);
+        lru.push_front(islot);
+        lru_pos.push_back(lru.begin());
+        return islot;
+    }
 
-#ifdef _OPENMP
-#pragma omp parallel private(irow, i, j)
-#endif
-    {
-        int *ind;
-        int mm, order, iat, k;
-        size_t im;
-        size_t idata;
-        size_t ishift, iparam;
-        size_t iold, inew;
-        double amat_tmp;
-        double **amat_orig_tmp;
-        double **amat_mod_tmp;
+    if (lru.empty()) return -1;
 
-        allocate(ind, maxorder + 1);
-        allocate(amat_orig_tmp, natmin3, ncols);
-        allocate(amat_mod_tmp, natmin3, ncols_new);
+    // Replace the least recently used column only when it has not been
+    // used in the current sweep.
+    islot = lru.back();
+    if (sweep_of_slot[islot] == isweep) return -1;
 
-#ifdef _OPENMP
-#pragma omp for schedule(guided)
-#endif
-        for (irow = 0; irow < ncycle; ++irow) {
+    slot_of_column[column_of_slot[islot]] = -1;
+    lru.splice(lru.begin(), lru, lru_pos[islot]);
 
-            // generate r.h.s vector B
-            for (i = 0; i < natmin; ++i) {
-                iat = symmetry->get_map_p2s()[i][0];
-                for (j = 0; j < 3; ++j) {
-                    im = 3 * i + j + natmin3 * irow;
-                    bvec[im] = f_multi[irow][3 * iat + j];
-                    bvec_orig[im] = f_multi[irow][3 * iat + j];
-                }
-            }
+    return islot;
+}
 
-            for (i = 0; i < natmin3; ++i) {
-                for (j = 0; j < ncols; ++j) {
-                    amat_orig_tmp[i][j] = 0.0;
-                }
-                for (j = 0; j < ncols_new; ++j) {
-                    amat_mod_tmp[i][j] = 0.0;
-                }
-            }
+std::function<void(const std::vector<size_t> &, Eigen::MatrixXd &)>
+GramCache::standardized_panel(const Eigen::Ref<const Eigen::MatrixXd> &A_in,
+                              const Eigen::VectorXd &mean,
+                              const Eigen::VectorXd &dev)
+{
+    // The panel is D^{-1} (A^T A_j - M * mean * mean_j) / dev_j for each column j.
+    // A_in is referred to without a copy.
+    const Eigen::Map<const Eigen::MatrixXd, 0, Eigen::OuterStride<>> A(A_in.data(),
+                                                                       A_in.rows(),
+                                                                       A_in.cols(),
+                                                                       Eigen::OuterStride<>(A_in.outerStride()));
+
+    return [A, mean, dev](const std::vector<size_t> &columns_in, Eigen::MatrixXd &panel_out)
+    {
+        const auto nrows = static_cast<double>(A.rows());
+        Eigen::MatrixXd A_panel(A.rows(), columns_in.size());
+        for (size_t k = 0; k < columns_in.size(); ++k) A_panel.col(k) = A.col(columns_in[k]);
+        panel_out.noalias() = A.transpose() * A_panel;
+        for (size_t k = 0; k < columns_in.size(); ++k) {
+            const auto j = columns_in[k];
+            panel_out.col(k) -= (nrows * mean(j)) * mean;
+            panel_out.col(k) = panel_out.col(k).cwiseQuotient(dev) / dev(j);
+        }
+    };
+}
 
-            // generate l.h.s. matrix A
+size_t GramCache::get_max_columns() const
+{
+    return max_columns;
+}
 
-            idata = natmin3 * irow;
-            iparam = 0;
+size_t GramCache::get_number_of_computed_columns() const
+{
+    return ncomputed;
+}
 
-            for (order = 0; order < maxorder; ++order) {
 
-                mm = 0;
+void Optimize::coordinate_descent(const int M,
+                                  const int N,
+                                  const double alpha,
+                                  const double alpha_prev,
+                                  const int warm_start,
+                                  Eigen::VectorXd &x,
+                                  const Eigen::Ref<const Eigen::MatrixXd> &A,
+                                  const Eigen::Ref<const Eigen::VectorXd> &b,
+                                  const Eigen::VectorXd &mean,
+                                  const Eigen::VectorXd &dev,
+                                  const Eigen::VectorXd &grad0,
+                                  GramCache &gram,
+                                  Eigen::VectorXd &grad,
+                                  const double fnorm,
+                                  const Eigen::VectorXd &scale_beta,
+                                  const int verbosity) const
+{
+    // Cyclic coordinate descent with the sequential strong rule and
+    // active-set cycling [Tibshirani et al., J. R. Stat. Soc. B 74, 245 (2012);
+    // Friedman et al., J. Stat. Softw. 33, 1 (2010)].
+    // beta(i) = 0 is optimal if and only if |grad(i)| / M <= alpha * l1_ratio,
+    // where grad = A^T (b - A beta). The coefficients violating the strong rule
+    // |grad(i)| / M >= 2 * alpha * l1_ratio - alpha_prev * l1_ratio at the previous solution
+    // are swept, and the sweep is restricted to the nonzero coefficients until
+    // convergence. Finally, the KKT condition is checked for all the coefficients
+    // and the violators are added to the strong set.
+    // A is not standardized. The standardization (mean, dev) is included in
+    // grad0 and in the columns given by gram.
 
-                for (const auto &iter : fcs->get_nequiv()[order]) {
-                    for (i = 0; i < iter; ++i) {
-                        ind[0] = fcs->get_fc_table()[order][mm].elems[0];
-                        k = inprim_index(ind[0], symmetry);
+    int i;
+    double diff{0.0};
+    Eigen::VectorXd beta(N);
+    Eigen::VectorXd res(N);
+    bool do_print_log;
 
-                        amat_tmp = 1.0;
-                        for (j = 1; j < order + 2; ++j) {
-                            ind[j] = fcs->get_fc_table()[order][mm].elems[j];
-                            amat_tmp *= u_multi[irow][fcs->get_fc_table()[order][mm].elems[j]];
-                        }
-                        amat_orig_tmp[k][iparam] -= gamma(order + 2, ind)
-                            * fcs->get_fc_table()[order][mm].sign * amat_tmp;
-                        ++mm;
-                    }
-                    ++iparam;
-                }
-            }
+    if (warm_start) {
+        for (i = 0; i < N; ++i) beta(i) = x(i);
+    } else {
+        for (i = 0; i < N; ++i) beta(i) = 0.0;
+        grad = grad0;
+    }
 
-            // Convert the full matrix and vector into a smaller irreducible form
-            // by using constraint information.
+    if (verbosity > 1) {
+        std::cout << "-----------------------------------------------------------------" << std::endl;
+        std::cout << "  L1_ALPHA = " << std::setw(15) << alpha << std::endl;
+    }
 
-            ishift = 0;
-            iparam = 0;
+    const auto Minv = 1.0 / static_cast<double>(M);
+    const auto alphlambda = alpha * optcontrol.l1_ratio;
 
-            for (order = 0; order < maxorder; ++order) {
+    // Strong set. Without the previous solution, the rule is applied with
+    // the smallest alpha giving beta = 0.
+    auto lambda_prev = alpha_prev * optcontrol.l1_ratio;
+    if (!warm_start || alpha_prev <= 0.0) {
+        lambda_prev = 0.0;
+        for (i = 0; i < N; ++i) {
+            if (beta(i) == 0.0) lambda_prev = std::max(lambda_prev, Minv * std::abs(grad(i)));
+        }
+        lambda_prev = std::max(lambda_prev, alphlambda);
+    }
+    const auto threshold_strong = 2.0 * alphlambda - lambda_prev;
 
-                for (i = 0; i < constraint->get_const_fix(order).size(); ++i) {
+    std::vector<int> strong_set, active_set;
+    std::vector<bool> is_strong(N, false);
+    for (i = 0; i < N; ++i) {
+        if (beta(i) != 0.0 || Minv * std::abs(grad(i)) >= threshold_strong) {
+            strong_set.push_back(i);
+            is_strong[i] = true;
+        }
+    }
 
-                    for (j = 0; j < natmin3; ++j) {
-                        bvec[j + idata] -= constraint->get_const_fix(order)[i].val_to_fix
-                            * amat_orig_tmp[j][ishift + constraint->get_const_fix(order)[i].p_index_target];
-                    }
-                }
+    // One sweep over the given coefficients. Returns the RMS change of beta.
+    auto sweep = [&](const std::vector<int> &indices)
+    {
+        auto delta2 = 0.0;
+        for (const auto j : indices) {
+            const auto beta_old = beta(j);
+            if (optcontrol.standardize) {
+                beta(j) = shrink(Minv * grad(j) + beta(j), alphlambda);
+            } else {
+                beta(j) = shrink(Minv * grad(j) + beta(j) / scale_beta(j), alphlambda) * scale_beta(j);
+            }
+            const auto delta = beta_old - beta(j);
+            if (std::abs(delta) > 0.0) {
+                grad = grad + gram.get_column(j, beta) * delta;
+                delta2 += delta * delta;
+            }
+        }
+        return std::sqrt(delta2 / static_cast<double>(N));
+    };
 
-                //                std::cout << "pass const_fix" << std::endl;
+    auto iloop = 0;
+    auto nkkt_violation = 0;
 
-                for (const auto &it : constraint->get_index_bimap(order)) {
-                    inew = it.left + iparam;
-                    iold = it.right + ishift;
+    while (iloop < optcontrol.maxnum_iteration) {
 
-                    for (j = 0; j < natmin3; ++j) {
-                        amat_mod_tmp[j][inew] = amat_orig_tmp[j][iold];
-                    }
-                }
+        // Full sweep over the strong set
+        diff = sweep(strong_set);
+        ++iloop;
 
-                for (i = 0; i < constraint->get_const_relate(order).size(); ++i) {
+        if (diff < optcontrol.tolerance_iteration) {
 
-                    iold = constraint->get_const_relate(order)[i].p_index_target + ishift;
+            // KKT check over the coefficients outside of the strong set
+            auto nviolation = 0;
+            for (i = 0; i < N; ++i) {
+                if (!is_strong[i] && Minv * std::abs(grad(i)) > alphlambda) {
+                    strong_set.push_back(i);
+                    is_strong[i] = true;
+                    ++nviolation;
+                }
+            }
+            if (nviolation == 0) break;
+            std::sort(strong_set.begin(), strong_set.end());
+            nkkt_violation += nviolation;
+            continue;
+        }
 
-                    for (j = 0; j < constraint->get_const_relate(order)[i].alpha.size(); ++j) {
+        // Active-set cycling
+        active_set.clear();
+        for (const auto j : strong_set) {
+            if (beta(j) != 0.0) active_set.push_back(j);
+        }
 
-                        inew = constraint->get_index_bimap(order).right.at(
-                                constraint->get_const_relate(order)[i].p_index_orig[j]) +
-                            iparam;
+        while (iloop < optcontrol.maxnum_iteration) {
+            do_print_log = !((iloop + 1) % optcontrol.output_frequency) && (verbosity > 1);
 
-                        for (k = 0; k < natmin3; ++k) {
-                            amat_mod_tmp[k][inew] -= amat_orig_tmp[k][iold]
-                                * constraint->get_const_relate(order)[i].alpha[j];
-                        }
-                    }
-                }
+            diff = sweep(active_set);
+            ++iloop;
 
-                ishift += fcs->get_nequiv()[order].size();
-                iparam += constraint->get_index_bimap(order).size();
-            }
+            if (diff < optcontrol.tolerance_iteration) break;
 
-            for (i = 0; i < natmin3; ++i) {
-                for (j = 0; j < ncols_new; ++j) {
-                    // Transpose here for later use of lapack without transpose
-                    amat[natmin3 * ncycle * j + i + idata] = amat_mod_tmp[i][j];
+            if (do_print_log) {
+                std::cout << "   Coordinate Descent : " << std::setw(5) << iloop << std::endl;
+                std::cout << "    1: ||u_{k}-u_{k-1}||_2     = " << std::setw(15) << diff
+                    << std::setw(15) << diff * std::sqrt(static_cast<double>(N) / beta.dot(beta)) << std::endl;
+                auto tmp = 0.0;
+#ifdef _OPENMP
+#pragma omp parallel for reduction(+:tmp)
+#endif
+                for (i = 0; i < N; ++i) {
+                    tmp += std::abs(beta(i));
                 }
+                std::cout << "    2: ||u_{k}||_1             = " << std::setw(15) << tmp << std::endl;
+                res = A * beta.cwiseQuotient(dev) - b;
+                res.array() -= mean.cwiseQuotient(dev).dot(beta);
+                tmp = res.dot(res);
+                std::cout << "    3: ||Au_{k}-f||_2          = " << std::setw(15) << std::sqrt(tmp)
+                    << std::setw(15) << std::sqrt(tmp / (fnorm * fnorm)) << std::endl;
+                std::cout << std::endl;
             }
         }
-
-        deallocate(ind);
-        deallocate(amat_orig_tmp);
-        deallocate(amat_mod_tmp);
     }
 
-    fnorm = 0.0;
-    for (i = 0; i < bvec_orig.size(); ++i) {
-        fnorm += bvec_orig[i] * bvec_orig[i];
+    if (verbosity > 1) {
+        std::cout << "  Size of the strong set : " << strong_set.size()
+            << " (KKT violations : " << nkkt_violation << ")" << std::endl;
     }
-    fnorm = std::sqrt(fnorm);
-
-    u_multi.clear();
-    f_multi.clear();
-}
-
-#ifdef WITH_SPARSE_SOLVER
-void Optimize::get_matrix_elements_in_sparse_form(const int maxorder,
-                                                  SpMat &sp_amat,
-                                                  Eigen::VectorXd &sp_bvec,
-                                                  const std::vector<std::vector<double>> &u_in,
-                                                  const std::vector<std::vector<double>> &f_in,
-                                                  double &fnorm,
-                                                  const Symmetry *symmetry,
-                                                  const Fcs *fcs,
-                                                  const Constraint *constraint) const
-{
-    size_t i, j;
-    long irow;
-    typedef Eigen::Triplet<double, size_t> T;
-    std::vector<T> nonzero_entries;
 
-    if (u_in.size() != f_in.size()) {
-        exit("get_matrix_elements",
-             "The lengths of displacement array and force array are diferent.");
+    if (verbosity > 1) {
+        if (iloop >= optcontrol.maxnum_iteration) {
+            std::cout << "WARNING: Convergence NOT achieved within " << optcontrol.maxnum_iteration
+                << " coordinate descent iterations." << std::endl;
+        } else {
+            std::cout << "  Convergence achieved in " << iloop << " iterations." << std::endl;
+        }
+        const auto param2norm = beta.dot(beta);
+        if (std::abs(param2norm) < eps) {
+            std::cout << "    1': ||u_{k}-u_{k-1}||_2     = " << std::setw(15) << 0.0
+                << std::setw(15) << 0.0 << std::endl;
+        } else {
+            std::cout << "    1': ||u_{k}-u_{k-1}||_2     = " << std::setw(15) << diff
+                << std::setw(15) << diff * std::sqrt(static_cast<double>(N) / param2norm) << std::endl;
+        }
+        double tmp = 0.0;
+#ifdef _OPENMP
+#pragma omp parallel for reduction(+:tmp)
+#endif
+        for (i = 0; i < N; ++i) {
+            tmp += std::abs(beta(i));
+        }
+        std::cout << "    2': ||u_{k}||_1             = " << std::setw(15) << tmp << std::endl;
+        res = A * beta.cwiseQuotient(dev) - b;
+        res.array() -= mean.cwiseQuotient(dev).dot(beta);
+        tmp = res.dot(res);
+        std::cout << "    3': ||Au_{k}-f||_2          = " << std::setw(15) << std::sqrt(tmp)
+            << std::setw(15) << std::sqrt(tmp / (fnorm * fnorm)) << std::endl;
+        std::cout << std::endl;
     }
 
-    const auto ndata_fit = u_in.size();
-    const auto natmin = symmetry->get_nat_prim();
-    const auto natmin3 = 3 * natmin;
-    const auto nrows = u_in.size() * u_in[0].size();
-
-    size_t ncols = 0;
-    size_t ncols_new = 0;
+    for (i = 0; i < N; ++i) x[i] = beta(i);
+}
 
-    for (i = 0; i < maxorder; ++i) {
-        ncols += fcs->get_nequiv()[i].size();
-        ncols_new += constraint->get_index_bimap(i).size();
+void Optimize::setup_proximal_gradient(const Eigen::Ref<const Eigen::MatrixXd> &A,
+                                       const Eigen::VectorXd &mean,
+                                       const Eigen::VectorXd &dev,
+                                       Eigen::MatrixXd &Gram,
+                                       double &lipschitz) const
+{
+    // The Gram matrix of the standardized A is formed once by a matrix-matrix product
+    // when it fits in GRAM_CACHE. Otherwise, proximal_gradient uses the products with A.
+    // The Lipschitz constant of the gradient, lambda_max(A^T A) / M, is estimated
+    // by the power method with a safety margin.
+
+    const auto M = A.rows();
+    const size_t N = A.cols();
+    const auto memory_mb = static_cast<double>(N) * static_cast<double>(N)
+        * sizeof(double) / (1024.0 * 1024.0);
+    const Eigen::VectorXd mean_scaled = mean.cwiseQuotient(dev);
+
+    if (optcontrol.gram_cache_mb <= 0.0 || memory_mb <= optcontrol.gram_cache_mb) {
+        Gram.resize(N, N);
+        Gram.noalias() = A.transpose() * A;
+        Gram.noalias() -= static_cast<double>(M) * mean * mean.transpose();
+        Gram = dev.cwiseInverse().asDiagonal() * Gram * dev.cwiseInverse().asDiagonal();
+    } else {
+        Gram.resize(0, 0);
     }
 
-    const auto ncycle = ndata_fit * symmetry->get_ntran();
+    Eigen::VectorXd v = Eigen::VectorXd::Ones(N) / std::sqrt(static_cast<double>(N));
+    Eigen::VectorXd w(N), Av(M);
+    auto lambda = 0.0;
 
-    std::vector<double> bvec_orig(nrows, 0.0);
-    std::vector<std::vector<double>> u_multi, f_multi;
+    for (auto iter = 0; iter < 100; ++iter) {
+        if (Gram.size() > 0) {
+            w.noalias() = Gram * v;
+        } else {
+            Av.noalias() = A * v.cwiseQuotient(dev);
+            Av.array() -= mean_scaled.dot(v);
+            w.noalias() = A.transpose() * Av;
+            w = (w - Av.sum() * mean).cwiseQuotient(dev);
+        }
+        const auto lambda_new = v.dot(w);
+        const auto wnorm = w.norm();
+        if (wnorm == 0.0) break;
+        v = w / wnorm;
+        if (std::abs(lambda_new - lambda) < 1.0e-6 * lambda_new) {
+            lambda = lambda_new;
+            break;
+        }
+        lambda = lambda_new;
+    }
 
-    data_multiplier(u_in, u_multi, symmetry);
-    data_multiplier(f_in, f_multi, symmetry);
+    lipschitz = 1.05 * lambda / static_cast<double>(M);
+}
 
-#ifdef _OPENMP
-#pragma omp parallel private(irow, i, j)
-#endif
-    {
-        int *ind;
-        int mm, order, iat, k;
-        size_t im, iparam;
-        size_t idata;
-        size_t ishift;
-        size_t iold, inew;
-        double amat_tmp;
-        double **amat_orig_tmp;
-        double **amat_mod_tmp;
+void Optimize::proximal_gradient(const int M,
+                                 const int N,
+                                 const double alpha,
+                                 const int warm_start,
+                                 Eigen::VectorXd &x,
+                                 const Eigen::Ref<const Eigen::MatrixXd> &A,
+                                 const Eigen::Ref<const Eigen::VectorXd> &b,
+                                 const Eigen::VectorXd &mean,
+                                 const Eigen::VectorXd &dev,
+                                 const Eigen::VectorXd &grad0,
+                                 const Eigen::MatrixXd &Gram,
+                                 const double lipschitz,
+                                 Eigen::VectorXd &grad,
+                                 const double fnorm,
+                                 const int verbosity) const
+{
+    // FISTA with the adaptive restart of the momentum
+    // [Beck and Teboulle, SIAM J. Imaging Sci. 2, 183 (2009);
+    //  O'Donoghue and Candes, Found. Comput. Math. 15, 715 (2015)].
+    // Each iteration needs only the gradient A^T (b - A y), which is computed by
+    // matrix-vector products with A^T A (or A) and is parallelized over rows.
+    // The stationarity condition |grad(i)| / M <= alpha * l1_ratio is the same
+    // as that of coordinate_descent, so both solvers converge to the same solution.
+    // On return, grad = A^T (b - A x) as in coordinate_descent.
+
+    const auto Minv = 1.0 / static_cast<double>(M);
+    const auto alphlambda = alpha * optcontrol.l1_ratio;
+    const auto step = 1.0 / lipschitz;
+    const auto use_gram = Gram.size() > 0;
 
-        std::vector<T> nonzero_omp;
+    Eigen::VectorXd beta(N), beta_new(N), y(N), g(N), res(use_gram ? 0 : M);
+    Eigen::VectorXd v_scaled(use_gram ? 0 : N);
+    const Eigen::VectorXd mean_scaled = mean.cwiseQuotient(dev);
 
-        allocate(ind, maxorder + 1);
-        allocate(amat_orig_tmp, natmin3, ncols);
-        allocate(amat_mod_tmp, natmin3, ncols_new);
+    if (warm_start) {
+        beta = x;
+    } else {
+        beta.setZero();
+    }
+    y = beta;
 
+    // g = A^T (b - A v) with the standardized A. Eigen does not parallelize
+    // matrix-vector products, so the rows of the products are distributed over threads.
+    auto compute_gradient = [&](const Eigen::VectorXd &v)
+    {
+        if (use_gram) {
 #ifdef _OPENMP
-#pragma omp for schedule(guided)
+#pragma omp parallel for schedule(static)
 #endif
-        for (irow = 0; irow < ncycle; ++irow) {
-
-            // generate r.h.s vector B
-            for (i = 0; i < natmin; ++i) {
-                iat = symmetry->get_map_p2s()[i][0];
-                for (j = 0; j < 3; ++j) {
-                    im = 3 * i + j + natmin3 * irow;
-                    sp_bvec(im) = f_multi[irow][3 * iat + j];
-                    bvec_orig[im] = f_multi[irow][3 * iat + j];
-                }
+            for (auto i = 0; i < N; ++i) {
+                g(i) = grad0(i) - Gram.col(i).dot(v);
             }
-
-            for (i = 0; i < natmin3; ++i) {
-                for (j = 0; j < ncols; ++j) {
-                    amat_orig_tmp[i][j] = 0.0;
-                }
-                for (j = 0; j < ncols_new; ++j) {
-                    amat_mod_tmp[i][j] = 0.0;
-                }
+        } else {
+            v_scaled = v.cwiseQuotient(dev);
+            const auto shift = mean_scaled.dot(v);
+            const auto nblock = (M + 255) / 256;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+            for (auto iblock = 0; iblock < nblock; ++iblock) {
+                const auto irow = 256 * iblock;
+                const auto nrows = std::min(256, M - irow);
+                res.segment(irow, nrows) = b.segment(irow, nrows);
+                res.segment(irow, nrows).array() += shift;
+                res.segment(irow, nrows).noalias() -= A.middleRows(irow, nrows) * v_scaled;
             }
-
-            // generate l.h.s. matrix A
-
-            idata = natmin3 * irow;
-            iparam = 0;
-
-            for (order = 0; order < maxorder; ++order) {
-
-                mm = 0;
-
-                for (const auto &iter : fcs->get_nequiv()[order]) {
-                    for (i = 0; i < iter; ++i) {
-                        ind[0] = fcs->get_fc_table()[order][mm].elems[0];
-                        k = inprim_index(ind[0], symmetry);
-
-                        amat_tmp = 1.0;
-                        for (j = 1; j < order + 2; ++j) {
-                            ind[j] = fcs->get_fc_table()[order][mm].elems[j];
-                            amat_tmp *= u_multi[irow][fcs->get_fc_table()[order][mm].elems[j]];
-                        }
-                        amat_orig_tmp[k][iparam] -= gamma(order + 2, ind)
-                            * fcs->get_fc_table()[order][mm].sign * amat_tmp;
-                        ++mm;
-                    }
-                    ++iparam;
-                }
+            const auto sum_res = res.sum();
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+            for (auto i = 0; i < N; ++i) {
+                g(i) = (A.col(i).dot(res) - sum_res * mean(i)) / dev(i);
             }
+        }
+    };
 
-            // Convert the full matrix and vector into a smaller irreducible form
-            // by using constraint information.
-
-            ishift = 0;
-            iparam = 0;
-
-            for (order = 0; order < maxorder; ++order) {
-
-                for (i = 0; i < constraint->get_const_fix(order).size(); ++i) {
-
-                    for (j = 0; j < natmin3; ++j) {
-                        sp_bvec(j + idata) -= constraint->get_const_fix(order)[i].val_to_fix
-                            * amat_orig_tmp[j][ishift + constraint->get_const_fix(order)[i].p_index_target];
-                    }
-                }
-
-                for (const auto &it : constraint->get_index_bimap(order)) {
-                    inew = it.left + iparam;
-                    iold = it.right + ishift;
+    if (verbosity > 1) {
+        std::cout << "-----------------------------------------------------------------" << std::endl;
+        std::cout << "  L1_ALPHA = " << std::setw(15) << alpha << std::endl;
+    }
 
-                    for (j = 0; j < natmin3; ++j) {
-                        amat_mod_tmp[j][inew] = amat_orig_tmp[j][iold];
-                    }
-                }
+    auto t = 1.0;
+    auto diff = 0.0;
+    auto nrestart = 0;
+    int iloop;
 
-                for (i = 0; i < constraint->get_const_relate(order).size(); ++i) {
+    for (iloop = 0; iloop < optcontrol.maxnum_iteration; ++iloop) {
 
-                    iold = constraint->get_const_relate(order)[i].p_index_target + ishift;
+        compute_gradient(y);
 
-                    for (j = 0; j < constraint->get_const_relate(order)[i].alpha.size(); ++j) {
+        for (auto i = 0; i < N; ++i) {
+            beta_new(i) = shrink(y(i) + step * Minv * g(i), step * alphlambda);
+        }
 
-                        inew = constraint->get_index_bimap(order).right.at(
-                                constraint->get_const_relate(order)[i].p_index_orig[j]) +
-                            iparam;
+        // Restart when the momentum points uphill.
+        if ((y - beta_new).dot(beta_new - beta) > 0.0) {
+            t = 1.0;
+            y = beta_new;
+            ++nrestart;
+        } else {
+            const auto t_new = 0.5 * (1.0 + std::sqrt(1.0 + 4.0 * t * t));
+            y = beta_new + ((t - 1.0) / t_new) * (beta_new - beta);
+            t = t_new;
+        }
 
-                        for (k = 0; k < natmin3; ++k) {
-                            amat_mod_tmp[k][inew] -= amat_orig_tmp[k][iold]
-                                * constraint->get_const_relate(order)[i].alpha[j];
-                        }
-                    }
-                }
+        diff = std::sqrt((beta_new - beta).squaredNorm() / static_cast<double>(N));
+        beta.swap(beta_new);
 
-                ishift += fcs->get_nequiv()[order].size();
-                iparam += constraint->get_index_bimap(order).size();
-            }
+        if (diff < optcontrol.tolerance_iteration) break;
 
-            for (i = 0; i < natmin3; ++i) {
-                for (j = 0; j < ncols_new; ++j) {
-                    if (std::abs(amat_mod_tmp[i][j]) > eps) {
-                        nonzero_omp.emplace_back(T(idata + i, j, amat_mod_tmp[i][j]));
-                    }
-                }
-            }
+        if (verbosity > 1 && !((iloop + 1) % optcontrol.output_frequency)) {
+            std::cout << "   FISTA : " << std::setw(5) << iloop + 1 << std::endl;
+            std::cout << "    1: ||u_{k}-u_{k-1}||_2     = " << std::setw(15) << diff << std::endl;
+            std::cout << "    2: ||u_{k}||_1             = " << std::setw(15) << beta.lpNorm<1>() << std::endl;
+            std::cout << std::endl;
         }
+    }
 
-        deallocate(ind);
-        deallocate(amat_orig_tmp);
-        deallocate(amat_mod_tmp);
+    compute_gradient(beta);
+    grad = g;
 
-#pragma omp critical
-        {
-            for (const auto &it : nonzero_omp) {
-                nonzero_entries.emplace_back(it);
-            }
+    if (verbosity > 1) {
+        if (iloop >= optcontrol.maxnum_iteration) {
+            std::cout << "WARNING: Convergence NOT achieved within MAXITER iterations." << std::endl;
+        } else {
+            std::cout << "  Convergence achieved in " << iloop + 1 << " iterations ("
+                << nrestart << " restarts)." << std::endl;
         }
+        std::cout << "    1': ||u_{k}-u_{k-1}||_2     = " << std::setw(15) << diff << std::endl;
+        std::cout << "    2': ||u_{k}||_1             = " << std::setw(15) << beta.lpNorm<1>() << std::endl;
+        Eigen::VectorXd fdiff = A * beta.cwiseQuotient(dev) - b;
+        fdiff.array() -= mean_scaled.dot(beta);
+        std::cout << "    3': ||Au_{k}-f||_2          = " << std::setw(15) << fdiff.norm()
+            << std::setw(15) << fdiff.norm() / fnorm << std::endl;
+        std::cout << std::endl;
     }
 
-    fnorm = 0.0;
-    for (i = 0; i < bvec_orig.size(); ++i) {
-        fnorm += bvec_orig[i] * bvec_orig[i];
-    }
-    fnorm = std::sqrt(fnorm);
-    sp_amat.setFromTriplets(nonzero_entries.begin(), nonzero_entries.end());
-    sp_amat.makeCompressed();
+    x = beta;
 }
-#endif
-
 
-void Optimize::recover_original_forceconstants(const int maxorder,
-                                               const std::vector<double> &param_in,
-                                               std::vector<double> &param_out,
-                                               const std::vector<size_t> *nequiv,
-                                               const Constraint *constraint) const
+void Optimize::lars_path(const Eigen::Ref<const Eigen::MatrixXd> &A,
+                         const Eigen::VectorXd &mean,
+                         const Eigen::VectorXd &dev,
+                         const Eigen::VectorXd &grad0,
+                         const std::vector<double> &alphas,
+                         Eigen::MatrixXd &X,
+                         const int verbosity) const
 {
-    // Expand the given force constants into the larger sets
-    // by using the constraint matrix.
-
-    size_t i, j, k;
-    size_t ishift = 0;
-    size_t iparam = 0;
-    double tmp;
-    size_t inew, iold;
+    // LARS algorithm with the LASSO modification (homotopy method)
+    // [Efron et al., Ann. Stat. 32, 407 (2004); Osborne et al., IMA J. Numer. Anal. 20, 389 (2000)].
+    // The LASSO solution is piecewise linear in alpha. Between two breakpoints,
+    // the active coefficients move along beta_A += t * (G_AA)^{-1} s_A while
+    // the correlations grad = A^T (b - A beta) of the active set decrease as
+    // |grad_A| = M * alpha - t. A breakpoint is where an inactive coefficient reaches
+    // |grad_j| = M * alpha (join) or an active coefficient crosses zero (drop).
+    // G_AA is handled by the Cholesky factor, which is updated at each breakpoint.
+    // The columns of the standardized A^T A are computed only for the active coefficients.
+    // On return, X.col(i) is the exact solution at alphas[i] obtained by the linear
+    // interpolation between the breakpoints. The L1_RATIO must be 1.
+
+    const auto M = A.rows();
+    const size_t N = A.cols();
+    const auto Md = static_cast<double>(M);
+    const auto nalphas = alphas.size();
+    const auto kmax = std::min<size_t>(N, M);
 
-    size_t nparams = 0;
+    X.setZero(N, nalphas);
 
-    for (i = 0; i < maxorder; ++i) nparams += nequiv[i].size();
+    // Grid points in the descending order of alpha
+    std::vector<size_t> order(nalphas);
+    for (size_t i = 0; i < nalphas; ++i) order[i] = i;
+    std::sort(order.begin(), order.end(),
+              [&alphas](const size_t i, const size_t j) { return alphas[i] > alphas[j]; });
+    if (nalphas == 0) return;
 
-    param_out.resize(nparams, 0.0);
+    Eigen::VectorXd beta = Eigen::VectorXd::Zero(N);
+    Eigen::VectorXd grad = grad0;
+    Eigen::VectorXd d, a(N), w;
+    Eigen::MatrixXd L(kmax, kmax);
 
-    for (i = 0; i < maxorder; ++i) {
-        for (j = 0; j < constraint->get_const_fix(i).size(); ++j) {
-            param_out[constraint->get_const_fix(i)[j].p_index_target + ishift]
-                = constraint->get_const_fix(i)[j].val_to_fix;
-        }
+    std::vector<size_t> active;
+    std::vector<double> sign_active;
+    std::vector<Eigen::VectorXd> gram_active;
+    std::vector<bool> is_active(N, false), is_excluded(N, false);
 
-        for (const auto &it : constraint->get_index_bimap(i)) {
-            inew = it.left + iparam;
-            iold = it.right + ishift;
+    const auto level_min = Md * alphas[order.back()];
 
-            param_out[iold] = param_in[inew];
-        }
+    size_t jmax = 0;
+    for (size_t j = 0; j < N; ++j) {
+        if (std::abs(grad(j)) > std::abs(grad(jmax))) jmax = j;
+    }
+    auto level = std::abs(grad(jmax));
+    const auto tiny = 1.0e-12 * std::max(level, eps);
 
-        for (j = 0; j < constraint->get_const_relate(i).size(); ++j) {
-            tmp = 0.0;
+    size_t igrid = 0;
+    while (igrid < nalphas && Md * alphas[order[igrid]] >= level) ++igrid;
 
-            for (k = 0; k < constraint->get_const_relate(i)[j].alpha.size(); ++k) {
-                tmp += constraint->get_const_relate(i)[j].alpha[k]
-                    * param_out[constraint->get_const_relate(i)[j].p_index_orig[k] + ishift];
+    // Adds j to the active set. Returns false when column j is linearly dependent on the active ones.
+    auto add_column = [&](const size_t j)
+    {
+        Eigen::VectorXd col = A.transpose() * A.col(j);
+        col -= (Md * mean(j)) * mean;
+        col = col.cwiseQuotient(dev) / dev(j);
+
+        const auto k = active.size();
+        w.resize(k);
+        for (size_t p = 0; p < k; ++p) w(p) = col(active[p]);
+        if (k > 0) L.topLeftCorner(k, k).triangularView<Eigen::Lower>().solveInPlace(w);
+        const auto r2 = col(j) - w.squaredNorm();
+        if (k >= kmax || r2 <= 1.0e-10 * col(j)) return false;
+
+        if (k > 0) L.row(k).head(k) = w.transpose();
+        L(k, k) = std::sqrt(r2);
+        active.push_back(j);
+        sign_active.push_back(grad(j) > 0.0 ? 1.0 : -1.0);
+        gram_active.push_back(col);
+        is_active[j] = true;
+        return true;
+    };
+
+    // Removes the p-th active coefficient. The Cholesky factor is restored
+    // to the lower triangular form by Givens rotations.
+    auto remove_column = [&](const size_t p)
+    {
+        const auto k = active.size();
+        for (size_t i = p; i + 1 < k; ++i) L.row(i).head(k) = L.row(i + 1).head(k);
+        for (size_t i = p; i + 1 < k; ++i) {
+            const auto r = std::hypot(L(i, i), L(i, i + 1));
+            const auto c = L(i, i) / r;
+            const auto s = L(i, i + 1) / r;
+            for (size_t irow = i; irow + 1 < k; ++irow) {
+                const auto x1 = L(irow, i);
+                const auto x2 = L(irow, i + 1);
+                L(irow, i) = c * x1 + s * x2;
+                L(irow, i + 1) = -s * x1 + c * x2;
             }
-            param_out[constraint->get_const_relate(i)[j].p_index_target + ishift] = -tmp;
         }
+        is_active[active[p]] = false;
+        active.erase(active.begin() + p);
+        sign_active.erase(sign_active.begin() + p);
+        gram_active.erase(gram_active.begin() + p);
+    };
 
-        ishift += nequiv[i].size();
-        iparam += constraint->get_index_bimap(i).size();
-    }
-}
+    if (!add_column(jmax)) is_excluded[jmax] = true;
 
+    size_t nbreak = 0;
+    size_t ndrop = 0;
 
-void Optimize::data_multiplier(const std::vector<std::vector<double>> &data_in,
-                               std::vector<std::vector<double>> &data_out,
-                               const Symmetry *symmetry) const
-{
-    const auto nat = symmetry->get_nat_prim() * symmetry->get_ntran();
-    const auto ndata_used = data_in.size();
-    const auto ntran = symmetry->get_ntran();
+    const auto nbreak_max = static_cast<size_t>(optcontrol.maxnum_iteration);
 
-    data_out.resize(ntran * ndata_used, std::vector<double>(3 * nat));
+    while (nbreak < nbreak_max && !active.empty()) {
 
-    auto idata = 0;
-    for (auto i = 0; i < ndata_used; ++i) {
+        const auto k = active.size();
 
-        for (auto itran = 0; itran < symmetry->get_ntran(); ++itran) {
-            for (auto j = 0; j < nat; ++j) {
-                const auto n_mapped = symmetry->get_map_sym()[j][symmetry->get_symnum_tran()[itran]];
-                for (auto k = 0; k < 3; ++k) {
-                    data_out[idata][3 * n_mapped + k] = data_in[i][3 * j + k];
+        // Direction of the active coefficients
+        d = Eigen::Map<const Eigen::VectorXd>(&sign_active[0], k);
+        L.topLeftCorner(k, k).triangularView<Eigen::Lower>().solveInPlace(d);
+        L.topLeftCorner(k, k).triangularView<Eigen::Lower>().transpose().solveInPlace(d);
+
+        a.setZero();
+        for (size_t p = 0; p < k; ++p) a += gram_active[p] * d(p);
+
+        // Step to the next breakpoint
+        auto gamma = level - level_min;
+        long jadd = -1;
+        long pdrop = -1;
+
+        for (size_t j = 0; j < N; ++j) {
+            if (is_active[j] || is_excluded[j]) continue;
+            if (a(j) < 1.0) {
+                const auto t = (level - grad(j)) / (1.0 - a(j));
+                if (t > tiny && t < gamma) {
+                    gamma = t;
+                    jadd = j;
+                }
+            }
+            if (a(j) > -1.0) {
+                const auto t = (level + grad(j)) / (1.0 + a(j));
+                if (t > tiny && t < gamma) {
+                    gamma = t;
+                    jadd = j;
                 }
             }
-            ++idata;
         }
-    }
-}
-
-int Optimize::inprim_index(const int n,
-                           const Symmetry *symmetry) const
-{
-    auto in = -1;
-    const auto atmn = n / 3;
-    const auto crdn = n % 3;
+        for (size_t p = 0; p < k; ++p) {
+            if (d(p) == 0.0) continue;
+            const auto t = -beta(active[p]) / d(p);
+            if (t > tiny && t < gamma) {
+                gamma = t;
+                jadd = -1;
+                pdrop = p;
+            }
+        }
+        gamma = std::max(gamma, 0.0);
+
+        // Solutions at the grid points in [level - gamma, level)
+        while (igrid < nalphas && Md * alphas[order[igrid]] >= level - gamma) {
+            const auto t = level - Md * alphas[order[igrid]];
+            X.col(order[igrid]) = beta;
+            for (size_t p = 0; p < k; ++p) X(active[p], order[igrid]) += t * d(p);
+            ++igrid;
+        }
 
-    for (size_t i = 0; i < symmetry->get_nat_prim(); ++i) {
-        if (symmetry->get_map_p2s()[i][0] == atmn) {
-            in = 3 * i + crdn;
+        for (size_t p = 0; p < k; ++p) beta(active[p]) += gamma * d(p);
+        grad -= gamma * a;
+        level -= gamma;
+        ++nbreak;
+
+        if (pdrop >= 0) {
+            beta(active[pdrop]) = 0.0;
+            remove_column(pdrop);
+            ++ndrop;
+        } else if (jadd >= 0) {
+            if (!add_column(jadd)) is_excluded[jadd] = true;
+        } else {
             break;
         }
     }
-    return in;
-}
-
-double Optimize::gamma(const int n,
-                       const int *arr) const
-{
-    int *arr_tmp, *nsame;
-    int i;
-
-    allocate(arr_tmp, n);
-    allocate(nsame, n);
 
-    for (i = 0; i < n; ++i) {
-        arr_tmp[i] = arr[i];
-        nsame[i] = 0;
+    // The rest of the grid when the path is terminated
+    while (igrid < nalphas) {
+        X.col(order[igrid]) = beta;
+        ++igrid;
     }
 
-    const auto ind_front = arr[0];
-    auto nsame_to_front = 1;
+    if (verbosity > 0) {
+        std::cout << "  LARS : " << nbreak << " breakpoints (" << ndrop << " drops), "
+            << active.size() << " active coefficients at L1_ALPHA = " << level / Md << std::endl;
+        if (nbreak >= nbreak_max && level > level_min) {
+            std::cout << "WARNING: The LARS path was terminated at MAXITER breakpoints." << std::endl;
+        }
+    }
+}
 
-    insort(n, arr_tmp);
+#ifdef WITH_SPARSE_SOLVER
+int Optimize::run_elastic_net_optimization_sparse(const int maxorder,
+                                                  const size_t M,
+                                                  const size_t N_new,
+                                                  const Fcs *fcs,
+                                                  const Symmetry *symmetry,
+                                                  const Constraint *constraint,
+                                                  const int verbosity,
+                                                  std::vector<double> &param_out) const
+{
+    // Elastic-net optimization with the sensing matrix in the sparse form (SPARSE = 1)
+    size_t i;
+    double fnorm;
 
-    auto nuniq = 1;
-    auto iuniq = 0;
+    SpMat A(M, N_new);
+    Eigen::VectorXd b(M), x, fdiff;
+    Eigen::VectorXd mean, dev, factor_std, scale_beta;
 
-    nsame[0] = 1;
+    get_matrix_elements_in_sparse_form(maxorder,
+                                       A,
+                                       b,
+                                       u_train,
+                                       f_train,
+                                       fnorm,
+                                       symmetry,
+                                       fcs,
+                                       constraint);
 
-    for (i = 1; i < n; ++i) {
-        if (arr_tmp[i] == arr_tmp[i - 1]) {
-            ++nsame[iuniq];
+    if (verbosity > 0) {
+        std::cout << "  Elastic-net minimization with the following parameters:" << std::endl;
+        std::cout << "   L1_RATIO = " << optcontrol.l1_ratio << std::endl;
+        std::cout << "   L1_ALPHA = " << std::setw(15) << optcontrol.l1_alpha << std::endl;
+        std::cout << "   CONV_TOL = " << std::setw(15) << optcontrol.tolerance_iteration << std::endl;
+        std::cout << "   MAXITER = " << std::setw(5) << optcontrol.maxnum_iteration << std::endl;
+        std::cout << "   ENET_DNORM = " << std::setw(15) << optcontrol.displacement_normalization_factor << std::endl;
+        std::cout << std::endl;
+        std::cout << "  SPARSE = 1 : Coordinate descent on the sparse sensing matrix." << std::endl;
+        std::cout << "               Number of nonzero elements : " << A.nonZeros()
+            << " (" << 100.0 * static_cast<double>(A.nonZeros())
+            / (static_cast<double>(M) * static_cast<double>(N_new)) << " %)" << std::endl;
+        std::cout << std::endl;
+        if (optcontrol.standardize) {
+            std::cout << " STANDARDIZE = 1 : Standardization will be performed for matrix A and vector b." << std::endl;
+            std::cout << "                   The ENET_DNORM-tag will be neglected." << std::endl;
         } else {
-            ++nsame[++iuniq];
-            ++nuniq;
+            std::cout << " STANDARDIZE = 0 : No standardization of matrix A and vector b." << std::endl;
+            std::cout << "                   Columns of matrix A will be scaled by the ENET_DNORM value." << std::endl;
         }
-
-        if (arr[i] == ind_front) ++nsame_to_front;
     }
 
-    auto denom = 1;
+    // The standardization is applied implicitly in coordinate_descent_sparse.
+    get_standardizer(A, mean, dev, factor_std, scale_beta);
 
-    for (i = 0; i < nuniq; ++i) {
-        denom *= factorial(nsame[i]);
+    for (i = 0; i < N_new; ++i) {
+        scale_beta(i) = 1.0 / (1.0 / scale_beta(i) + (1.0 - optcontrol.l1_ratio) * optcontrol.l1_alpha);
     }
 
-    deallocate(arr_tmp);
-    deallocate(nsame);
-
-    return static_cast<double>(nsame_to_front) / static_cast<double>(denom);
-}
+    x.setZero(N_new);
 
+    coordinate_descent_sparse(M, N_new, optcontrol.l1_alpha,
+                              0.0,
+                              0,
+                              x, A, b, mean, dev,
+                              scale_beta,
+                              verbosity);
 
-double* Optimize::get_params() const
-{
-    return params;
-}
+    for (i = 0; i < N_new; ++i) {
+        param_out[i] = x[i] * factor_std[i];
+    }
 
-int Optimize::factorial(const int n) const
-{
-    if (n == 1 || n == 0) {
-        return 1;
+    if (verbosity > 0) {
+        // The intercept correction cancels the column means.
+        fdiff = A * x.cwiseQuotient(dev) - b;
+        const auto res1 = fdiff.dot(fdiff) / (fnorm * fnorm);
+        std::cout << "  RESIDUAL (%): " << std::sqrt(res1) * 100.0 << std::endl;
     }
-    return n * factorial(n - 1);
-}
 
+    if (optcontrol.debiase_after_l1opt) {
 
-int Optimize::rankQRD(const size_t m,
-                      const size_t n,
-                      double *mat,
-                      const double tolerance) const
-{
-    // Return the rank of matrix mat revealed by the column pivoting QR decomposition
-    // The matrix mat is destroyed.
+        if (verbosity > 0) {
+            std::cout << " DEBIAS_OLS = 1: Attempt to reduce the bias of LASSO by performing OLS fitting" << std::endl;
+            std::cout << "                 with features selected by LASSO." << std::endl;
+        }
 
-    auto m_ = static_cast<int>(m);
-    auto n_ = static_cast<int>(n);
+        // Only the selected columns are standardized and made dense.
+        std::vector<size_t> nonzero_index;
+        for (i = 0; i < N_new; ++i) {
+            if (std::abs(param_out[i]) >= eps) nonzero_index.push_back(i);
+        }
 
-    auto LDA = m_;
+        Eigen::MatrixXd A_nonzero(M, nonzero_index.size());
+        for (i = 0; i < nonzero_index.size(); ++i) {
+            const auto j = nonzero_index[i];
+            A_nonzero.col(i) = (Eigen::VectorXd(A.col(j)).array() - mean(j)) / dev(j);
+        }
+        Eigen::VectorXd x_nonzero = A_nonzero.colPivHouseholderQr().solve(b);
 
-    auto LWORK = 10 * n_;
-    int INFO;
-    int *JPVT;
-    double *WORK, *TAU;
+        for (i = 0; i < N_new; ++i) param_out[i] = 0.0;
+        for (i = 0; i < nonzero_index.size(); ++i) {
+            param_out[nonzero_index[i]] = x_nonzero[i] * factor_std[nonzero_index[i]];
+        }
+    }
+
+    return 0;
+}
+
+void Optimize::run_enet_solution_path_sparse(const int maxorder,
+                                             const SpMat &A,
+                                             const Eigen::VectorXd &b,
+                                             const SpMat &A_validation,
+                                             const Eigen::VectorXd &b_validation,
+                                             const double fnorm,
+                                             const double fnorm_validation,
+                                             const std::string file_coef,
+                                             const int verbosity,
+                                             const Constraint *constraint,
+                                             const std::vector<double> &alphas,
+                                             std::vector<double> &training_error,
+                                             std::vector<double> &validation_error,
+                                             std::vector<std::vector<int>> &nonzeros) const
+{
+    // Same as run_enet_solution_path for the sensing matrices in the sparse form.
 
-    const auto nmin = std::min<int>(m_, n_);
+    std::ofstream ofs_coef;
 
-    allocate(JPVT, n_);
-    allocate(WORK, LWORK);
-    allocate(TAU, nmin);
+    std::vector<double> params_tmp;
+    std::vector<int> nzero_lasso(maxorder);
 
-    for (auto i = 0; i < n_; ++i) JPVT[i] = 0;
+    Eigen::VectorXd x, z, fdiff, fdiff_validation;
+    Eigen::VectorXd mean, dev, factor_std, scale_beta, scale_beta_enet;
 
-    dgeqp3_(&m_, &n_, mat, &LDA, JPVT, TAU, WORK, &LWORK, &INFO);
+    const size_t N_new = A.cols();
+    const size_t M = A.rows();
 
-    deallocate(JPVT);
-    deallocate(WORK);
-    deallocate(TAU);
+    x.setZero(N_new);
+    scale_beta_enet.resize(N_new);
 
-    if (std::abs(mat[0]) < eps) return 0;
+    if (optcontrol.save_solution_path) {
+        ofs_coef.open(file_coef.c_str(), std::ios::out);
+        ofs_coef << "# L1 ALPHA, coefficients" << std::endl;
+        params_tmp.resize(N_new);
+    }
 
-    double **mat_tmp;
-    allocate(mat_tmp, m_, n_);
+    get_standardizer(A, mean, dev, factor_std, scale_beta);
 
-    unsigned long k = 0;
+    training_error.clear();
+    validation_error.clear();
+    nonzeros.clear();
 
-    for (auto j = 0; j < n_; ++j) {
-        for (auto i = 0; i < m_; ++i) {
-            mat_tmp[i][j] = mat[k++];
-        }
-    }
+    if (verbosity == 1) std::cout << std::setw(3);
 
-    auto nrank = 0;
-    for (auto i = 0; i < nmin; ++i) {
-        if (std::abs(mat_tmp[i][i]) > tolerance * std::abs(mat[0])) ++nrank;
-    }
+    for (size_t ialpha = 0; ialpha < alphas.size(); ++ialpha) {
 
-    deallocate(mat_tmp);
+        const auto l1_alpha = alphas[ialpha];
 
-    return nrank;
-}
+        for (size_t i = 0; i < N_new; ++i) {
+            scale_beta_enet(i) = 1.0 / (1.0 / scale_beta(i) + (1.0 - optcontrol.l1_ratio) * l1_alpha);
+        }
 
+        coordinate_descent_sparse(M, N_new, l1_alpha,
+                                  ialpha > 0 ? alphas[ialpha - 1] : 0.0,
+                                  ialpha > 0,
+                                  x, A, b, mean, dev,
+                                  scale_beta_enet,
+                                  verbosity);
+
+        // With the intercept correction, the residuals are A * (x / dev) - b.
+        z = x.cwiseQuotient(dev);
+        fdiff = A * z - b;
+        fdiff_validation = A_validation * z - b_validation;
+        const auto res1 = fdiff.dot(fdiff) / (fnorm * fnorm);
+        const auto res2 = fdiff_validation.dot(fdiff_validation) / (fnorm_validation * fnorm_validation);
 
-#ifdef WITH_SPARSE_SOLVER
-int Optimize::run_eigen_sparseQR(const SpMat &sp_mat,
-                                 const Eigen::VectorXd &sp_bvec,
-                                 std::vector<double> &param_out,
-                                 const double fnorm,
-                                 const int maxorder,
-                                 const Fcs *fcs,
-                                 const Constraint *constraint,
-                                 const int verbosity) const
-{
-    //    Eigen::BenchTimer t;
+        get_number_of_zero_coefs(maxorder,
+                                 constraint,
+                                 x,
+                                 nzero_lasso);
 
-    if (verbosity > 0) {
-        std::cout << "  Solve least-squares problem by sparse LDLT." << std::endl;
-    }
-
-    SpMat AtA = sp_mat.transpose() * sp_mat;
-    Eigen::VectorXd AtB, x;
-    AtB = sp_mat.transpose() * sp_bvec;
-
-    /*
-        t.reset();
-        t.start();
-        Eigen::SparseQR<Eigen::SparseMatrix<double>, Eigen::COLAMDOrdering<int>> qr(sp_mat);
-        x = qr.solve(sp_bvec);
-    
-        t.stop();
-        std::cout << "sqr   : " << qr.info() << " ; " << t.value() 
-        << "s ;  err: " << (AtA * x - AtB).norm() / AtB.norm() << "\n";
-    
-        t.reset();
-        t.start();
-    */
-    Eigen::SimplicialLDLT<SpMat> ldlt(AtA);
-    x = ldlt.solve(AtB);
-    //       t.stop();
-    //   std::cout << "ldlt  : " << ldlt.info() << " ; " << t.value() << "s ;  err: " << (AtA*x-AtB).norm() / AtB.norm() << "\n";
-
-    /*
-         t.reset(); t.start();
-         Eigen::ConjugateGradient<SpMat> cg(AtA);
-         cg.setTolerance(optcontrol.tolerance_iteration);
-         cg.setMaxIterations(optcontrol.maxnum_iteration);
-         x.setZero(); x = cg.solve(AtB);
-         t.stop();
-         std::cout << "cg    : " << cg.info() << " ; " << t.value() << "s ;  err: " << (AtA*x-AtB).norm() / AtB.norm() << "\n";
-    */
-    /*   t.reset(); t.start();
-       Eigen::LeastSquaresConjugateGradient<SpMat> lscg(sp_mat);
-       lscg.setTolerance(eps10);
-       lscg.setMaxIterations(10000000);
-       x.setZero(); x = lscg.solve(sp_bvec);
-  
-       t.stop();
-       std::cout << "lscg  : " << lscg.info() << " ; " << t.value() << "s ;  err: " << (AtA*x-AtB).norm() / AtB.norm() << "\n";*/
-
-    /*
-         t.reset(); t.start();
-         Eigen::BiCGSTAB<SpMat> bicg(AtA);
-         bicg.setTolerance(optcontrol.tolerance_iteration);
-         bicg.setMaxIterations(optcontrol.maxnum_iteration);
-         x.setZero(); x = bicg.solve(AtB);
-         t.stop();
-         std::cout << "bicg    : " << bicg.info() << " ; " << t.value() << "s ;  err: " << (AtA*x-AtB).norm() / AtB.norm() << "\n";
-    
-    */
-    auto res = sp_bvec - sp_mat * x;
-    const auto res2norm = res.squaredNorm();
-    const auto nparams = x.size();
-    std::vector<double> param_irred(nparams);
+        training_error.push_back(std::sqrt(res1));
+        validation_error.push_back(std::sqrt(res2));
+        nonzeros.push_back(nzero_lasso);
 
-    for (auto i = 0; i < nparams; ++i) {
-        param_irred[i] = x(i);
-    }
+        if (optcontrol.save_solution_path) {
+            ofs_coef << std::setw(15) << l1_alpha;
 
-    if (ldlt.info() == Eigen::Success) {
-        // Recover reducible set of force constants
+            for (size_t i = 0; i < N_new; ++i) params_tmp[i] = x[i];
 
-        recover_original_forceconstants(maxorder,
-                                        param_irred,
-                                        param_out,
-                                        fcs->get_nequiv(),
-                                        constraint);
+            apply_scaler_force_constants(maxorder,
+                                         optcontrol.displacement_normalization_factor,
+                                         constraint,
+                                         params_tmp);
 
-        if (verbosity > 0) {
-            std::cout << "  Residual sum of squares for the solution: "
-                << sqrt(res2norm) << std::endl;
-            std::cout << "  Fitting error (%) : "
-                << sqrt(res2norm / (fnorm * fnorm)) * 100.0 << std::endl;
+            for (size_t i = 0; i < N_new; ++i) {
+                ofs_coef << std::setw(15) << params_tmp[i];
+            }
+            ofs_coef << std::endl;
         }
 
-        return 0;
+        if (verbosity == 1) {
 
-    } else {
+            std::cout << '.' << std::flush;
+            if (ialpha % 25 == 24) {
+                std::cout << std::endl;
+                std::cout << std::setw(3);
+            }
+        }
+    }
 
-        std::cerr << "  Fitting by LDLT failed." << std::endl;
-        std::cerr << ldlt.info() << std::endl;
+    if (verbosity == 1) std::cout << std::endl;
 
-        return 1;
-    }
+    if (optcontrol.save_solution_path) ofs_coef.close();
 }
 
-#endif
+void Optimize::get_standardizer(const SpMat &Amat,
+                                Eigen::VectorXd &mean,
+                                Eigen::VectorXd &dev,
+                                Eigen::VectorXd &factor_std,
+                                Eigen::VectorXd &scale_beta) const
+{
+    const auto nrows = Amat.rows();
+    const auto ncols = Amat.cols();
 
+    mean.resize(ncols);
+    dev.resize(ncols);
+    factor_std.resize(ncols);
+    scale_beta.resize(ncols);
 
-void Optimize::set_optimizer_control(const OptimizerControl &optcontrol_in)
-{
-    // Check the validity of the options before copying it.
+    const auto inv_nrows = 1.0 / static_cast<double>(nrows);
 
-    if (optcontrol_in.cross_validation < -1) {
-        exit("set_optimizer_control", "cross_validation must be -1, 0, or larger");
-    }
-    if (optcontrol_in.linear_model == 2) {
-        if (optcontrol_in.l1_ratio <= eps || optcontrol_in.l1_ratio > 1.0) {
-            exit("set_optimizer_control", "L1_RATIO must be 0 < L1_RATIO <= 1.");
+    for (auto j = 0; j < ncols; ++j) {
+        auto sum1 = 0.0;
+        auto sum2 = 0.0;
+        for (SpMat::InnerIterator it(Amat, j); it; ++it) {
+            sum1 += it.value();
+            sum2 += it.value() * it.value();
         }
+        sum1 *= inv_nrows;
+        sum2 *= inv_nrows;
 
-        if (optcontrol_in.cross_validation >= 1 || optcontrol_in.cross_validation == -1) {
-            if (optcontrol_in.l1_alpha_min >= optcontrol_in.l1_alpha_max) {
-                exit("set_optimizer_control", "L1_ALPHA_MIN must be smaller than L1_ALPHA_MAX.");
-            }
+        if (optcontrol.standardize) {
+            mean(j) = sum1;
+            dev(j) = std::sqrt(sum2 - sum1 * sum1);
+            factor_std(j) = 1.0 / dev(j);
+            scale_beta(j) = 1.0;
+        } else {
+            mean(j) = 0.0;
+            dev(j) = 1.0;
+            factor_std(j) = 1.0;
+            scale_beta(j) = 1.0 / sum2;
         }
     }
-
-    optcontrol = optcontrol_in;
 }
 
-OptimizerControl Optimize::get_optimizer_control() const
+double Optimize::get_esimated_max_alpha(const SpMat &Amat,
+                                        const Eigen::VectorXd &bvec,
+                                        const Eigen::VectorXd &mean,
+                                        const Eigen::VectorXd &dev) const
 {
-    return optcontrol;
+    const Eigen::VectorXd C = (Amat.transpose() * bvec - bvec.sum() * mean).cwiseQuotient(dev);
+    return C.cwiseAbs().maxCoeff() / static_cast<double>(Amat.rows());
 }
 
-
-void Optimize::coordinate_descent(const int M,
-                                  const int N,
-                                  const double alpha,
-                                  const int warm_start,
-                                  Eigen::VectorXd &x,
-                                  const Eigen::MatrixXd &A,
-                                  const Eigen::VectorXd &b,
-                                  const Eigen::VectorXd &grad0,
-                                  bool *has_prod,
-                                  Eigen::MatrixXd &Prod,
-                                  Eigen::VectorXd &grad,
-                                  const double fnorm,
-                                  const Eigen::VectorXd &scale_beta,
-                                  const int verbosity) const
+void Optimize::coordinate_descent_sparse(const int M,
+                                         const int N,
+                                         const double alpha,
+                                         const double alpha_prev,
+                                         const int warm_start,
+                                         Eigen::VectorXd &x,
+                                         const SpMat &A,
+                                         const Eigen::VectorXd &b,
+                                         const Eigen::VectorXd &mean,
+                                         const Eigen::VectorXd &dev,
+                                         const Eigen::VectorXd &scale_beta,
+                                         const int verbosity) const
 {
-    int i, j;
+    // Coordinate descent with the columns of the sparse matrix A.
+    // The standardized matrix (A - 1 mean^T) D^{-1} is not formed. Instead, the residual
+    // r = b - (A - 1 mean^T) D^{-1} beta is kept as r_sp + shift * 1, so that
+    // an update of beta(j) touches only the nonzero elements of the j-th column of A.
+    // The screening and the active-set cycling are the same as coordinate_descent.
+
+    int i;
     double diff{0.0};
-    Eigen::VectorXd beta(N), delta(N);
-    Eigen::VectorXd res(N);
-    bool do_print_log;
+    Eigen::VectorXd beta(N), colsum(N);
 
     if (warm_start) {
-        for (i = 0; i < N; ++i) beta(i) = x(i);
+        beta = x;
     } else {
-        for (i = 0; i < N; ++i) beta(i) = 0.0;
-        grad = grad0;
+        beta.setZero();
+    }
+
+    for (i = 0; i < N; ++i) {
+        colsum(i) = 0.0;
+        for (SpMat::InnerIterator it(A, i); it; ++it) colsum(i) += it.value();
     }
 
+    const Eigen::VectorXd z = beta.cwiseQuotient(dev);
+    Eigen::VectorXd r_sp = b - A * z;
+    auto shift = mean.dot(z);
+    auto sum_r_sp = r_sp.sum();
+
+    // j-th element of A_std^T r
+    auto get_gradient = [&](const int j)
+    {
+        auto dot = 0.0;
+        for (SpMat::InnerIterator it(A, j); it; ++it) dot += it.value() * r_sp(it.row());
+        return (dot + shift * colsum(j) - mean(j) * (sum_r_sp + static_cast<double>(M) * shift)) / dev(j);
+    };
+
     if (verbosity > 1) {
         std::cout << "-----------------------------------------------------------------" << std::endl;
         std::cout << "  L1_ALPHA = " << std::setw(15) << alpha << std::endl;
@@ -2585,135 +6471,109 @@ void Optimize::coordinate_descent(const int M,
     const auto Minv = 1.0 / static_cast<double>(M);
     const auto alphlambda = alpha * optcontrol.l1_ratio;
 
-    auto iloop = 0;
+    std::vector<double> grad_abs(N);
+    for (i = 0; i < N; ++i) grad_abs[i] = Minv * std::abs(get_gradient(i));
 
-    if (optcontrol.standardize) {
-        while (iloop < optcontrol.maxnum_iteration) {
-            do_print_log = !((iloop + 1) % optcontrol.output_frequency) && (verbosity > 1);
+    auto lambda_prev = alpha_prev * optcontrol.l1_ratio;
+    if (!warm_start || alpha_prev <= 0.0) {
+        lambda_prev = 0.0;
+        for (i = 0; i < N; ++i) {
+            if (beta(i) == 0.0) lambda_prev = std::max(lambda_prev, grad_abs[i]);
+        }
+        lambda_prev = std::max(lambda_prev, alphlambda);
+    }
+    const auto threshold_strong = 2.0 * alphlambda - lambda_prev;
 
-            if (do_print_log) {
-                std::cout << "   Coordinate Descent : " << std::setw(5) << iloop + 1 << std::endl;
-            }
-            delta = beta;
-            for (i = 0; i < N; ++i) {
-                beta(i) = shrink(Minv * grad(i) + beta(i), alphlambda);
-                delta(i) -= beta(i);
-                if (std::abs(delta(i)) > 0.0) {
-                    if (!has_prod[i]) {
-#pragma omp parallel for
-                        for (j = 0; j < N; ++j) {
-                            Prod(j, i) = A.col(j).dot(A.col(i));
-                        }
-                        has_prod[i] = true;
-                    }
-                    grad = grad + Prod.col(i) * delta(i);
-                }
+    std::vector<int> strong_set, active_set;
+    std::vector<bool> is_strong(N, false);
+    for (i = 0; i < N; ++i) {
+        if (beta(i) != 0.0 || grad_abs[i] >= threshold_strong) {
+            strong_set.push_back(i);
+            is_strong[i] = true;
+        }
+    }
+
+    auto sweep = [&](const std::vector<int> &indices)
+    {
+        auto delta2 = 0.0;
+        for (const auto j : indices) {
+            const auto beta_old = beta(j);
+            const auto grad_j = get_gradient(j);
+            if (optcontrol.standardize) {
+                beta(j) = shrink(Minv * grad_j + beta(j), alphlambda);
+            } else {
+                beta(j) = shrink(Minv * grad_j + beta(j) / scale_beta(j), alphlambda) * scale_beta(j);
             }
-            ++iloop;
-            diff = 0.0;
-#pragma omp parallel for reduction(+:diff)
-            for (i = 0; i < N; ++i) {
-                diff += delta(i) * delta(i);
+            const auto delta = beta(j) - beta_old;
+            if (std::abs(delta) > 0.0) {
+                const auto delta_z = delta / dev(j);
+                for (SpMat::InnerIterator it(A, j); it; ++it) r_sp(it.row()) -= delta_z * it.value();
+                sum_r_sp -= delta_z * colsum(j);
+                shift += delta_z * mean(j);
+                delta2 += delta * delta;
             }
-            diff = std::sqrt(diff / static_cast<double>(N));
-            //diff = std::sqrt(delta.dot(delta) / static_cast<double>(N));
+        }
+        return std::sqrt(delta2 / static_cast<double>(N));
+    };
 
-            if (diff < optcontrol.tolerance_iteration) break;
+    auto iloop = 0;
+    auto nkkt_violation = 0;
 
-            if (do_print_log) {
-                std::cout << "    1: ||u_{k}-u_{k-1}||_2     = " << std::setw(15) << diff
-                    << std::setw(15) << diff * std::sqrt(static_cast<double>(N) / beta.dot(beta)) << std::endl;
-                auto tmp = 0.0;
-#ifdef _OPENMP
-#pragma omp parallel for reduction(+:tmp)
-#endif
-                for (i = 0; i < N; ++i) {
-                    tmp += std::abs(beta(i));
-                }
-                std::cout << "    2: ||u_{k}||_1             = " << std::setw(15) << tmp << std::endl;
-                res = A * beta - b;
-                tmp = res.dot(res);
-                std::cout << "    3: ||Au_{k}-f||_2          = " << std::setw(15) << std::sqrt(tmp)
-                    << std::setw(15) << std::sqrt(tmp / (fnorm * fnorm)) << std::endl;
-                std::cout << std::endl;
-            }
-        }
-    } else {
-        // Non-standardized version. Needs additional operations
-        while (iloop < optcontrol.maxnum_iteration) {
-            do_print_log = !((iloop + 1) % optcontrol.output_frequency) && (verbosity > 1);
+    while (iloop < optcontrol.maxnum_iteration) {
 
-            if (do_print_log) {
-                std::cout << "   Coordinate Descent : " << std::setw(5) << iloop + 1 << std::endl;
-            }
-            delta = beta;
+        diff = sweep(strong_set);
+        ++iloop;
+
+        if (diff < optcontrol.tolerance_iteration) {
+            auto nviolation = 0;
             for (i = 0; i < N; ++i) {
-                beta(i) = shrink(Minv * grad(i) + beta(i) / scale_beta(i), alphlambda) * scale_beta(i);
-                delta(i) -= beta(i);
-                if (std::abs(delta(i)) > 0.0) {
-                    if (!has_prod[i]) {
-                        for (j = 0; j < N; ++j) {
-                            Prod(j, i) = A.col(j).dot(A.col(i));
-                        }
-                        has_prod[i] = true;
-                    }
-                    grad = grad + Prod.col(i) * delta(i);
+                if (!is_strong[i] && Minv * std::abs(get_gradient(i)) > alphlambda) {
+                    strong_set.push_back(i);
+                    is_strong[i] = true;
+                    ++nviolation;
                 }
             }
-            ++iloop;
-            diff = std::sqrt(delta.dot(delta) / static_cast<double>(N));
+            if (nviolation == 0) break;
+            std::sort(strong_set.begin(), strong_set.end());
+            nkkt_violation += nviolation;
+            continue;
+        }
+
+        active_set.clear();
+        for (const auto j : strong_set) {
+            if (beta(j) != 0.0) active_set.push_back(j);
+        }
 
+        while (iloop < optcontrol.maxnum_iteration) {
+            diff = sweep(active_set);
+            ++iloop;
             if (diff < optcontrol.tolerance_iteration) break;
 
-            if (do_print_log) {
-                std::cout << "    1: ||u_{k}-u_{k-1}||_2     = " << std::setw(15) << diff
-                    << std::setw(15) << diff * std::sqrt(static_cast<double>(N) / beta.dot(beta)) << std::endl;
-                auto tmp = 0.0;
-#ifdef _OPENMP
-#pragma omp parallel for reduction(+:tmp)
-#endif
-                for (i = 0; i < N; ++i) {
-                    tmp += std::abs(beta(i));
-                }
-                std::cout << "    2: ||u_{k}||_1             = " << std::setw(15) << tmp << std::endl;
-                res = A * beta - b;
-                tmp = res.dot(res);
-                std::cout << "    3: ||Au_{k}-f||_2          = " << std::setw(15) << std::sqrt(tmp)
-                    << std::setw(15) << std::sqrt(tmp / (fnorm * fnorm)) << std::endl;
+            if (verbosity > 1 && !(iloop % optcontrol.output_frequency)) {
+                std::cout << "   Coordinate Descent : " << std::setw(5) << iloop << std::endl;
+                std::cout << "    1: ||u_{k}-u_{k-1}||_2     = " << std::setw(15) << diff << std::endl;
+                std::cout << "    2: ||u_{k}||_1             = " << std::setw(15) << beta.lpNorm<1>() << std::endl;
                 std::cout << std::endl;
             }
         }
     }
 
     if (verbosity > 1) {
+        std::cout << "  Size of the strong set : " << strong_set.size()
+            << " (KKT violations : " << nkkt_violation << ")" << std::endl;
         if (iloop >= optcontrol.maxnum_iteration) {
             std::cout << "WARNING: Convergence NOT achieved within " << optcontrol.maxnum_iteration
                 << " coordinate descent iterations." << std::endl;
         } else {
             std::cout << "  Convergence achieved in " << iloop << " iterations." << std::endl;
         }
-        const auto param2norm = beta.dot(beta);
-        if (std::abs(param2norm) < eps) {
-            std::cout << "    1': ||u_{k}-u_{k-1}||_2     = " << std::setw(15) << 0.0
-                << std::setw(15) << 0.0 << std::endl;
-        } else {
-            std::cout << "    1': ||u_{k}-u_{k-1}||_2     = " << std::setw(15) << diff
-                << std::setw(15) << diff * std::sqrt(static_cast<double>(N) / param2norm) << std::endl;
-        }
-        double tmp = 0.0;
-#ifdef _OPENMP
-#pragma omp parallel for reduction(+:tmp)
-#endif
-        for (i = 0; i < N; ++i) {
-            tmp += std::abs(beta(i));
-        }
-        std::cout << "    2': ||u_{k}||_1             = " << std::setw(15) << tmp << std::endl;
-        res = A * beta - b;
-        tmp = res.dot(res);
-        std::cout << "    3': ||Au_{k}-f||_2          = " << std::setw(15) << std::sqrt(tmp)
-            << std::setw(15) << std::sqrt(tmp / (fnorm * fnorm)) << std::endl;
+        std::cout << "    1': ||u_{k}-u_{k-1}||_2     = " << std::setw(15) << diff << std::endl;
+        std::cout << "    2': ||u_{k}||_1             = " << std::setw(15) << beta.lpNorm<1>() << std::endl;
+        const auto res = std::sqrt((r_sp.array() + shift).square().sum());
+        std::cout << "    3': ||Au_{k}-f||_2          = " << std::setw(15) << res << std::endl;
         std::cout << std::endl;
     }
 
-    for (i = 0; i < N; ++i) x[i] = beta(i);
+    x = beta;
 }
+#endif
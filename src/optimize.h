@@ -10,6 +10,9 @@
 
 #pragma once
 
+#include <functional>
+#include <list>
+#include <string>
 #include <vector>
 #include "files.h"
 #ifdef WITH_SPARSE_SOLVER
@@ -32,14 +35,20 @@ namespace ALM_NS
         // General optimization options
         int linear_model;      // 1 : least-squares, 2 : elastic net
         int use_sparse_solver; // 0: No, 1: Yes
+        std::string sparsesolver; // Solver used when use_sparse_solver = 1
+        std::string densesolver;  // Solver used when use_sparse_solver = 0 (SVD, QR, TSQR, Cholesky, or SketchLSQR)
         int maxnum_iteration;
         double tolerance_iteration;
         int output_frequency;
+        int ndata_chunk;       // 0: use all data at once, > 0: number of entries accumulated at a time (OLS only)
+        int nrows_panel;       // rows of the dense sensing matrix assembled at once by a thread (0: automatic)
+        int incremental;       // 0: refit from scratch, 1: update the R factor with newly appended entries (OLS only)
 
         // Options related to L1-regularized optimization
         int standardize;
         double displacement_normalization_factor;
         int debiase_after_l1opt;
+        std::string enet_solver; // CD (coordinate descent), FISTA (accelerated proximal gradient), or LARS
 
         // cross-validation related variables
         int cross_validation; // 0 : No CV mode, -1 or > 0: CV mode
@@ -49,17 +58,26 @@ namespace ALM_NS
         int num_l1_alpha;
         double l1_ratio; // l1_ratio = 1 for LASSO; 0 < l1_ratio < 1 for Elastic net
         int save_solution_path;
+        double gram_cache_mb; // memory for the columns of A^T A in MB (0: no limit)
+        int parallel_cv;      // 0: run the CV folds one by one, 1: run them concurrently (CV > 0 only)
+        int cv_patience;      // 0: solve all alphas, > 0: stop after the validation error increased this many times
 
         OptimizerControl()
         {
             linear_model = 1;
             use_sparse_solver = 0;
+            sparsesolver = "SimplicialLDLT";
+            densesolver = "SVD";
             maxnum_iteration = 10000;
             tolerance_iteration = 1.0e-8;
             output_frequency = 1000;
+            ndata_chunk = 0;
+            nrows_panel = 0;
+            incremental = 0;
             standardize = 1;
             displacement_normalization_factor = 1.0;
             debiase_after_l1opt = 0;
+            enet_solver = "CD";
             cross_validation = 0;
             l1_alpha = 0.0;
             l1_alpha_min = 1.0e-4;
@@ -67,6 +85,9 @@ namespace ALM_NS
             l1_ratio = 1.0;
             num_l1_alpha = 1;
             save_solution_path = 0;
+            gram_cache_mb = 0.0;
+            parallel_cv = 0;
+            cv_patience = 0;
         }
 
         ~OptimizerControl() = default;
@@ -74,6 +95,158 @@ namespace ALM_NS
         OptimizerControl& operator=(const OptimizerControl &obj) = default;
     };
 
+    class SensingMatrixPlan
+    {
+    public:
+        // Flat list of the terms contributing to a row block of the sensing matrix.
+        // The terms are stored in the same order as fc_table for each order.
+        int maxorder;
+        size_t ncols;                          // number of reducible parameters
+        std::vector<std::vector<int>> row;     // [order][iterm]: 3 * (atom index in primitive cell) + xyz
+        std::vector<std::vector<size_t>> col;  // [order][iterm]: index of the reducible parameter
+        std::vector<std::vector<double>> coef; // [order][iterm]: -gamma * sign
+        std::vector<std::vector<int>> disp;    // [order][(order + 1) * iterm + j]: indices of displacements
+        std::vector<std::vector<int>> index_tran; // [itran][3 * iat + xyz]: index of the original data
+                                                  // moved to 3 * iat + xyz by the itran-th translation
+        // Inverted index from a displacement to the terms whose first displacement it is.
+        // The terms of term_index[order][term_ptr[order][idisp]:term_ptr[order][idisp + 1]]
+        // have disp[order][(order + 1) * iterm] == idisp.
+        std::vector<std::vector<size_t>> term_ptr;   // [order][3 * nat + 1]
+        std::vector<std::vector<size_t>> term_index; // [order][iterm]
+
+        // Generations of the fcs and symmetry from which the plan was compiled.
+        // fc_table is regenerated by Fcs::init also when the clusters are changed.
+        size_t fcs_generation;
+        size_t symmetry_generation;
+
+        SensingMatrixPlan()
+        {
+            maxorder = 0;
+            ncols = 0;
+            fcs_generation = 0;
+            symmetry_generation = 0;
+        }
+
+        bool is_built_for(const int maxorder_in,
+                          const Symmetry *symmetry,
+                          const Fcs *fcs) const
+        {
+            return maxorder_in == maxorder
+                && fcs->get_generation() == fcs_generation
+                && symmetry->get_generation() == symmetry_generation;
+        }
+    };
+
+    class ConstraintTransform
+    {
+    public:
+        // Algebraic constraints written as x = T y + x0, where x is the vector of all
+        // (reducible) parameters and y that of the free parameters.
+        // T (ncols x ncols_new) is stored row by row (CSR format), and
+        // x0 holds the values of the fixed parameters.
+        size_t ncols;
+        size_t ncols_new;
+        std::vector<size_t> row_ptr;
+        std::vector<size_t> col_index;
+        std::vector<double> values;
+        std::vector<double> offset;
+
+        ConstraintTransform()
+        {
+            ncols = 0;
+            ncols_new = 0;
+        }
+    };
+
+    class IncrementalFactor
+    {
+    public:
+        // R factor of the QR decomposition of the sensing matrix built from
+        // the first ndata entries of the training data, which is updated
+        // when new entries are appended.
+        size_t ncols;             // number of columns of the sensing matrix
+        size_t ndata;             // number of entries absorbed in rmat
+        std::vector<double> rmat; // upper-triangular R (ncols x ncols, column-major)
+        std::vector<double> qtb;  // first ncols elements of Q^T b
+        double residual2;         // |Q^T b|^2 of the remaining elements, i.e., the squared residual
+        double fnorm2;            // squared norm of the absorbed forces
+
+        // Generation of the fcs for which the factor was built.
+        size_t fcs_generation;
+
+        IncrementalFactor()
+        {
+            reset(0, 0);
+        }
+
+        void reset(const size_t ncols_in,
+                   const size_t fcs_generation_in)
+        {
+            ncols = ncols_in;
+            ndata = 0;
+            rmat.assign(ncols * ncols, 0.0);
+            qtb.assign(ncols, 0.0);
+            residual2 = 0.0;
+            fnorm2 = 0.0;
+            fcs_generation = fcs_generation_in;
+        }
+    };
+
+    class GramCache
+    {
+    public:
+        // Columns of the Gram matrix A^T A used in the coordinate descent.
+        // At most max_columns columns are kept. A column which has not been
+        // used during the current sweep is replaced when a new column is needed.
+        // When all the kept columns are in use, new columns are not kept
+        // and are recomputed in the next sweep, which avoids the thrashing of
+        // the LRU replacement in the cyclic access of the coordinate descent.
+        // Missing columns are computed together with those of the following
+        // nonzero coefficients by a matrix-matrix product.
+        // The columns are those of the standardized matrix (A - 1 mean^T) D^{-1}
+        // with D = diag(dev), which is not formed. A_in must outlive the cache.
+        GramCache(const Eigen::Ref<const Eigen::MatrixXd> &A_in,
+                  const Eigen::VectorXd &mean,
+                  const Eigen::VectorXd &dev,
+                  const double memory_mb);
+
+        // The columns are given by compute_panel(columns, panel), which stores
+        // the requested columns in panel (ncols x columns.size()).
+        GramCache(const size_t ncols_in,
+                  std::function<void(const std::vector<size_t> &, Eigen::MatrixXd &)> compute_panel_in,
+                  const double memory_mb);
+
+        Eigen::Ref<const Eigen::VectorXd> get_column(const size_t icol,
+                                                     const Eigen::VectorXd &beta);
+
+        size_t get_max_columns() const;
+        size_t get_number_of_computed_columns() const;
+
+    private:
+        std::function<void(const std::vector<size_t> &, Eigen::MatrixXd &)> compute_panel;
+        size_t ncols;
+        size_t max_columns;
+        size_t npanel_max;
+        size_t ncomputed;
+        size_t isweep;
+        size_t icol_prev;
+        std::vector<Eigen::VectorXd> columns; // [slot]
+        std::vector<long> slot_of_column;     // [icol]: -1 if not kept
+        std::vector<size_t> column_of_slot;   // [slot]
+        std::vector<size_t> sweep_of_slot;    // [slot]: sweep in which the column was used last
+        std::list<size_t> lru;                // slots, the most recently used first
+        std::vector<std::list<size_t>::iterator> lru_pos; // [slot]
+        Eigen::MatrixXd panel;                // columns of the last panel
+        std::vector<size_t> panel_columns;
+
+        long get_free_slot();
+
+        static std::function<void(const std::vector<size_t> &, Eigen::MatrixXd &)>
+        standardized_panel(const Eigen::Ref<const Eigen::MatrixXd> &A_in,
+                           const Eigen::VectorXd &mean,
+                           const Eigen::VectorXd &dev);
+    };
+
     class Optimize
     {
     public:
@@ -91,9 +264,24 @@ namespace ALM_NS
                           const DispForceFile &filedata_validation,
                           Timer *timer);
 
+        int optimize_multiple_rhs(const Symmetry *symmetry,
+                                  const Constraint *constraint,
+                                  const Fcs *fcs,
+                                  const int maxorder,
+                                  const std::vector<std::vector<double>> &u_in,
+                                  const std::vector<std::vector<std::vector<double>>> &f_in,
+                                  const int verbosity,
+                                  std::vector<std::vector<double>> &fc_irred_out,
+                                  Timer *timer);
+
         void set_training_data(const std::vector<std::vector<double>> &u_train_in,
                                const std::vector<std::vector<double>> &f_train_in);
 
+        void append_training_data(const std::vector<std::vector<double>> &u_train_in,
+                                  const std::vector<std::vector<double>> &f_train_in);
+
+        void reset_incremental_factor();
+
         void set_validation_data(const std::vector<std::vector<double>> &u_validation_in,
                                  const std::vector<std::vector<double>> &f_validation_in);
 
@@ -117,6 +305,10 @@ namespace ALM_NS
                             const Constraint *constraint);
 
 
+        void update_sensing_matrix_plan(const int maxorder,
+                                        const Symmetry *symmetry,
+                                        const Fcs *fcs);
+
         size_t get_number_of_rows_sensing_matrix() const;
         double* get_params() const;
 
@@ -131,18 +323,65 @@ namespace ALM_NS
         std::vector<std::vector<double>> u_validation, f_validation;
 
         OptimizerControl optcontrol;
+        SensingMatrixPlan matrix_plan;
+        IncrementalFactor incremental_factor;
 
         void set_default_variables();
         void deallocate_variables();
 
-        void data_multiplier(const std::vector<std::vector<double>> &,
-                             std::vector<std::vector<double>> &,
-                             const Symmetry *) const;
-
         int inprim_index(const int,
                          const Symmetry *) const;
 
-        int least_squares(const int maxorder,
+        void build_sensing_matrix_plan(const int maxorder,
+                                       const Symmetry *symmetry,
+                                       const Fcs *fcs,
+                                       SensingMatrixPlan &plan_out) const;
+
+        const SensingMatrixPlan& get_sensing_matrix_plan(const int maxorder,
+                                                         const Symmetry *symmetry,
+                                                         const Fcs *fcs,
+                                                         SensingMatrixPlan &plan_tmp) const;
+
+        bool get_nonzero_displacements(const SensingMatrixPlan &plan,
+                                       const std::vector<double> &u_in,
+                                       const int *index_tran,
+                                       std::vector<int> &disp_nonzero) const;
+
+        void accumulate_sensing_matrix_rows(const SensingMatrixPlan &plan,
+                                            const std::vector<double> &u_in,
+                                            const int *index_tran,
+                                            const std::vector<int> &disp_nonzero,
+                                            const bool use_index,
+                                            double *amat_block,
+                                            const size_t ld) const;
+
+        void build_constraint_transform(const int maxorder,
+                                        const Fcs *fcs,
+                                        const Constraint *constraint,
+                                        ConstraintTransform &transform_out) const;
+
+        void accumulate_reduced_sensing_matrix_rows(const SensingMatrixPlan &plan,
+                                                    const ConstraintTransform &transform,
+                                                    const std::vector<double> &u_in,
+                                                    const int *index_tran,
+                                                    const std::vector<int> &disp_nonzero,
+                                                    const bool use_index,
+                                                    double *amat_block,
+                                                    const size_t ld,
+                                                    double *bvec_block) const;
+
+        size_t get_number_of_blocks_per_panel(const size_t nblocks,
+                                              const size_t nrows_block,
+                                              const size_t ncols) const;
+
+        void get_force_vector(const int maxorder,
+                              const std::vector<std::vector<double>> &f_in,
+                              std::vector<double> &fvec,
+                              const Symmetry *symmetry,
+                              const Fcs *fcs) const;
+
+        int least_squares(const std::string job_prefix,
+                          const int maxorder,
                           const size_t N,
                           const size_t N_new,
                           const size_t M,
@@ -152,6 +391,36 @@ namespace ALM_NS
                           const Constraint *constraint,
                           std::vector<double> &param_out);
 
+        int run_least_squares_crossvalidation(const std::string file_cvscore,
+                                              const size_t N,
+                                              const size_t M,
+                                              const double *amat,
+                                              const double *bvec,
+                                              const int verbosity) const;
+
+        int least_squares_chunked(const int maxorder,
+                                  const size_t N,
+                                  const size_t N_new,
+                                  const DispForceFile &filedata_train,
+                                  const int verbosity,
+                                  const Symmetry *symmetry,
+                                  const Fcs *fcs,
+                                  const Constraint *constraint,
+                                  std::vector<double> &param_out);
+
+        int least_squares_incremental(const int maxorder,
+                                      const size_t N,
+                                      const size_t N_new,
+                                      const int verbosity,
+                                      const Symmetry *symmetry,
+                                      const Fcs *fcs,
+                                      const Constraint *constraint,
+                                      std::vector<double> &param_out);
+
+        void update_incremental_factor(const size_t nrows,
+                                       std::vector<double> &amat,
+                                       std::vector<double> &bvec);
+
         int elastic_net(const std::string job_prefix,
                         const int maxorder,
                         const size_t N_new,
@@ -185,6 +454,13 @@ namespace ALM_NS
                              const Constraint *constraint,
                              const int verbosity);
 
+        void run_enetcv_parallel(const std::string job_prefix,
+                                 const int maxorder,
+                                 const Fcs *fcs,
+                                 const Symmetry *symmetry,
+                                 const Constraint *constraint,
+                                 const int verbosity);
+
         void write_cvresult_to_file(const std::string file_out,
                                     const std::vector<double> &alphas,
                                     const std::vector<double> &training_error,
@@ -208,8 +484,10 @@ namespace ALM_NS
                                          const int verbosity,
                                          std::vector<double> &param_out) const;
 
-        int run_least_squares_with_nonzero_coefs(const Eigen::MatrixXd &A_in,
+        int run_least_squares_with_nonzero_coefs(const Eigen::Ref<const Eigen::MatrixXd> &A_in,
                                                  const Eigen::VectorXd &b_in,
+                                                 const Eigen::VectorXd &mean,
+                                                 const Eigen::VectorXd &dev,
                                                  const Eigen::VectorXd &factor_std,
                                                  std::vector<double> &params_inout,
                                                  const int verbosity) const;
@@ -219,18 +497,14 @@ namespace ALM_NS
                                       const Eigen::VectorXd &x,
                                       std::vector<int> &nzeros) const;
 
-        void get_standardizer(const Eigen::MatrixXd &Amat,
+        void get_standardizer(const Eigen::Ref<const Eigen::MatrixXd> &Amat,
                               Eigen::VectorXd &mean,
                               Eigen::VectorXd &dev,
                               Eigen::VectorXd &factor_std,
                               Eigen::VectorXd &scale_beta) const;
 
-        void apply_standardizer(Eigen::MatrixXd &Amat,
-                                const Eigen::VectorXd &mean,
-                                const Eigen::VectorXd &dev) const;
-
-        double get_esimated_max_alpha(const Eigen::MatrixXd &Amat,
-                                      const Eigen::VectorXd &bvec,
+        double get_esimated_max_alpha(const Eigen::Ref<const Eigen::MatrixXd> &Amat,
+                                      const Eigen::Ref<const Eigen::VectorXd> &bvec,
                                       const Eigen::VectorXd &mean,
                                       const Eigen::VectorXd &dev) const;
 
@@ -272,6 +546,70 @@ namespace ALM_NS
                                       const Constraint *constraint,
                                       const int verbosity) const;
 
+        int solve_dense_least_squares(const size_t N,
+                                      const size_t M,
+                                      const size_t nrhs,
+                                      double *amat,
+                                      double *fsum2,
+                                      int &nrank,
+                                      std::vector<double> &f_residual,
+                                      const int verbosity) const;
+
+        int solve_normal_equation(const size_t N,
+                                  const std::vector<double> &AtA,
+                                  const std::vector<double> &Atb,
+                                  std::vector<double> &param_out,
+                                  int &nrank,
+                                  const int verbosity) const;
+
+        int solve_triangular_factor(const size_t N,
+                                    const double *rmat,
+                                    const int ldr,
+                                    double *rhs,
+                                    const int ldrhs,
+                                    const size_t nrhs,
+                                    int &nrank,
+                                    const int verbosity) const;
+
+        void factorize_qr(const size_t M,
+                          const size_t N,
+                          double *amat,
+                          const size_t lda,
+                          double *bvec,
+                          const size_t ldb,
+                          const size_t nrhs) const;
+
+        void factorize_tsqr(const size_t N,
+                            const size_t M,
+                            const size_t nrhs,
+                            double *amat,
+                            double *fsum2,
+                            std::vector<double> &f_residual) const;
+
+        bool run_lsqr(const std::function<void(const Eigen::VectorXd &, Eigen::VectorXd &)> &apply_A,
+                      const std::function<void(const Eigen::VectorXd &, Eigen::VectorXd &)> &apply_At,
+                      const size_t ncols,
+                      const Eigen::VectorXd &bvec,
+                      Eigen::VectorXd &y,
+                      int &niter) const;
+
+        void get_sketch_embedding(const size_t nrows,
+                                  const size_t ncols,
+                                  std::vector<int> &rows,
+                                  std::vector<double> &values) const;
+
+        void get_sketch(const Eigen::Ref<const Eigen::MatrixXd> &A,
+                        Eigen::MatrixXd &SA) const;
+
+        bool get_sketch_preconditioner(Eigen::MatrixXd &SA,
+                                       double &rcond) const;
+
+        bool solve_cholesky(const size_t N,
+                            std::vector<double> &mat,
+                            std::vector<double> &rhs,
+                            double &rcond,
+                            const size_t nrhs) const;
+
         int fit_with_constraints(const size_t N,
                                  const size_t M,
                                  const size_t P,
@@ -282,6 +620,18 @@ namespace ALM_NS
                                  double *dvec,
                                  const int verbosity) const;
 
+        int fit_null_space(const size_t N,
+                           const size_t M,
+                           const size_t nrhs,
+                           const double *amat,
+                           const double *bvec,
+                           const size_t ldb,
+                           double *param_out,
+                           const int maxorder,
+                           const Fcs *fcs,
+                           const Constraint *constraint,
+                           const int verbosity) const;
+
 
         void get_matrix_elements(const int maxorder,
                                  std::vector<double> &amat,
@@ -302,14 +652,79 @@ namespace ALM_NS
                                                 const Fcs *fcs,
                                                 const Constraint *constraint) const;
 
-        int run_eigen_sparseQR(const SpMat &,
-                               const Eigen::VectorXd &,
-                               std::vector<double> &,
-                               const double,
-                               const int,
-                               const Fcs *,
-                               const Constraint *,
-                               const int) const;
+        int run_sparse_solver(const SpMat &,
+                              const Eigen::VectorXd &,
+                              std::vector<double> &,
+                              const double,
+                              const int,
+                              const Fcs *,
+                              const Constraint *,
+                              const int) const;
+
+        void get_normal_matrix(const SpMat &A,
+                               SpMat &AtA) const;
+
+        bool run_lsqr(const SpMat &sp_mat,
+                      const Eigen::VectorXd &sp_bvec,
+                      Eigen::VectorXd &x,
+                      int &niter) const;
+
+        bool run_sketch_lsqr(const SpMat &sp_mat,
+                             const Eigen::VectorXd &sp_bvec,
+                             Eigen::VectorXd &x,
+                             int &niter,
+                             const int verbosity) const;
+
+        void get_sketch(const SpMat &A,
+                        Eigen::MatrixXd &SA) const;
+
+        int run_elastic_net_optimization_sparse(const int maxorder,
+                                                const size_t M,
+                                                const size_t N_new,
+                                                const Fcs *fcs,
+                                                const Symmetry *symmetry,
+                                                const Constraint *constraint,
+                                                const int verbosity,
+                                                std::vector<double> &param_out) const;
+
+        void run_enet_solution_path_sparse(const int maxorder,
+                                           const SpMat &A,
+                                           const Eigen::VectorXd &b,
+                                           const SpMat &A_validation,
+                                           const Eigen::VectorXd &b_validation,
+                                           const double fnorm,
+                                           const double fnorm_validation,
+                                           const std::string file_coef,
+                                           const int verbosity,
+                                           const Constraint *constraint,
+                                           const std::vector<double> &alphas,
+                                           std::vector<double> &training_error,
+                                           std::vector<double> &validation_error,
+                                           std::vector<std::vector<int>> &nonzeros) const;
+
+        void get_standardizer(const SpMat &Amat,
+                              Eigen::VectorXd &mean,
+                              Eigen::VectorXd &dev,
+                              Eigen::VectorXd &factor_std,
+                              Eigen::VectorXd &scale_beta) const;
+
+        double get_esimated_max_alpha(const SpMat &Amat,
+                                      const Eigen::VectorXd &bvec,
+                                      const Eigen::VectorXd &mean,
+                                      const Eigen::VectorXd &dev) const;
+
+        void coordinate_descent_sparse(const int M,
+                                       const int N,
+                                       const double alpha,
+                                       const double alpha_prev,
+                                       const int warm_start,
+                                       Eigen::VectorXd &x,
+                                       const SpMat &A,
+                                       const Eigen::VectorXd &b,
+                                       const Eigen::VectorXd &mean,
+                                       const Eigen::VectorXd &dev,
+                                       const Eigen::VectorXd &scale_beta,
+                                       const int verbosity) const;
 #endif
 
         void recover_original_forceconstants(const int maxorder,
@@ -330,23 +745,55 @@ namespace ALM_NS
         void coordinate_descent(const int M,
                                 const int N,
                                 const double alpha,
+                                const double alpha_prev,
                                 const int warm_start,
                                 Eigen::VectorXd &x,
-                                const Eigen::MatrixXd &A,
-                                const Eigen::VectorXd &b,
+                                const Eigen::Ref<const Eigen::MatrixXd> &A,
+                                const Eigen::Ref<const Eigen::VectorXd> &b,
+                                const Eigen::VectorXd &mean,
+                                const Eigen::VectorXd &dev,
                                 const Eigen::VectorXd &grad0,
-                                bool *has_prod,
-                                Eigen::MatrixXd &Prod,
+                                GramCache &gram,
                                 Eigen::VectorXd &grad,
                                 const double fnorm,
                                 const Eigen::VectorXd &scale_beta,
                                 const int verbosity) const;
 
+        void setup_proximal_gradient(const Eigen::Ref<const Eigen::MatrixXd> &A,
+                                     const Eigen::VectorXd &mean,
+                                     const Eigen::VectorXd &dev,
+                                     Eigen::MatrixXd &Gram,
+                                     double &lipschitz) const;
+
+        void proximal_gradient(const int M,
+                               const int N,
+                               const double alpha,
+                               const int warm_start,
+                               Eigen::VectorXd &x,
+                               const Eigen::Ref<const Eigen::MatrixXd> &A,
+                               const Eigen::Ref<const Eigen::VectorXd> &b,
+                               const Eigen::VectorXd &mean,
+                               const Eigen::VectorXd &dev,
+                               const Eigen::VectorXd &grad0,
+                               const Eigen::MatrixXd &Gram,
+                               const double lipschitz,
+                               Eigen::VectorXd &grad,
+                               const double fnorm,
+                               const int verbosity) const;
+
+        void lars_path(const Eigen::Ref<const Eigen::MatrixXd> &A,
+                       const Eigen::VectorXd &mean,
+                       const Eigen::VectorXd &dev,
+                       const Eigen::VectorXd &grad0,
+                       const std::vector<double> &alphas,
+                       Eigen::MatrixXd &X,
+                       const int verbosity) const;
+
         void run_enet_solution_path(const int maxorder,
-                                    Eigen::MatrixXd &A,
-                                    Eigen::VectorXd &b,
-                                    Eigen::MatrixXd &A_validation,
-                                    Eigen::VectorXd &b_validation,
+                                    const Eigen::Ref<const Eigen::MatrixXd> &A,
+                                    const Eigen::Ref<const Eigen::VectorXd> &b,
+                                    const Eigen::Ref<const Eigen::MatrixXd> &A_validation,
+                                    const Eigen::Ref<const Eigen::VectorXd> &b_validation,
                                     const double fnorm,
                                     const double fnorm_validation,
                                     const std::string file_coef,
@@ -355,9 +802,42 @@ namespace ALM_NS
                                     const std::vector<double> &alphas,
                                     std::vector<double> &training_error,
                                     std::vector<double> &validation_error,
-                                    std::vector<std::vector<int>> &nonzeros) const;
+                                    std::vector<std::vector<int>> &nonzeros,
+                                    const int patience = 0) const;
+
+        void run_enet_solution_path_downdate(const int maxorder,
+                                             const Eigen::Ref<const Eigen::MatrixXd> &A,
+                                             const Eigen::Ref<const Eigen::VectorXd> &b,
+                                             const Eigen::MatrixXd &Gram,
+                                             const Eigen::VectorXd &Atb,
+                                             const Eigen::VectorXd &colsum,
+                                             const size_t irow_validation,
+                                             const size_t nrows_validation,
+                                             const double fnorm,
+                                             const double fnorm_validation,
+                                             const std::string file_coef,
+                                             const Constraint *constraint,
+                                             const std::vector<double> &alphas,
+                                             std::vector<double> &training_error,
+                                             std::vector<double> &validation_error,
+                                             std::vector<std::vector<int>> &nonzeros,
+                                             double &alpha_max) const;
 
         void compute_alphas(std::vector<double> &alphas) const;
+
+        void refine_alphas(const std::vector<double> &alphas,
+                           const std::vector<double> &error,
+                           std::vector<double> &alphas_refined) const;
+
+        void sort_cvresult(std::vector<double> &alphas,
+                           std::vector<double> &training_error,
+                           std::vector<double> &validation_error,
+                           std::vector<std::vector<int>> &nonzeros) const;
+
+        void get_residual_norms(const Eigen::Ref<const Eigen::MatrixXd> &A,
+                                const Eigen::Ref<const Eigen::VectorXd> &b,
+                                const Eigen::Ref<const Eigen::MatrixXd> &Z,
+                                Eigen::VectorXd &res2) const;
     };
 
     inline double shrink(const double x,
@@ -397,6 +877,172 @@ namespace ALM_NS
                  int *lwork,
                  int *info);
 
+    void dsyrk_(char *uplo,
+                char *trans,
+                int *n,
+                int *k,
+                double *alpha,
+                double *a,
+                int *lda,
+                double *beta,
+                double *c,
+                int *ldc);
+
+    void dgemv_(char *trans,
+                int *m,
+                int *n,
+                double *alpha,
+                double *a,
+                int *lda,
+                double *x,
+                int *incx,
+                double *beta,
+                double *y,
+                int *incy);
+
+    void dgemm_(char *transa,
+                char *transb,
+                int *m,
+                int *n,
+                int *k,
+                double *alpha,
+                double *a,
+                int *lda,
+                double *b,
+                int *ldb,
+                double *beta,
+                double *c,
+                int *ldc);
+
+    void dsymv_(char *uplo,
+                int *n,
+                double *alpha,
+                double *a,
+                int *lda,
+                double *x,
+                int *incx,
+                double *beta,
+                double *y,
+                int *incy);
+
+    void dpotrf_(char *uplo,
+                 int *n,
+                 double *a,
+                 int *lda,
+                 int *info);
+
+    void dpotrs_(char *uplo,
+                 int *n,
+                 int *nrhs,
+                 double *a,
+                 int *lda,
+                 double *b,
+                 int *ldb,
+                 int *info);
+
+    void dpocon_(char *uplo,
+                 int *n,
+                 double *a,
+                 int *lda,
+                 double *anorm,
+                 double *rcond,
+                 double *work,
+                 int *iwork,
+                 int *info);
+
+    double dlansy_(char *norm,
+                   char *uplo,
+                   int *n,
+                   double *a,
+                   int *lda,
+                   double *work);
+
+    void dgeqrf_(int *m,
+                 int *n,
+                 double *a,
+                 int *lda,
+                 double *tau,
+                 double *work,
+                 int *lwork,
+                 int *info);
+
+    void dormqr_(char *side,
+                 char *trans,
+                 int *m,
+                 int *n,
+                 int *k,
+                 double *a,
+                 int *lda,
+                 double *tau,
+                 double *c,
+                 int *ldc,
+                 double *work,
+                 int *lwork,
+                 int *info);
+
+    void dorgqr_(int *m,
+                 int *n,
+                 int *k,
+                 double *a,
+                 int *lda,
+                 double *tau,
+                 double *work,
+                 int *lwork,
+                 int *info);
+
+    void dtrcon_(char *norm,
+                 char *uplo,
+                 char *diag,
+                 int *n,
+                 double *a,
+                 int *lda,
+                 double *rcond,
+                 double *work,
+                 int *iwork,
+                 int *info);
+
+    void dtrtrs_(char *uplo,
+                 char *trans,
+                 char *diag,
+                 int *n,
+                 int *nrhs,
+                 double *a,
+                 int *lda,
+                 double *b,
+                 int *ldb,
+                 int *info);
+
+    void dtpqrt_(int *m,
+                 int *n,
+                 int *l,
+                 int *nb,
+                 double *a,
+                 int *lda,
+                 double *b,
+                 int *ldb,
+                 double *t,
+                 int *ldt,
+                 double *work,
+                 int *info);
+
+    void dtpmqrt_(char *side,
+                  char *trans,
+                  int *m,
+                  int *n,
+                  int *k,
+                  int *l,
+                  int *nb,
+                  double *v,
+                  int *ldv,
+                  double *t,
+                  int *ldt,
+                  double *a,
+                  int *lda,
+                  double *b,
+                  int *ldb,
+                  double *work,
+                  int *info);
+
     void dgeqp3_(int *m,
                  int *n,
                  double *a,
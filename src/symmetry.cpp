@@ -94,6 +94,11 @@ size_t Symmetry::get_ntran() const
     return ntran;
 }
 
+size_t Symmetry::get_generation() const
+{
+    return generation;
+}
+
 size_t Symmetry::get_nat_prim() const
 {
     return nat_prim;
@@ -135,6 +140,7 @@ void Symmetry::init(const System *system,
 
     gen_mapping_information(system->get_supercell(),
                             system->get_atomtype_group());
+    ++generation;
 
     if (verbosity > 0) {
         print_symminfo_stdout();
@@ -156,6 +162,7 @@ void Symmetry::set_default_variables()
     printsymmetry = false;
     ntran = 0;
     nat_prim = 0;
+    generation = 0;
     tolerance = 1e-3;
     use_internal_symm_finder = false;
 }
@@ -123,9 +123,11 @@ namespace ALM_NS
         size_t get_nsym() const;
         size_t get_ntran() const;
         size_t get_nat_prim() const;
+        size_t get_generation() const;
 
     private:
         size_t nsym, ntran, nat_prim;
+        size_t generation; // incremented whenever the symmetry operations are regenerated
         std::vector<std::vector<int>> map_sym;   // [nat, nsym]
         std::vector<std::vector<int>> map_p2s;   // [nat_prim, ntran]
         std::vector<Maps> map_s2p;               // [nat]
@@ -92,17 +92,24 @@ void Writer::write_input_vars(const ALM *alm) const
         }
 
         std::cout << "  ICONST = " << alm->constraint->get_constraint_mode() << '\n';
+        std::cout << "  CONST_SOLVER = " << alm->constraint->get_constraint_solver() << '\n';
         std::cout << "  ROTAXIS = " << alm->constraint->get_rotation_axis() << '\n';
         std::cout << "  FC2XML = " << alm->constraint->get_fc_file(2) << '\n';
         std::cout << "  FC3XML = " << alm->constraint->get_fc_file(3) << "\n\n";
-        std::cout << "  SPARSE = " << optctrl.use_sparse_solver << "\n\n";
+        std::cout << "  SPARSE = " << optctrl.use_sparse_solver << '\n';
+        std::cout << "  SPARSESOLVER = " << optctrl.sparsesolver << '\n';
+        std::cout << "  DENSESOLVER = " << optctrl.densesolver << '\n';
+        std::cout << "  NDATA_CHUNK = " << optctrl.ndata_chunk << "\n\n";
         if (optctrl.linear_model == 2) {
             std::cout << " Elastic-net related variables:\n";
             std::cout << "  CV = " << std::setw(5) << optctrl.cross_validation << '\n';
+            std::cout << "  CV_PARALLEL = " << optctrl.parallel_cv
+                << "; CV_PATIENCE = " << optctrl.cv_patience << '\n';
             std::cout << "  DFSET_CV = " << alm->files->get_datfile_validation().filename << '\n';
             std::cout << "  NDATA_CV = " << alm->files->get_datfile_validation().ndata
                 << "; NSTART_CV = " << alm->files->get_datfile_validation().nstart
                 << "; NEND_CV = " << alm->files->get_datfile_validation().nend << "\n\n";
+            std::cout << "  ENET_SOLVER = " << optctrl.enet_solver << '\n';
             std::cout << "  L1_RATIO = " << optctrl.l1_ratio << '\n';
             std::cout << "  L1_ALPHA = " << optctrl.l1_alpha << '\n';
             std::cout << "  CV_MINALPHA = " << optctrl.l1_alpha_min
@@ -114,6 +121,7 @@ void Writer::write_input_vars(const ALM *alm) const
             std::cout << "  MAXITER = " << optctrl.maxnum_iteration << '\n';
             std::cout << "  NWRITE = " << std::setw(5) << optctrl.output_frequency << '\n';
             std::cout << "  DEBIAS_OLS = " << optctrl.debiase_after_l1opt << '\n';
+            std::cout << "  GRAM_CACHE = " << optctrl.gram_cache_mb << '\n';
             std::cout << '\n';
         }
     }
@@ -0,0 +1,64 @@
+#!/usr/bin/env python
+# coding: utf-8
+#
+#  SiC_incremental.py
+#
+#  This checks that the incremental fitting with appended data gives
+#  the same force constants as the fitting of all the data from scratch.
+#
+
+import numpy as np
+from alm import ALM
+
+
+lavec = np.loadtxt('lavec.dat')
+xcoord = np.loadtxt('xcoord.dat')
+kd = np.loadtxt('kd.dat')
+force = np.loadtxt("sic_force.dat").reshape((-1, 64, 3))
+disp = np.loadtxt("sic_disp.dat").reshape((-1, 64, 3))
+
+np.random.seed(1)
+force += 5e-4 * np.random.random(force.shape)
+nfirst = 8
+
+
+def fit_all(translation):
+    with ALM(lavec, xcoord, kd) as alm:
+        alm.define(1)
+        alm.set_constraint(translation=translation)
+        alm.set_verbosity(0)
+        alm.set_displacement_and_force(disp, force)
+        info = alm.optimize(solver='dense')
+        assert info == 0
+        fc_values, elem_indices = alm.get_fc(1)
+    return fc_values
+
+
+def check(fc_values, fc_ref, label):
+    diff = np.abs(fc_values - fc_ref).max()
+    print('%s: max |dFC2| = %.3e' % (label, diff))
+    assert diff < 1e-8 * max(1.0, np.abs(fc_ref).max())
+
+
+# alm.alm_new() and alm.alm_delete() are done by 'with' statement
+with ALM(lavec, xcoord, kd) as alm:
+    alm.define(1)
+    alm.set_constraint(translation=True)
+    alm.set_verbosity(0)
+    alm.set_displacement_and_force(disp[:nfirst], force[:nfirst])
+    info = alm.optimize(incremental=True)
+    assert info == 0
+
+    # Only the appended entries are absorbed in the R factor.
+    alm.append_displacement_and_force(disp[nfirst:], force[nfirst:])
+    info = alm.optimize()
+    assert info == 0
+    fc_values, elem_indices = alm.get_fc(1)
+    check(fc_values, fit_all(True), 'Appended data')
+
+    # The R factor is discarded when the constraint is changed.
+    alm.set_constraint(translation=False)
+    info = alm.optimize()
+    assert info == 0
+    fc_values, elem_indices = alm.get_fc(1)
+    check(fc_values, fit_all(False), 'Constraint changed')
@@ -0,0 +1,51 @@
+#!/usr/bin/env python
+# coding: utf-8
+#
+#  SiC_multiple_forces.py
+#
+#  This checks that optimize_multiple_forces gives the same force constants
+#  as the fittings of the force sets one by one.
+#
+
+import numpy as np
+from alm import ALM
+from alm import _alm
+
+
+lavec = np.loadtxt('lavec.dat')
+xcoord = np.loadtxt('xcoord.dat')
+kd = np.loadtxt('kd.dat')
+force = np.loadtxt("sic_force.dat").reshape((-1, 64, 3))
+disp = np.loadtxt("sic_disp.dat").reshape((-1, 64, 3))
+
+np.random.seed(1)
+nsets = 3
+force_sets = np.array([force + 5e-4 * np.random.random(force.shape)
+                       for i in range(nsets)])
+
+for iconst in (11, 1):
+    # alm.alm_new() and alm.alm_delete() are done by 'with' statement
+    with ALM(lavec, xcoord, kd) as alm:
+        alm.define(1)
+        # ICONST = 1 is not reachable with set_constraint.
+        _alm.set_constraint_type(alm._id, iconst)
+        alm.set_verbosity(0)
+
+        fc2_single = []
+        for f in force_sets:
+            alm.set_displacement_and_force(disp, f)
+            info = alm.optimize(solver='dense')
+            assert info == 0
+            fc_values, elem_indices = alm.get_fc(1)
+            fc2_single.append(fc_values)
+
+        info, fc_sets = alm.optimize_multiple_forces(disp, force_sets)
+        assert info == 0
+
+        for i in range(nsets):
+            alm.set_fc(fc_sets[i])
+            fc_values, elem_indices = alm.get_fc(1)
+            diff = np.abs(fc_values - fc2_single[i]).max()
+            print('ICONST = %2d, force set %d: max |dFC2| = %.3e'
+                  % (iconst, i, diff))
+            assert diff < 1e-8 * max(1.0, np.abs(fc2_single[i]).max())
@@ -0,0 +1,153 @@
+#!/usr/bin/env python
+#
+# dfset2bin.py
+#
+# Simple script to convert a DFSET file in the text format into
+# the binary format, which can be loaded by ALM without text parsing.
+#
+# This file is distributed under the terms of the MIT license.
+# Please see the file 'LICENCE.txt' in the root directory
+# or http://opensource.org/licenses/mit-license.php for information.
+#
+
+"""
+This python script converts a text DFSET file into the binary DFSET format.
+
+Usage:
+    $ python dfset2bin.py --nat=64 DFSET DFSET.bin
+
+The binary file starts with a 64-byte header
+
+    char     magic[8]     "ALMDFSET"
+    uint32   version      1
+    uint32   byte_order   0x01020304
+    uint64   nat
+    uint64   ndata
+    uint64   data_offset  64
+    char     units[24]    "Rydberg" (Bohr, Ryd/Bohr)
+
+followed by ndata entries, each of which contains 3*nat displacements
+and then 3*nat forces as doubles in the native byte order.
+When --unit=eV (Angstrom, eV/Angstrom) or --unit=Hartree (Bohr, Hartree/Bohr)
+is given, the values are converted into Bohr and Ryd/Bohr before writing.
+The binary file can be given to the DFSET-tag as it is.
+"""
+
+from __future__ import print_function
+import numpy as np
+import optparse
+import struct
+import sys
+
+usage = "usage: %prog [options] DFSET DFSET.bin"
+parser = optparse.OptionParser(usage=usage)
+
+parser.add_option('--nat',
+                  type="int",
+                  help="number of atoms in the supercell")
+
+parser.add_option('--unit',
+                  action="store",
+                  type="string",
+                  dest="unitname",
+                  default="Rydberg",
+                  help="units of the displacements and forces in DFSET. \
+                        Available options are 'eV', 'Rydberg' (default), and 'Hartree'.")
+
+parser.add_option('--chunk',
+                  type="int",
+                  default=100,
+                  help="number of entries converted at a time (default: 100)")
+
+HEADER_FORMAT = '=8sIIQQQ24s'
+HEADER_SIZE = struct.calcsize(HEADER_FORMAT)
+
+
+def get_unit_conversion_factor(unitname):
+    # Factors converting displacements and forces into Bohr and Ryd/Bohr
+    # (the same constants as in the interface scripts of extract.py)
+
+    Bohr_radius = 0.52917721067
+    Rydberg_to_eV = 13.60569253
+
+    if unitname == "eV":
+        disp_conv_factor = 1.0 / Bohr_radius
+        energy_conv_factor = 1.0 / Rydberg_to_eV
+    elif unitname == "Hartree":
+        disp_conv_factor = 1.0
+        energy_conv_factor = 2.0
+    else:
+        disp_conv_factor = 1.0
+        energy_conv_factor = 1.0
+
+    return disp_conv_factor, energy_conv_factor / disp_conv_factor
+
+
+def pack_header(nat, ndata):
+    return struct.pack(HEADER_FORMAT, b'ALMDFSET', 1, 0x01020304,
+                       nat, ndata, HEADER_SIZE, b'Rydberg')
+
+
+def write_entries(fout, values, nat, unitname):
+    # Rearrange (nat, 6) rows of each entry into [u(3*nat), f(3*nat)]
+    disp_conv_factor, force_conv_factor = get_unit_conversion_factor(unitname)
+    arr = np.array(values, dtype=np.float64).reshape(-1, nat, 6)
+    out = np.concatenate((arr[:, :, :3].reshape(-1, 3 * nat) * disp_conv_factor,
+                          arr[:, :, 3:].reshape(-1, 3 * nat) * force_conv_factor), axis=1)
+    fout.write(out.astype('=f8').tobytes())
+    return arr.shape[0]
+
+
+def convert(file_in, file_out, nat, unitname, nchunk):
+
+    nvalues_chunk = 6 * nat * nchunk
+    values = []
+    ndata = 0
+
+    with open(file_out, 'wb') as fout:
+        fout.write(pack_header(nat, 0))
+
+        with open(file_in, 'r') as fin:
+            for line in fin:
+                line = line.strip()
+                if not line or line[0] == '#':
+                    continue
+                values.extend([float(t) for t in line.split()])
+
+                if len(values) >= nvalues_chunk:
+                    ndata += write_entries(fout, values[:nvalues_chunk], nat, unitname)
+                    values = values[nvalues_chunk:]
+
+        if len(values) % (6 * nat) != 0:
+            print("The number of lines in DFSET is indivisible by NAT")
+            sys.exit(1)
+
+        if values:
+            ndata += write_entries(fout, values, nat, unitname)
+
+        fout.seek(0)
+        fout.write(pack_header(nat, ndata))
+
+    return ndata
+
+
+if __name__ == '__main__':
+
+    options, args = parser.parse_args()
+
+    if len(args) != 2:
+        parser.print_help()
+        sys.exit(1)
+
+    if options.nat is None or options.nat <= 0:
+        print("--nat option must be given.")
+        sys.exit(1)
+
+    if options.unitname not in ['eV', 'Rydberg', 'Hartree']:
+        print("Invalid --unit option: %s" % options.unitname)
+        sys.exit(1)
+
+    ndata = convert(args[0], args[1], options.nat,
+                    options.unitname, options.chunk)
+
+    print("%d entries have been written to %s" % (ndata, args[1]))